@@ -0,0 +1,10 @@
+// Ricardas Navickas 2020
+// Shader for orbits drawn as conics (see draw_orbit())
+#version 330 core
+out vec4 FragColor;
+
+uniform vec4 color;
+
+void main(void) {
+	FragColor = color;
+}
@@ -0,0 +1,23 @@
+// Ricardas Navickas 2020
+// Shader for orbits drawn as conics (see draw_orbit()), with no vertex data: each vertex is a point of
+// the conic at a true anomaly picked by gl_VertexID
+#version 330 core
+uniform mat4 model; // translation to the focus
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform float semi_latus_rectum;
+uniform float eccentricity;
+uniform vec3 periapsis_dir;
+uniform vec3 motion_dir;
+uniform float anomaly_start;
+uniform float anomaly_end;
+uniform int segments;
+
+void main(void) {
+	float anomaly = mix(anomaly_start, anomaly_end, float(gl_VertexID) / float(segments));
+	float radius = semi_latus_rectum / (1.0f + eccentricity * cos(anomaly));
+	vec3 pos = radius * (cos(anomaly) * periapsis_dir + sin(anomaly) * motion_dir);
+
+	gl_Position = projection * view * model * vec4(pos, 1.0f);
+}
@@ -0,0 +1,13 @@
+// Ricardas Navickas 2020
+// Shader for particles (see ParticleEmitter): round, fading out towards the edge
+#version 330 core
+in vec2 corner;
+in vec4 particle_color;
+out vec4 FragColor;
+
+void main(void) {
+	float r2 = dot(corner, corner);
+	if (r2 > 1.0f) discard;
+
+	FragColor = vec4(particle_color.rgb, particle_color.a * (1.0f - r2));
+}
@@ -0,0 +1,26 @@
+// Ricardas Navickas 2020
+// Shader for particles (see ParticleEmitter), drawn instanced: a camera facing quad per particle
+#version 330 core
+layout (location = 0) in vec2 aCorner;   // of the quad, -1 to 1
+layout (location = 1) in vec4 aParticle; // position (relative to the emitter's origin) & age as a fraction of life
+
+out vec2 corner;
+out vec4 particle_color;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform float size_start;
+uniform float size_end;
+uniform vec4 color_start;
+uniform vec4 color_end;
+
+void main(void) {
+	float size = mix(size_start, size_end, aParticle.w);
+	vec4 center = view * model * vec4(aParticle.xyz, 1.0f);
+
+	gl_Position = projection * (center + vec4(aCorner * size, 0.0f, 0.0f));
+	corner = aCorner;
+	particle_color = mix(color_start, color_end, aParticle.w);
+}
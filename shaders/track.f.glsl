@@ -0,0 +1,11 @@
+// Ricardas Navickas 2020
+// Shader for tracks kept in ring buffers (see TrackBuffer)
+#version 330 core
+in float alpha;
+out vec4 FragColor;
+
+uniform vec3 color;
+
+void main(void) {
+	FragColor = vec4(color, alpha);
+}
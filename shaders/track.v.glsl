@@ -0,0 +1,22 @@
+// Ricardas Navickas 2020
+// Shader for tracks kept in ring buffers (see TrackBuffer)
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+out float alpha;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform int last;     // slot of the newest vertex
+uniform int length;   // vertices drawn
+uniform int capacity; // slots in the ring (the one after the last repeats slot 0)
+
+void main(void) {
+	gl_Position = projection * view * model * vec4(aPos, 1.0f);
+
+	// Fade out with the number of vertices since this one
+	int age = (last - gl_VertexID % capacity + capacity) % capacity;
+	alpha = 1.0f - float(age) / float(length);
+}
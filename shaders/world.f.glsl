@@ -16,6 +16,7 @@ uniform vec3 fog_color = vec3(0.7f, 0.5f, 0.5f);
 uniform vec3 view_pos;
 
 uniform bool apply_lighting = true;
+uniform float opacity = 1.0f;
 uniform int num_of_lights = 0;
 uniform vec3 light_pos[MAX_NUM_OF_LIGHTS];
 uniform vec3 light_color[MAX_NUM_OF_LIGHTS];
@@ -36,7 +37,7 @@ void main(void) {
 		result = result * light();
 	} else {
 		// If lighting is disabled, use the normal vector to determine alpha
-		alpha = normal_length;
+		alpha = normal_length * opacity;
 	}
 
 	if (apply_fog == true)
@@ -1,10 +1,24 @@
 // Ricardas Navickas 2020
 #include "autopilot.h"
 #include "lander.h"
-#include "gui.h"
+#include "mars.h"
 #include "pid.h"
-#include "global.h"
 #include "simulation.h"
+#include "core/state_blob.h"
+
+#include <cstring>
+#include <unordered_map>
+
+// Tags of stored Lua values (see save_autopilot_globals())
+#define STORED_END 0
+#define STORED_BOOLEAN 1
+#define STORED_NUMBER 2
+#define STORED_INTEGER 3
+#define STORED_STRING 4
+#define STORED_TABLE 5
+#define STORED_TABLE_REF 6 // a table stored earlier in the same save, by id
+
+#define STORED_MAX_DEPTH 16 // of nested tables
 
 // Lua helper functions
 int TIME(lua_State* L);
@@ -18,6 +32,7 @@ int LANDER_DELTA_V(lua_State* L);
 int LANDER_MAX_THRUST(lua_State* L);
 int LANDER_WEIGHT(lua_State* L);
 int LANDER_MASS(lua_State* L);
+int LANDER_STATE(lua_State* L);
 
 int PERIAPSIS_ALT(lua_State* L);
 int APOAPSIS_ALT(lua_State* L);
@@ -41,71 +56,171 @@ int DEPLOY_PARACHUTE(lua_State* L);
 int INFO(lua_State* L);
 int PAUSE(lua_State* L);
 
+static void register_function(lua_State* L, SimulationContext* ctx, const char* name, lua_CFunction f);
+static SimulationContext* get_context(lua_State* L);
+
+static bool storable_global(lua_State* L);
+// Ids of the tables stored so far in one save (numbered from 1 in the order they are stored). Each
+// table is stored once and referred to by id afterwards, so shared & cyclic tables are restored as such.
+typedef std::unordered_map<const void*, uint32_t> StoredTableIds;
+
+static bool storable_value(lua_State* L, int index, int depth);
+static void save_table(lua_State* L, StateWriter& w, StoredTableIds& ids, int depth);
+static void save_value(lua_State* L, int index, StateWriter& w, StoredTableIds& ids, int depth);
+static bool restore_table(lua_State* L, StateReader& r, int tables, int depth);
+static bool restore_value(lua_State* L, StateReader& r, char tag, int tables, int depth);
+
 // ==== ==== ==== ==== ==== ==== ==== ====
 
-AutopilotProgram make_autopilot_program(std::string lua_path) {
+AutopilotControllers::AutopilotControllers() :
+	attitude_stabilizer(5.0, 0.0, 0.0),
+	attitude_controller(5.0, 0.0, 0.0),
+	attitude_damper(5.0, 0.0, 0.0),
+	velocity_controller(1000.0, 100.0, 0.0) {}
+
+AutopilotProgram make_autopilot_program(SimulationContext* ctx, std::string lua_path) {
 	AutopilotProgram ap;
 
 	ap.path = lua_path;
 
 	ap.L = luaL_newstate();
 	luaL_openlibs(ap.L);
-	lua_register(ap.L, "TIME", TIME);
-	lua_register(ap.L, "LANDER_ALT", LANDER_ALT);
-	lua_register(ap.L, "LANDER_VELOCITY", LANDER_VELOCITY);
-	lua_register(ap.L, "LANDER_SURFACE_VELOCITY", LANDER_SURFACE_VELOCITY);
-	lua_register(ap.L, "LANDER_GROUND_SPEED", LANDER_GROUND_SPEED);
-	lua_register(ap.L, "LANDER_DESCENT_RATE", LANDER_DESCENT_RATE);
-	lua_register(ap.L, "LANDER_DELTA_V", LANDER_DELTA_V);
-	lua_register(ap.L, "LANDER_MAX_THRUST", LANDER_MAX_THRUST);
-	lua_register(ap.L, "LANDER_WEIGHT", LANDER_WEIGHT);
-	lua_register(ap.L, "LANDER_MASS", LANDER_MASS);
-	lua_register(ap.L, "PERIAPSIS_ALT", PERIAPSIS_ALT);
-	lua_register(ap.L, "APOAPSIS_ALT", APOAPSIS_ALT);
-	lua_register(ap.L, "MAINTAIN_ATTITUDE", MAINTAIN_ATTITUDE);
-	lua_register(ap.L, "HOLD_PROGRADE", HOLD_PROGRADE);
-	lua_register(ap.L, "HOLD_RETROGRADE", HOLD_RETROGRADE);
-	lua_register(ap.L, "HOLD_NORMAL", HOLD_NORMAL);
-	lua_register(ap.L, "HOLD_ANTINORMAL", HOLD_ANTINORMAL);
-	lua_register(ap.L, "HOLD_RADIAL", HOLD_RADIAL);
-	lua_register(ap.L, "HOLD_ANTIRADIAL", HOLD_ANTIRADIAL);
-	lua_register(ap.L, "HOLD_SURFACE_PROGRADE", HOLD_SURFACE_PROGRADE);
-	lua_register(ap.L, "HOLD_SURFACE_RETROGRADE", HOLD_SURFACE_RETROGRADE);
-	lua_register(ap.L, "SET_MAIN_ENGINE_THROTTLE", SET_MAIN_ENGINE_THROTTLE);
-	lua_register(ap.L, "MAINTAIN_SURFACE_VELOCITY", MAINTAIN_SURFACE_VELOCITY);
-	lua_register(ap.L, "DEPLOY_PARACHUTE", DEPLOY_PARACHUTE);
-	lua_register(ap.L, "INFO", INFO);
-	lua_register(ap.L, "PAUSE", PAUSE);
+	register_function(ap.L, ctx, "TIME", TIME);
+	register_function(ap.L, ctx, "LANDER_ALT", LANDER_ALT);
+	register_function(ap.L, ctx, "LANDER_VELOCITY", LANDER_VELOCITY);
+	register_function(ap.L, ctx, "LANDER_SURFACE_VELOCITY", LANDER_SURFACE_VELOCITY);
+	register_function(ap.L, ctx, "LANDER_GROUND_SPEED", LANDER_GROUND_SPEED);
+	register_function(ap.L, ctx, "LANDER_DESCENT_RATE", LANDER_DESCENT_RATE);
+	register_function(ap.L, ctx, "LANDER_DELTA_V", LANDER_DELTA_V);
+	register_function(ap.L, ctx, "LANDER_MAX_THRUST", LANDER_MAX_THRUST);
+	register_function(ap.L, ctx, "LANDER_WEIGHT", LANDER_WEIGHT);
+	register_function(ap.L, ctx, "LANDER_MASS", LANDER_MASS);
+	register_function(ap.L, ctx, "LANDER_STATE", LANDER_STATE);
+	register_function(ap.L, ctx, "PERIAPSIS_ALT", PERIAPSIS_ALT);
+	register_function(ap.L, ctx, "APOAPSIS_ALT", APOAPSIS_ALT);
+	register_function(ap.L, ctx, "MAINTAIN_ATTITUDE", MAINTAIN_ATTITUDE);
+	register_function(ap.L, ctx, "HOLD_PROGRADE", HOLD_PROGRADE);
+	register_function(ap.L, ctx, "HOLD_RETROGRADE", HOLD_RETROGRADE);
+	register_function(ap.L, ctx, "HOLD_NORMAL", HOLD_NORMAL);
+	register_function(ap.L, ctx, "HOLD_ANTINORMAL", HOLD_ANTINORMAL);
+	register_function(ap.L, ctx, "HOLD_RADIAL", HOLD_RADIAL);
+	register_function(ap.L, ctx, "HOLD_ANTIRADIAL", HOLD_ANTIRADIAL);
+	register_function(ap.L, ctx, "HOLD_SURFACE_PROGRADE", HOLD_SURFACE_PROGRADE);
+	register_function(ap.L, ctx, "HOLD_SURFACE_RETROGRADE", HOLD_SURFACE_RETROGRADE);
+	register_function(ap.L, ctx, "SET_MAIN_ENGINE_THROTTLE", SET_MAIN_ENGINE_THROTTLE);
+	register_function(ap.L, ctx, "MAINTAIN_SURFACE_VELOCITY", MAINTAIN_SURFACE_VELOCITY);
+	register_function(ap.L, ctx, "DEPLOY_PARACHUTE", DEPLOY_PARACHUTE);
+	register_function(ap.L, ctx, "INFO", INFO);
+	register_function(ap.L, ctx, "PAUSE", PAUSE);
 
 	if (luaL_dofile(ap.L, lua_path.c_str()) != LUA_OK) {
-		guistate.autopilot_message_log.push_back(std::string("[INFO] Lua error: ") + lua_tostring(ap.L, -1));
+		ctx->autopilot_message_log.push_back(std::string("[INFO] Lua error: ") + lua_tostring(ap.L, -1));
 		ap.loaded = false;
 	} else {
-		guistate.autopilot_message_log.push_back("[INFO] Successfully loaded script from " + ap.path);
+		ctx->autopilot_message_log.push_back("[INFO] Successfully loaded script from " + ap.path);
 		ap.loaded = true;
 	}
 
+	record_autopilot_load(ctx, lua_path);
+
 	return ap;
 }
 
-void run_autopilot_program(AutopilotProgram* ap) {
+void free_autopilot_program(AutopilotProgram* ap) {
+	if (ap->L != NULL) lua_close(ap->L);
+	ap->L = NULL;
+	ap->loaded = false;
+}
+
+void run_autopilot_program(SimulationContext* ctx) {
+	AutopilotProgram* ap = &ctx->ap;
 	lua_getglobal(ap->L, "STEP");
 
 	if (!lua_isfunction(ap->L, 1)) {
-		guistate.autopilot_message_log.push_back("[INFO] STEP() not defined. Unloading autopilot program.");
+		ctx->autopilot_message_log.push_back("[INFO] STEP() not defined. Unloading autopilot program.");
 		lua_pop(ap->L, 1);
 		ap->loaded = false;
 		return;
 	}
 
 	if (lua_pcall(ap->L, 0, 0, 0) != LUA_OK) {
-		guistate.autopilot_message_log.push_back(std::string("[INFO] Lua error: ") + lua_tostring(ap->L, -1));
+		ctx->autopilot_message_log.push_back(std::string("[INFO] Lua error: ") + lua_tostring(ap->L, -1));
 		ap->loaded = false;
 	}
 }
 
-void attitude_stabilization_step(Object* lander, double timestep) {
-	static PIDController attitude_stabilizer(5.0, 0.0, 0.0);
+void save_autopilot_globals(AutopilotProgram* ap, StateWriter& w) {
+	if (ap->L == NULL) {
+		w.put((char)STORED_END);
+		return;
+	}
+
+	lua_State* L = ap->L;
+	lua_pushglobaltable(L);
+
+	// The global table itself is table 1 (in case some table refers to it)
+	StoredTableIds ids;
+	ids[lua_topointer(L, -1)] = 1;
+
+	lua_pushnil(L);
+	while (lua_next(L, -2) != 0) {
+		if (storable_global(L)) {
+			save_value(L, -2, w, ids, 0);
+			save_value(L, -1, w, ids, 0);
+		}
+		lua_pop(L, 1);
+	}
+	lua_pop(L, 1);
+
+	w.put((char)STORED_END);
+}
+
+bool restore_autopilot_globals(AutopilotProgram* ap, StateReader& r) {
+	if (ap->L == NULL) {
+		char tag = -1;
+		return r.get(&tag) && tag == STORED_END;
+	}
+
+	lua_State* L = ap->L;
+	int top = lua_gettop(L);
+
+	// Clear the current ones first (keys can't be removed while iterating)
+	std::vector<std::string> names;
+	lua_pushglobaltable(L);
+	lua_pushnil(L);
+	while (lua_next(L, -2) != 0) {
+		if (storable_global(L)) names.push_back(lua_tostring(L, -2));
+		lua_pop(L, 1);
+	}
+
+	for (unsigned int i = 0; i < names.size(); i++) {
+		lua_pushstring(L, names[i].c_str());
+		lua_pushnil(L);
+		lua_rawset(L, -3);
+	}
+
+	// Restored tables by id, starting with the global table
+	lua_newtable(L);
+	const int tables = lua_gettop(L);
+	lua_pushvalue(L, -2);
+	lua_rawseti(L, tables, 1);
+
+	lua_pushvalue(L, -2);
+	bool ok = restore_table(L, r, tables, 0);
+	lua_settop(L, top);
+
+	return ok;
+}
+
+void reset_autopilot_controllers(AutopilotControllers* c) {
+	c->attitude_stabilizer.reset();
+	c->attitude_controller.reset();
+	c->attitude_damper.reset();
+	c->velocity_controller.reset();
+}
+
+void attitude_stabilization_step(AutopilotControllers* c, Lander* lander, double timestep) {
+	PIDController& attitude_stabilizer = c->attitude_stabilizer;
 
 	double error = glm::length(lander->ang_velocity);
 
@@ -115,9 +230,9 @@ void attitude_stabilization_step(Object* lander, double timestep) {
 	setup_rcs(lander, -lander->ang_velocity, attitude_stabilizer.output());
 }
 
-void attitude_control_step(Object* lander, glm::dvec3 target, double timestep) {
-	static PIDController attitude_controller(5.0, 0.0, 0.0);
-	static PIDController attitude_stabilizer(5.0, 0.0, 0.0);
+void attitude_control_step(AutopilotControllers* c, Lander* lander, glm::dvec3 target, double timestep) {
+	PIDController& attitude_controller = c->attitude_controller;
+	PIDController& attitude_stabilizer = c->attitude_damper;
 
 	if (glm::length(target) == 0) return;
 	target = glm::normalize(target);
@@ -148,8 +263,8 @@ void attitude_control_step(Object* lander, glm::dvec3 target, double timestep) {
 }
 
 // Assumes that lander is already pointed retrograde
-void surface_velocity_control_step(Object* mars, Object* lander, double target, double timestep) {
-	static PIDController velocity_controller(1000.0, 100.0, 0.0);
+void surface_velocity_control_step(AutopilotControllers* c, Object* mars, Lander* lander, double target, double timestep) {
+	PIDController& velocity_controller = c->velocity_controller;
 
 	double surface_velocity_magnitude = glm::length(lander->velocity - mars_surface_velocity(mars, lander->position));
 	double error = surface_velocity_magnitude - target;
@@ -161,142 +276,344 @@ void surface_velocity_control_step(Object* mars, Object* lander, double target,
 
 // ==== ==== ==== ==== LUA FUNCTIONS ==== ==== ==== ====
 int TIME(lua_State* L) {
-	lua_pushnumber(L, simstate.time);
+	SimulationContext* ctx = get_context(L);
+	lua_pushnumber(L, ctx->state.time);
 	return 1;
 }
 
 int LANDER_ALT(lua_State* L) {
-	lua_pushnumber(L, glm::length(lander->position - mars->position) - MARS_RADIUS - mars_surface_height(mars, lander->position - mars->position) - BASE_COM_DIST);
+	SimulationContext* ctx = get_context(L);
+	lua_pushnumber(L, glm::length(ctx->lander->position - ctx->mars->position) - MARS_RADIUS - mars_surface_height(ctx->mars, &ctx->env, &ctx->terrain, TERRAIN_PHYSICS_LEVEL, ctx->lander->position - ctx->mars->position) - BASE_COM_DIST);
 	return 1;
 }
 
 int LANDER_VELOCITY(lua_State* L) {
-	lua_pushnumber(L, glm::length(lander->velocity));
+	SimulationContext* ctx = get_context(L);
+	lua_pushnumber(L, glm::length(ctx->lander->velocity));
 	return 1;
 }
 
 int LANDER_SURFACE_VELOCITY(lua_State* L) {
-	lua_pushnumber(L, glm::length(lander->velocity - mars_surface_velocity(mars, lander->position)));
+	SimulationContext* ctx = get_context(L);
+	lua_pushnumber(L, glm::length(ctx->lander->velocity - mars_surface_velocity(ctx->mars, ctx->lander->position)));
 	return 1;
 }
 
 int LANDER_GROUND_SPEED(lua_State* L) {
-	double descent_rate = glm::dot(-lander->velocity, glm::normalize(lander->position - mars->position));
-	glm::dvec3 dist = lander->position - mars->position;
-	double groundspeed = glm::length(lander->velocity + glm::normalize(dist) * descent_rate - mars_surface_velocity(mars, lander->position));
+	SimulationContext* ctx = get_context(L);
+	double descent_rate = glm::dot(-ctx->lander->velocity, glm::normalize(ctx->lander->position - ctx->mars->position));
+	glm::dvec3 dist = ctx->lander->position - ctx->mars->position;
+	double groundspeed = glm::length(ctx->lander->velocity + glm::normalize(dist) * descent_rate - mars_surface_velocity(ctx->mars, ctx->lander->position));
 	lua_pushnumber(L, groundspeed);
 	return 1;
 }
 
 int LANDER_DESCENT_RATE(lua_State* L) {
-	double descent_rate = glm::dot(-lander->velocity, glm::normalize(lander->position - mars->position));
+	SimulationContext* ctx = get_context(L);
+	double descent_rate = glm::dot(-ctx->lander->velocity, glm::normalize(ctx->lander->position - ctx->mars->position));
 	lua_pushnumber(L, descent_rate);
 	return 1;
 }
 
 int LANDER_DELTA_V(lua_State* L) {
-	lua_pushnumber(L, lander_delta_v(lander));
+	SimulationContext* ctx = get_context(L);
+	lua_pushnumber(L, lander_delta_v(ctx->lander));
 	return 1;
 }
 
 int LANDER_MAX_THRUST(lua_State* L) {
-	lua_pushnumber(L, lander->attribute["me_exhaust_vel"] * lander->attribute["me_max_fuel_rate"]);
+	SimulationContext* ctx = get_context(L);
+	lua_pushnumber(L, ctx->lander->state.me_exhaust_vel * ctx->lander->state.me_max_fuel_rate);
 	return 1;
 }
 
 int LANDER_WEIGHT(lua_State* L) {
-	lua_pushnumber(L, glm::length(grav_force(mars, lander)));
+	SimulationContext* ctx = get_context(L);
+	lua_pushnumber(L, glm::length(grav_force(ctx->mars, ctx->lander)));
 	return 1;
 }
 
 int LANDER_MASS(lua_State* L) {
-	lua_pushnumber(L, lander->mass);
+	SimulationContext* ctx = get_context(L);
+	lua_pushnumber(L, ctx->lander->mass);
+	return 1;
+}
+
+int LANDER_STATE(lua_State* L) {
+	SimulationContext* ctx = get_context(L);
+	const char* name = lua_tostring(L, 1);
+	double* field = (name != NULL) ? lander_state_field(&ctx->lander->state, name) : NULL;
+
+	if (field == NULL) {
+		lua_pushnil(L);
+	} else {
+		lua_pushnumber(L, *field);
+	}
 	return 1;
 }
 
 int PERIAPSIS_ALT(lua_State* L) {
-	lua_pushnumber(L, periapsis_radius(mars, lander) - MARS_RADIUS);
+	SimulationContext* ctx = get_context(L);
+	lua_pushnumber(L, periapsis_radius(ctx->mars, ctx->lander) - MARS_RADIUS);
 	return 1;
 }
 
 int APOAPSIS_ALT(lua_State* L) {
-	lua_pushnumber(L, apoapsis_radius(mars, lander) - MARS_RADIUS);
+	SimulationContext* ctx = get_context(L);
+	lua_pushnumber(L, apoapsis_radius(ctx->mars, ctx->lander) - MARS_RADIUS);
 	return 1;
 }
 
 int MAINTAIN_ATTITUDE(lua_State* L) {
-	attitude_stabilization_step(lander, simstate.timestep);
+	SimulationContext* ctx = get_context(L);
+	attitude_stabilization_step(&ctx->controllers, ctx->lander, ctx->state.timestep);
 	return 0;
 }
 
 int HOLD_PROGRADE(lua_State* L) {
-	attitude_control_step(lander, lander->velocity, simstate.timestep);
+	SimulationContext* ctx = get_context(L);
+	attitude_control_step(&ctx->controllers, ctx->lander, ctx->lander->velocity, ctx->state.timestep);
 	return 0;
 }
 
 int HOLD_RETROGRADE(lua_State* L) {
-	attitude_control_step(lander, -lander->velocity, simstate.timestep);
+	SimulationContext* ctx = get_context(L);
+	attitude_control_step(&ctx->controllers, ctx->lander, -ctx->lander->velocity, ctx->state.timestep);
 	return 0;
 }
 
 int HOLD_NORMAL(lua_State* L) {
-	glm::dvec3 normal = glm::cross(lander->velocity, lander->position - mars->position);
-	attitude_control_step(lander, normal, simstate.timestep);
+	SimulationContext* ctx = get_context(L);
+	glm::dvec3 normal = glm::cross(ctx->lander->velocity, ctx->lander->position - ctx->mars->position);
+	attitude_control_step(&ctx->controllers, ctx->lander, normal, ctx->state.timestep);
 	return 0;
 }
 
 int HOLD_ANTINORMAL(lua_State* L) {
-	glm::dvec3 normal = glm::cross(lander->velocity, lander->position - mars->position);
-	attitude_control_step(lander, -normal, simstate.timestep);
+	SimulationContext* ctx = get_context(L);
+	glm::dvec3 normal = glm::cross(ctx->lander->velocity, ctx->lander->position - ctx->mars->position);
+	attitude_control_step(&ctx->controllers, ctx->lander, -normal, ctx->state.timestep);
 	return 0;
 }
 
 int HOLD_RADIAL(lua_State* L) {
-	attitude_control_step(lander, lander->position - mars->position, simstate.timestep);
+	SimulationContext* ctx = get_context(L);
+	attitude_control_step(&ctx->controllers, ctx->lander, ctx->lander->position - ctx->mars->position, ctx->state.timestep);
 	return 0;
 }
 
 int HOLD_ANTIRADIAL(lua_State* L) {
-	attitude_control_step(lander, -lander->position + mars->position, simstate.timestep);
+	SimulationContext* ctx = get_context(L);
+	attitude_control_step(&ctx->controllers, ctx->lander, -ctx->lander->position + ctx->mars->position, ctx->state.timestep);
 	return 0;
 }
 
 int HOLD_SURFACE_PROGRADE(lua_State* L) {
-	attitude_control_step(lander, lander->velocity - mars_surface_velocity(mars, lander->position), simstate.timestep);
+	SimulationContext* ctx = get_context(L);
+	attitude_control_step(&ctx->controllers, ctx->lander, ctx->lander->velocity - mars_surface_velocity(ctx->mars, ctx->lander->position), ctx->state.timestep);
 	return 0;
 }
 
 int HOLD_SURFACE_RETROGRADE(lua_State* L) {
-	attitude_control_step(lander, -lander->velocity + mars_surface_velocity(mars, lander->position), simstate.timestep);
+	SimulationContext* ctx = get_context(L);
+	attitude_control_step(&ctx->controllers, ctx->lander, -ctx->lander->velocity + mars_surface_velocity(ctx->mars, ctx->lander->position), ctx->state.timestep);
 	return 0;
 }
 
 int SET_MAIN_ENGINE_THROTTLE(lua_State* L) {
+	SimulationContext* ctx = get_context(L);
 	double throttle = glm::clamp(lua_tonumber(L, 1), 0.0, 1.0);
-	setup_main_engine(lander, throttle);
+	setup_main_engine(ctx->lander, throttle);
 	return 0;
 }
 
 int MAINTAIN_SURFACE_VELOCITY(lua_State* L) {
+	SimulationContext* ctx = get_context(L);
 	double velocity_target = lua_tonumber(L, 1);
-	surface_velocity_control_step(mars, lander, velocity_target, simstate.timestep);
+	surface_velocity_control_step(&ctx->controllers, ctx->mars, ctx->lander, velocity_target, ctx->state.timestep);
 	return 0;
 }
 
 int DEPLOY_PARACHUTE(lua_State* L) {
-	deploy_parachute(lander);
+	SimulationContext* ctx = get_context(L);
+	deploy_parachute(ctx->lander, ctx->mars);
 	return 0;
 }
 
 int INFO(lua_State* L) {
+	SimulationContext* ctx = get_context(L);
 	const char* str = lua_tostring(L, 1);
-	std::string message = "[" + std::to_string(simstate.time) + "] " + str;
-	guistate.autopilot_message_log.push_back(message);
+	std::string message = "[" + std::to_string(ctx->state.time) + "] " + str;
+	ctx->autopilot_message_log.push_back(message);
 	return 0;
 }
 
 int PAUSE(lua_State* L) {
-	simstate.paused = true;
+	SimulationContext* ctx = get_context(L);
+	ctx->state.paused = true;
 	return 0;
 }
 
+// ==== ==== ==== ==== ==== ==== ==== ====
+
+// API functions receive their simulation context as an upvalue
+static void register_function(lua_State* L, SimulationContext* ctx, const char* name, lua_CFunction f) {
+	lua_pushlightuserdata(L, ctx);
+	lua_pushcclosure(L, f, 1);
+	lua_setglobal(L, name);
+}
+
+static SimulationContext* get_context(lua_State* L) {
+	return (SimulationContext*)lua_touserdata(L, lua_upvalueindex(1));
+}
+
+// Key & value on top of the stack are a global variable that save_autopilot_globals() stores
+static bool storable_global(lua_State* L) {
+	static const char* libraries[] = { "_G", "package", "coroutine", "table", "io", "os", "string", "math", "utf8", "debug", "bit32" };
+
+	if (lua_type(L, -2) != LUA_TSTRING || !storable_value(L, -1, 0)) return false;
+	if (lua_type(L, -1) != LUA_TTABLE) return true;
+
+	const char* name = lua_tostring(L, -2);
+	for (const char* library : libraries) {
+		if (strcmp(name, library) == 0) return false;
+	}
+
+	return true;
+}
+
+static bool storable_value(lua_State* L, int index, int depth) {
+	switch (lua_type(L, index)) {
+	case LUA_TBOOLEAN:
+	case LUA_TNUMBER:
+	case LUA_TSTRING:
+		return true;
+	case LUA_TTABLE:
+		return depth < STORED_MAX_DEPTH;
+	default:
+		return false;
+	}
+}
+
+// Stores the (key, value) pairs of the table on top of the stack, followed by STORED_END
+static void save_table(lua_State* L, StateWriter& w, StoredTableIds& ids, int depth) {
+	lua_pushnil(L);
+	while (lua_next(L, -2) != 0) {
+		if (storable_value(L, -2, depth) && lua_type(L, -2) != LUA_TTABLE && storable_value(L, -1, depth)) {
+			save_value(L, -2, w, ids, depth);
+			save_value(L, -1, w, ids, depth);
+		}
+		lua_pop(L, 1);
+	}
+
+	w.put((char)STORED_END);
+}
+
+static void save_value(lua_State* L, int index, StateWriter& w, StoredTableIds& ids, int depth) {
+	index = lua_absindex(L, index);
+
+	switch (lua_type(L, index)) {
+	case LUA_TBOOLEAN:
+		w.put((char)STORED_BOOLEAN);
+		w.put((char)lua_toboolean(L, index));
+		break;
+	case LUA_TNUMBER:
+#if LUA_VERSION_NUM >= 503
+		if (lua_isinteger(L, index)) {
+			w.put((char)STORED_INTEGER);
+			w.put((long long)lua_tointeger(L, index));
+			break;
+		}
+#endif
+		w.put((char)STORED_NUMBER);
+		w.put((double)lua_tonumber(L, index));
+		break;
+	case LUA_TSTRING: {
+		size_t length = 0;
+		const char* s = lua_tolstring(L, index, &length);
+		w.put((char)STORED_STRING);
+		w.put_string(std::string(s, length));
+		break;
+	}
+	case LUA_TTABLE: {
+		const void* table = lua_topointer(L, index);
+		StoredTableIds::const_iterator stored = ids.find(table);
+		if (stored != ids.end()) {
+			w.put((char)STORED_TABLE_REF);
+			w.put(stored->second);
+			break;
+		}
+
+		// (the id is taken before the contents are stored, same as in restore_value())
+		const uint32_t id = ids.size() + 1;
+		ids[table] = id;
+
+		w.put((char)STORED_TABLE);
+		lua_pushvalue(L, index);
+		save_table(L, w, ids, depth + 1);
+		lua_pop(L, 1);
+		break;
+	}
+	}
+}
+
+// Sets the stored (key, value) pairs in the table on top of the stack. 'tables' is the stack index of
+// the table of tables restored so far, by id.
+static bool restore_table(lua_State* L, StateReader& r, int tables, int depth) {
+	char tag = STORED_END;
+
+	while (r.get(&tag) && tag != STORED_END) {
+		if (!restore_value(L, r, tag, tables, depth)) return false;
+
+		char value_tag = STORED_END;
+		if (!r.get(&value_tag) || !restore_value(L, r, value_tag, tables, depth)) return false;
+
+		lua_rawset(L, -3);
+	}
+
+	return !r.failed;
+}
+
+// Pushes the stored value
+static bool restore_value(lua_State* L, StateReader& r, char tag, int tables, int depth) {
+	switch (tag) {
+	case STORED_BOOLEAN: {
+		char b = 0;
+		if (!r.get(&b)) return false;
+		lua_pushboolean(L, b);
+		return true;
+	}
+	case STORED_NUMBER: {
+		double x = 0.0;
+		if (!r.get(&x)) return false;
+		lua_pushnumber(L, x);
+		return true;
+	}
+	case STORED_INTEGER: {
+		long long x = 0;
+		if (!r.get(&x)) return false;
+		lua_pushinteger(L, x);
+		return true;
+	}
+	case STORED_STRING: {
+		std::string s;
+		if (!r.get_string(&s)) return false;
+		lua_pushlstring(L, s.data(), s.size());
+		return true;
+	}
+	case STORED_TABLE:
+		if (depth >= STORED_MAX_DEPTH) return false;
+		lua_newtable(L);
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, tables, lua_rawlen(L, tables) + 1);
+		return restore_table(L, r, tables, depth + 1);
+	case STORED_TABLE_REF: {
+		uint32_t id = 0;
+		if (!r.get(&id) || id < 1 || id > lua_rawlen(L, tables)) return false;
+		lua_rawgeti(L, tables, id);
+		return true;
+	}
+	default:
+		return false;
+	}
+}
@@ -2,9 +2,14 @@
 #ifndef AUTOPILOT_H
 #define AUTOPILOT_H
 
-#include "core/core.h"
+#include "core/object.h"
+#include "lander.h"
+#include "pid.h"
 #include "lua.hpp"
 
+#include <string>
+#include <vector>
+
 struct AutopilotProgram {
 	std::string path;
 	bool loaded;
@@ -12,11 +17,34 @@ struct AutopilotProgram {
 	lua_State* L;
 };
 
-AutopilotProgram make_autopilot_program(std::string lua_path);
-void run_autopilot_program(AutopilotProgram* ap);
+// Controller state used by the autopilot actions (one set per simulation)
+struct AutopilotControllers {
+	AutopilotControllers();
+
+	PIDController attitude_stabilizer; // MAINTAIN_ATTITUDE()
+	PIDController attitude_controller; // HOLD_*()
+	PIDController attitude_damper;     // HOLD_*() rotation damping
+	PIDController velocity_controller; // MAINTAIN_SURFACE_VELOCITY()
+};
+
+class SimulationContext;
+class StateWriter;
+class StateReader;
+
+// Loads the program; the Lua API functions act on ctx
+AutopilotProgram make_autopilot_program(SimulationContext* ctx, std::string lua_path);
+void free_autopilot_program(AutopilotProgram* ap);
+void run_autopilot_program(SimulationContext* ctx); // runs ctx->ap
+
+// Global variables of the program holding plain data (numbers, strings, booleans & tables of them),
+// for checkpoints. Functions, library tables and locals of the main chunk are left out, tables
+// referenced more than once are stored as copies. Restoring replaces all such globals.
+void save_autopilot_globals(AutopilotProgram* ap, StateWriter& w);
+bool restore_autopilot_globals(AutopilotProgram* ap, StateReader& r);
 
-void attitude_stabilization_step(Object* lander, double timestep);
-void attitude_control_step(Object* lander, glm::dvec3 target, double timestep);
-void surface_velocity_control_step(Object* mars, Object* lander, double target, double timestep);
+void reset_autopilot_controllers(AutopilotControllers* c);
+void attitude_stabilization_step(AutopilotControllers* c, Lander* lander, double timestep);
+void attitude_control_step(AutopilotControllers* c, Lander* lander, glm::dvec3 target, double timestep);
+void surface_velocity_control_step(AutopilotControllers* c, Object* mars, Lander* lander, double target, double timestep);
 
 #endif
@@ -0,0 +1,102 @@
+// Ricardas Navickas 2020
+#include "campaign.h"
+#include "simulation.h"
+#include "lander.h"
+#include "mars.h"
+#include "core/thread_pool.h"
+
+#include <random>
+#include <cmath>
+
+static CampaignRunResult do_run(const CampaignConfig& cfg, int run);
+static glm::dvec3 random_vector(CounterRng& rng, double sigma);
+
+CampaignConfig default_campaign_config() {
+	CampaignConfig cfg;
+
+	cfg.scenario_id = 1;
+	cfg.autopilot_path = "";
+	cfg.duration = 3600.0;
+	cfg.timestep = 1.0 / 60.0;
+	cfg.integrator = INTEGRATOR_VERLET;
+	cfg.runs = 100;
+	cfg.threads = 0;
+	cfg.seed = 1;
+
+	cfg.position_sigma = 0.1;     // 100 m
+	cfg.velocity_sigma = 0.001;   // 1 m/s
+	cfg.fuel_level_sigma = 0.05;
+	cfg.exhaust_vel_sigma = 0.01;
+
+	return cfg;
+}
+
+std::vector<CampaignRunResult> run_campaign(const CampaignConfig& cfg) {
+	std::vector<CampaignRunResult> results(cfg.runs);
+	ThreadPool pool(cfg.threads);
+
+	for (int i = 0; i < cfg.runs; i++) {
+		pool.submit([&cfg, &results, i] { results[i] = do_run(cfg, i); });
+	}
+
+	pool.wait();
+	return results;
+}
+
+static CampaignRunResult do_run(const CampaignConfig& cfg, int run) {
+	// Every run has its own stream, so dispersions don't depend on which thread runs it
+	CounterRng rng(cfg.seed, RNG_STREAM_CAMPAIGN_RUN(run));
+
+	CampaignRunResult result;
+	result.run = run;
+	result.wind_seed = rng();
+
+	SimulationContext* ctx = new SimulationContext(cfg.timestep, cfg.seed, result.wind_seed); // same terrain in every run
+	ctx->state.integrator = cfg.integrator;
+	set_scenario(ctx, cfg.scenario_id);
+
+	// Disperse initial conditions
+	std::normal_distribution<double> normal(0.0, 1.0);
+	Lander* lander = ctx->lander;
+
+	lander->position += random_vector(rng, cfg.position_sigma);
+	lander->velocity += random_vector(rng, cfg.velocity_sigma);
+	set_fuel_level(lander, 1.0 + cfg.fuel_level_sigma * normal(rng));
+	lander->state.me_exhaust_vel *= 1.0 + cfg.exhaust_vel_sigma * normal(rng);
+	lander->reset_integrator();
+
+	if (cfg.autopilot_path != "") {
+		ctx->ap = make_autopilot_program(ctx, cfg.autopilot_path);
+		ctx->state.autopilot_active = true;
+	}
+
+	// Unattended vacuum coasts are skipped to their next event in one Kepler solve
+	ctx->state.coast_to_events = true;
+	while (ctx->state.time < cfg.duration && !ctx->state.paused) {
+		const long remaining = (long)std::ceil((cfg.duration - ctx->state.time) / ctx->state.timestep);
+		long coasted = simulation_coast(ctx, remaining);
+		if (coasted == remaining) break;
+		if (coasted == 0) simulation_step(ctx);
+	}
+
+	result.landed = ctx->state.landed;
+	result.crashed = ctx->state.crashed;
+	result.autopilot_failed = (cfg.autopilot_path != "") && !ctx->ap.loaded;
+	result.time = ctx->state.time;
+	result.fuel_level = lander->state.fuel_level;
+	result.touchdown_speed = ctx->state.touchdown_speed;
+
+	delete ctx;
+	return result;
+}
+
+static glm::dvec3 random_vector(CounterRng& rng, double sigma) {
+	std::normal_distribution<double> normal(0.0, sigma);
+
+	// Separate statements fix the order in which components are drawn
+	double x = normal(rng);
+	double y = normal(rng);
+	double z = normal(rng);
+
+	return glm::dvec3(x, y, z);
+}
@@ -0,0 +1,43 @@
+// Ricardas Navickas 2020
+#ifndef CAMPAIGN_H
+#define CAMPAIGN_H
+
+#include <string>
+#include <vector>
+
+// Monte Carlo landing campaign: many independent runs of one scenario with randomly
+// dispersed initial conditions, spread across all cores
+struct CampaignConfig {
+	int scenario_id;
+	std::string autopilot_path; // empty - no autopilot
+	double duration;            // max simulated seconds per run
+	double timestep;
+	int integrator;             // INTEGRATOR_*
+	int runs;
+	unsigned int threads;       // 0 - one per hardware thread
+	unsigned int seed;          // campaign seed (terrain & all dispersions are derived from it)
+
+	// Dispersions (standard deviations)
+	double position_sigma;    // km, per axis
+	double velocity_sigma;    // km/s, per axis
+	double fuel_level_sigma;  // fraction of full tank (mean is a full tank, clamped to 0.0-1.0)
+	double exhaust_vel_sigma; // fraction of nominal me_exhaust_vel
+};
+
+struct CampaignRunResult {
+	int run;
+	unsigned int wind_seed;
+	bool landed, crashed;
+	bool autopilot_failed;  // script did not load or raised an error
+	double time;            // simulated time at end of run
+	double fuel_level;      // at end of run
+	double touchdown_speed; // km/s rel. to surface, < 0 if the lander never touched down
+};
+
+CampaignConfig default_campaign_config();
+
+// Runs cfg.runs simulations and returns their results ordered by run number.
+// Results only depend on cfg (not on the number of threads or scheduling).
+std::vector<CampaignRunResult> run_campaign(const CampaignConfig& cfg);
+
+#endif
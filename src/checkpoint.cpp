@@ -0,0 +1,259 @@
+// Ricardas Navickas 2020
+#include "checkpoint.h"
+#include "simulation.h"
+#include "autopilot.h"
+#include "core/state_blob.h"
+#include "core/error.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CHECKPOINT_MAGIC "LCKP"
+#define CHECKPOINT_VERSION 6
+
+// Identifies the build & context layout; checked before anything is restored
+struct CheckpointHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t size; // of the whole checkpoint
+	uint32_t state_size, lander_state_size, object_size;
+	uint32_t num_of_debris, num_of_objects;
+};
+
+static CheckpointHeader make_header(SimulationContext* ctx);
+static void save_recording_state(const Recording& rec, StateWriter& w);
+static bool restore_recording_state(Recording* rec, StateReader& r);
+static bool restore_autopilot(SimulationContext* ctx, StateReader& r);
+
+std::vector<char> save_checkpoint(SimulationContext* ctx) {
+	std::vector<char> data;
+	save_checkpoint(ctx, &data);
+	return data;
+}
+
+void save_checkpoint(SimulationContext* ctx, std::vector<char>* data) {
+	data->clear();
+	StateWriter w(data);
+
+	w.put(make_header(ctx));
+	w.put(ctx->state);
+
+	ctx->lander->save_state(w);
+	w.put(ctx->lander->state);
+	ctx->mars->save_state(w);
+	for (unsigned int i = 0; i < ctx->lander_debris.size(); i++) ctx->lander_debris[i]->save_state(w);
+	for (unsigned int i = 0; i < ctx->obj.size(); i++) ctx->obj[i]->save_state(w);
+	ctx->bodies.save_state(w, ctx->lander_debris);
+
+	ctx->lander_dopri5.save_state(w);
+	w.put(ctx->lander_yoshida.order);
+	w.put(ctx->lander_yoshida.steps);
+	w.put(ctx->lander_yoshida.evaluations);
+
+	w.put((uint32_t)ctx->event_log.size());
+	w.put_bytes(ctx->event_log.data(), ctx->event_log.size() * sizeof(EventRecord));
+
+	w.put(ctx->env.terrain_seed);
+	w.put(ctx->env.wind_seed);
+	ctx->env.height_noise.save_state(w);
+	ctx->env.wind_speed.save_state(w);
+	ctx->env.wind_x.save_state(w);
+	ctx->env.wind_z.save_state(w);
+
+	w.put(ctx->rng_seed);
+	w.put(ctx->rng);
+
+	ctx->controllers.attitude_stabilizer.save_state(w);
+	ctx->controllers.attitude_controller.save_state(w);
+	ctx->controllers.attitude_damper.save_state(w);
+	ctx->controllers.velocity_controller.save_state(w);
+
+	w.put_string(ctx->ap.path);
+	w.put(ctx->ap.loaded);
+	save_autopilot_globals(&ctx->ap, w);
+
+	save_recording_state(ctx->recording, w);
+
+	reinterpret_cast<CheckpointHeader*>(data->data())->size = data->size();
+}
+
+bool restore_checkpoint(SimulationContext* ctx, const char* data, size_t size) {
+	StateReader r(data, size);
+
+	CheckpointHeader header, expected = make_header(ctx);
+	expected.size = size;
+	if (!r.get(&header) || memcmp(&header, &expected, sizeof(CheckpointHeader)) != 0) {
+		error("restore_checkpoint()", "Not a checkpoint of this simulation (or made by another version)");
+		return false;
+	}
+
+	r.get(&ctx->state);
+
+	ctx->lander->restore_state(r);
+	r.get(&ctx->lander->state);
+	ctx->mars->restore_state(r);
+	for (unsigned int i = 0; i < ctx->lander_debris.size(); i++) ctx->lander_debris[i]->restore_state(r);
+	for (unsigned int i = 0; i < ctx->obj.size(); i++) ctx->obj[i]->restore_state(r);
+	ctx->bodies.restore_state(r, ctx->lander_debris);
+
+	ctx->lander_dopri5.restore_state(r);
+	r.get(&ctx->lander_yoshida.order);
+	r.get(&ctx->lander_yoshida.steps);
+	r.get(&ctx->lander_yoshida.evaluations);
+
+	uint32_t num_of_events = 0;
+	if (r.get(&num_of_events) && r.remaining() >= num_of_events * sizeof(EventRecord)) {
+		ctx->event_log.resize(num_of_events);
+		r.get_bytes(ctx->event_log.data(), num_of_events * sizeof(EventRecord));
+	} else {
+		r.failed = true;
+	}
+
+	r.get(&ctx->env.terrain_seed);
+	r.get(&ctx->env.wind_seed);
+	ctx->env.height_noise.restore_state(r);
+	ctx->env.wind_speed.restore_state(r);
+	ctx->env.wind_x.restore_state(r);
+	ctx->env.wind_z.restore_state(r);
+
+	r.get(&ctx->rng_seed);
+	r.get(&ctx->rng);
+
+	ctx->controllers.attitude_stabilizer.restore_state(r);
+	ctx->controllers.attitude_controller.restore_state(r);
+	ctx->controllers.attitude_damper.restore_state(r);
+	ctx->controllers.velocity_controller.restore_state(r);
+
+	// After the autopilot, which may have to reload the program (and record that)
+	bool ok = restore_autopilot(ctx, r) && restore_recording_state(&ctx->recording, r);
+
+	if (!ok || r.remaining() != 0) {
+		error("restore_checkpoint()", "Checkpoint is corrupt, simulation state is undefined");
+		return false;
+	}
+
+	return true;
+}
+
+bool save_checkpoint_file(SimulationContext* ctx, std::string path) {
+	std::vector<char> data = save_checkpoint(ctx);
+
+	FILE* f = fopen(path.c_str(), "wb");
+	if (f == NULL) {
+		error("save_checkpoint_file()", "Cannot open " + path + " for writing");
+		return false;
+	}
+
+	bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+	ok = (fclose(f) == 0) && ok;
+
+	if (!ok) error("save_checkpoint_file()", "Failed to write " + path);
+	return ok;
+}
+
+bool restore_checkpoint_file(SimulationContext* ctx, std::string path) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		error("restore_checkpoint_file()", "Cannot open " + path);
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		error("restore_checkpoint_file()", path + " is empty");
+		close(fd);
+		return false;
+	}
+
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		error("restore_checkpoint_file()", "Cannot map " + path);
+		return false;
+	}
+
+	bool ok = restore_checkpoint(ctx, static_cast<const char*>(data), st.st_size);
+	munmap(data, st.st_size);
+
+	return ok;
+}
+
+static CheckpointHeader make_header(SimulationContext* ctx) {
+	CheckpointHeader header;
+	memset(&header, 0, sizeof(header)); // no stray bytes in the padding, headers are compared with memcmp()
+
+	memcpy(header.magic, CHECKPOINT_MAGIC, 4);
+	header.version = CHECKPOINT_VERSION;
+	header.size = 0;
+	header.state_size = sizeof(SimulationState);
+	header.lander_state_size = sizeof(LanderState);
+	header.object_size = sizeof(Object);
+	header.num_of_debris = ctx->lander_debris.size();
+	header.num_of_objects = ctx->obj.size();
+
+	return header;
+}
+
+static void save_recording_state(const Recording& rec, StateWriter& w) {
+	w.put(rec.scenario_id);
+	w.put(rec.custom_lander_pos);
+	w.put(rec.custom_lander_vel);
+	w.put(rec.terrain_seed);
+	w.put(rec.wind_seed);
+	w.put(rec.rng_seed);
+	w.put(rec.steps);
+
+	w.put((uint32_t)rec.records.size());
+	for (unsigned int i = 0; i < rec.records.size(); i++) {
+		w.put(rec.records[i].step);
+		w.put(rec.records[i].inputs);
+		w.put_string(rec.records[i].autopilot_path);
+	}
+}
+
+static bool restore_recording_state(Recording* rec, StateReader& r) {
+	uint32_t num_of_records = 0;
+
+	r.get(&rec->scenario_id);
+	r.get(&rec->custom_lander_pos);
+	r.get(&rec->custom_lander_vel);
+	r.get(&rec->terrain_seed);
+	r.get(&rec->wind_seed);
+	r.get(&rec->rng_seed);
+	r.get(&rec->steps);
+	r.get(&num_of_records);
+
+	rec->records.clear();
+	for (uint32_t i = 0; i < num_of_records && !r.failed; i++) {
+		InputRecord record = InputRecord();
+		r.get(&record.step);
+		r.get(&record.inputs);
+		r.get_string(&record.autopilot_path);
+		rec->records.push_back(record);
+	}
+
+	return !r.failed;
+}
+
+// Reloads the program if another one (or none) is loaded, then sets its globals
+static bool restore_autopilot(SimulationContext* ctx, StateReader& r) {
+	std::string path;
+	bool loaded = false;
+	if (!r.get_string(&path) || !r.get(&loaded)) return false;
+
+	if (path == "") {
+		free_autopilot_program(&ctx->ap);
+		ctx->ap.path = "";
+	} else if (path != ctx->ap.path || ctx->ap.L == NULL) {
+		free_autopilot_program(&ctx->ap);
+		ctx->ap = make_autopilot_program(ctx, path);
+		loaded = loaded && ctx->ap.loaded;
+	}
+
+	ctx->ap.loaded = loaded;
+	return restore_autopilot_globals(&ctx->ap, r);
+}
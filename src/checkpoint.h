@@ -0,0 +1,26 @@
+// Ricardas Navickas 2020
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+class SimulationContext;
+
+// Binary snapshot of everything a simulation steps from: state, all bodies (with their integrator
+// history), integrators, controllers, noise generators, the recording and the autopilot program's
+// globals. A context restored from a checkpoint continues bit-exactly like the one it was taken from,
+// so one checkpoint can be the starting point of any number of what-if runs.
+//
+// Checkpoints are raw memory images: they only load into the build that made them, and only into a
+// context with the same objects (see SimulationContext::obj).
+std::vector<char> save_checkpoint(SimulationContext* ctx);
+void save_checkpoint(SimulationContext* ctx, std::vector<char>* data); // replaces the contents (reusing the memory)
+bool restore_checkpoint(SimulationContext* ctx, const char* data, size_t size); // false if it isn't a checkpoint for this build & context
+
+// Files are restored straight from a read-only memory mapping
+bool save_checkpoint_file(SimulationContext* ctx, std::string path);
+bool restore_checkpoint_file(SimulationContext* ctx, std::string path);
+
+#endif
@@ -6,6 +6,8 @@
 #include "core/error.h"
 #include "global.h"
 #include "simulation.h"
+#include "terrain_lod.h"
+#include "lander_particles.h"
 #include "gui.h"
 #include <iostream>
 
@@ -13,34 +15,42 @@
 static Scene* closeup_scene;
 static Camera* closeup_camera;
 
-// Near mars object
-static Object* near_mars = NULL;
-static const double mars_transition_height = 10.0;
-static const unsigned int near_mars_update_period = 60; // number of calls to update_closeup_scene() between near mars model updates
-static bool near_mars_model_active = false;
+static const double closeup_fov = 45.0;
+
+// Mars surface (drawn instead of mars_view's model)
+static TerrainLod* terrain = NULL;
+
+// Exhaust & dust
+static LanderParticles* particles = NULL;
 
 static double dist_to_lander = 0.015; // Distance from camera to lander
 
+static void draw_particles(Camera* camera, glm::mat4 view, glm::mat4 projection);
 static void closeup_mouse_callback(GLFWwindow* w, double x, double y);
 static void closeup_scroll_callback(GLFWwindow* w, double x, double y);
 
 void init_closeup_scene(Shader* world_shader, Shader* light_shader) {
-	closeup_camera = new Camera(glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, 0.0, -0.5), glm::dvec3(0.0, 1.0, 0.0), 45.0, 0.01);
+	closeup_camera = new Camera(glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, 0.0, -0.5), glm::dvec3(0.0, 1.0, 0.0), closeup_fov, 0.01);
 	closeup_scene = new Scene(closeup_camera, world_shader, light_shader);
 
-	closeup_scene->add_object(mars);
-	closeup_scene->add_object(lander);
+	// Terrain noise is stateless, and only replaced on this thread (by the GUI restoring a checkpoint)
+	terrain = new TerrainLod(&sim->env, 64 << 20);
+	particles = new LanderParticles(&sim->env);
+
+	closeup_scene->add_object_list(&terrain->visible);
+	closeup_scene->add_object(lander_view);
 	closeup_scene->add_object(lander_parachute);
 	closeup_scene->add_nofx_object(lander_exhaust);
+	closeup_scene->add_nofx_object(predicted_path);
+	closeup_scene->add_nofx_object(predicted_landing_site);
+	closeup_scene->add_render_callback(draw_particles);
 
-	for (unsigned int i = 0; i < lander_debris.size(); i++) {
-		closeup_scene->add_object(lander_debris[i]);
+	for (unsigned int i = 0; i < lander_debris_view.size(); i++) {
+		closeup_scene->add_object(lander_debris_view[i]);
 	}
 
 	closeup_scene->add_light(sun, glm::vec3(1.0f, 1.0f, 1.0f));
 	closeup_scene->render_wireframe = false;
-
-	near_mars = make_mars_near_object(mars, lander);
 }
 
 void activate_closeup_scene() {
@@ -50,59 +60,39 @@ void activate_closeup_scene() {
 }
 
 void update_closeup_scene() {
-	static unsigned int update_count = 0;
-
 	// Make the closeup camera follow the lander
-	glm::dvec3 dist = lander->position - mars->position;
+	glm::dvec3 dist = lander_view->position - mars_view->position;
 	closeup_camera->right = glm::normalize(-glm::cross(dist, closeup_camera->facing));
-	closeup_camera->position = lander->position - dist_to_lander * closeup_camera->facing;
+	closeup_camera->position = lander_view->position - dist_to_lander * closeup_camera->facing;
 	closeup_camera->up = glm::normalize(glm::cross(closeup_camera->right, closeup_camera->facing));
 
-	if (lander->attribute["me_throttle"] > 0.0 && lander->attribute["fuel_level"] > 0.0) {
-		lander_exhaust->position = lander->position + lander->attitude_matrix * glm::dvec3(0.0, -0.0004 - EXHAUST_MAX_LENGTH * lander->attribute["me_throttle"], 0.0);
-		lander_exhaust->attitude_matrix = lander->attitude_matrix;
-		update_exhaust_model(lander, lander_exhaust);
+	if (lander_view->state.me_throttle > 0.0 && lander_view->state.fuel_level > 0.0) {
+		lander_exhaust->position = lander_view->position + lander_view->attitude_matrix * glm::dvec3(0.0, -0.0004 - EXHAUST_MAX_LENGTH * lander_view->state.me_throttle, 0.0);
+		lander_exhaust->attitude_matrix = lander_view->attitude_matrix;
+		update_exhaust_model(lander_view, lander_exhaust);
 	} else {
 		lander_exhaust->position = glm::dvec3(0.0);
 	}
 
-	if (lander->attribute["parachute_status"] != 1.0) {
+	if (lander_view->state.parachute_status != 1.0) {
 		lander_parachute->position = glm::dvec3(0.0, 0.0, 0.0);
 	} else {
-		lander_parachute->position = lander->position;
-		lander_parachute->orient_towards(-(lander->velocity - mars_surface_velocity(mars, lander->position)));
+		lander_parachute->position = lander_view->position;
+		lander_parachute->orient_towards(-(lander_view->velocity - mars_surface_velocity(mars_view, lander_view->position)));
 	}
 
-	// Transition to Mars near model
-	if (glm::length(lander->position - mars->position) - MARS_RADIUS < mars_transition_height && near_mars_model_active == false) {
-		update_mars_near_object(near_mars, mars, lander);
-		closeup_scene->add_object(near_mars);
-		closeup_scene->remove_object(mars);
-		add_sim_object(near_mars);
-		near_mars_model_active = true;
-	}
-
-	// Transition to Mars far model
-	if (glm::length(lander->position - mars->position) - MARS_RADIUS > mars_transition_height && near_mars_model_active == true) {
-		closeup_scene->add_object(mars);
-		closeup_scene->remove_object(near_mars);
-		remove_sim_object(near_mars);
-		near_mars_model_active = false;
-	}
+	glm::dvec3 camera_velocity = lander_view->velocity - mars_surface_velocity(mars_view, lander_view->position);
+	terrain->update(mars_view, closeup_camera, camera_velocity, closeup_fov, wstate.window_width, wstate.window_height);
 
-	// Update
-	if (near_mars_model_active == true) {
-		near_mars->orient_towards(lander->position - mars->position);
-		near_mars->velocity = mars_surface_velocity(mars, lander->position - mars->position);
-		near_mars->ang_velocity = mars->ang_velocity;
-		near_mars->reset_integrator(); // effectively does Euler integration
+	particles->update(lander_view, mars_view, sim_view.state.time, glfwGetTime(), sim_view.ground_height, sim_view.state.touchdown_speed);
+}
 
-		if (update_count % near_mars_update_period == 0) {
-			update_mars_near_object(near_mars, mars, lander);
-		}
-	}
+static void draw_particles(Camera* camera, glm::mat4 view, glm::mat4 projection) {
+	particle_shader->use();
+	particle_shader->setmat4("view", view);
+	particle_shader->setmat4("projection", projection);
 
-	update_count++;
+	particles->draw(particle_shader, camera->position);
 }
 
 static void closeup_mouse_callback(GLFWwindow* w, double xpos, double ypos) {
@@ -116,7 +106,7 @@ static void closeup_mouse_callback(GLFWwindow* w, double xpos, double ypos) {
 	double yoffset = lastY - ypos;
 
 	if (glfwGetMouseButton(w, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
-		glm::dvec3 radial = glm::normalize(lander->position - mars->position);
+		glm::dvec3 radial = glm::normalize(lander_view->position - mars_view->position);
 		glm::dvec3 cross = glm::cross(radial, glm::normalize(closeup_camera->facing));
 		double sin_theta = glm::length(cross);
 
@@ -0,0 +1,324 @@
+// Ricardas Navickas 2020
+#include "body_store.h"
+#include "state_blob.h"
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BODY_STORE_AVX2
+#include <immintrin.h>
+#endif
+
+// Raw array pointers passed to the integration kernels
+struct BodyArrays {
+	double *px, *py, *pz;
+	double *prev_px, *prev_py, *prev_pz;
+	double *vx, *vy, *vz;
+	const double *fx, *fy, *fz;
+	const double *mass;
+};
+
+static void verlet_kernel(const BodyArrays& b, unsigned int begin, unsigned int end, double dt, glm::dvec3 c, double mu);
+#ifdef BODY_STORE_AVX2
+static unsigned int verlet_kernel_avx2(const BodyArrays& b, unsigned int count, double dt, glm::dvec3 c, double mu);
+static bool cpu_has_avx2();
+#endif
+
+BodyStore::BodyStore() {}
+
+BodyStore::~BodyStore() {}
+
+int BodyStore::add_body(glm::dvec3 pos, glm::dvec3 vel, double m, Object* h) {
+	px.push_back(pos.x);
+	py.push_back(pos.y);
+	pz.push_back(pos.z);
+	prev_px.push_back(pos.x);
+	prev_py.push_back(pos.y);
+	prev_pz.push_back(pos.z);
+	vx.push_back(vel.x);
+	vy.push_back(vel.y);
+	vz.push_back(vel.z);
+
+	fx.push_back(0.0);
+	fy.push_back(0.0);
+	fz.push_back(0.0);
+	mass.push_back(m);
+
+	qw.push_back(1.0);
+	qx.push_back(0.0);
+	qy.push_back(0.0);
+	qz.push_back(0.0);
+	wx.push_back(0.0);
+	wy.push_back(0.0);
+	wz.push_back(0.0);
+
+	handle.push_back(h);
+	first_run.push_back(true);
+
+	return px.size() - 1;
+}
+
+void BodyStore::clear() {
+	px.clear(); py.clear(); pz.clear();
+	prev_px.clear(); prev_py.clear(); prev_pz.clear();
+	vx.clear(); vy.clear(); vz.clear();
+	fx.clear(); fy.clear(); fz.clear();
+	mass.clear();
+	qw.clear(); qx.clear(); qy.clear(); qz.clear();
+	wx.clear(); wy.clear(); wz.clear();
+	handle.clear();
+	first_run.clear();
+}
+
+void BodyStore::save_state(StateWriter& w, const std::vector<Object*>& handles) const {
+	uint32_t n = px.size();
+	w.put(n);
+
+	const std::vector<double>* columns[] = { &px, &py, &pz, &prev_px, &prev_py, &prev_pz, &vx, &vy, &vz, &fx, &fy, &fz, &mass,
+	                                         &qw, &qx, &qy, &qz, &wx, &wy, &wz };
+	for (const std::vector<double>* c : columns) w.put_bytes(c->data(), n * sizeof(double));
+
+	for (uint32_t i = 0; i < n; i++) {
+		int h = -1;
+		for (unsigned int j = 0; j < handles.size(); j++) {
+			if (handles[j] == handle[i]) h = j;
+		}
+
+		w.put(h);
+		w.put((char)first_run[i]);
+	}
+}
+
+bool BodyStore::restore_state(StateReader& r, const std::vector<Object*>& handles) {
+	uint32_t n = 0;
+	std::vector<double>* columns[] = { &px, &py, &pz, &prev_px, &prev_py, &prev_pz, &vx, &vy, &vz, &fx, &fy, &fz, &mass,
+	                                   &qw, &qx, &qy, &qz, &wx, &wy, &wz };
+	const unsigned int num_of_columns = sizeof(columns) / sizeof(columns[0]);
+	if (!r.get(&n) || r.remaining() < n * num_of_columns * sizeof(double)) return false;
+
+	for (std::vector<double>* c : columns) {
+		c->resize(n);
+		r.get_bytes(c->data(), n * sizeof(double));
+	}
+
+	handle.resize(n);
+	first_run.resize(n);
+
+	for (uint32_t i = 0; i < n; i++) {
+		int h = -1;
+		char f = 0;
+		r.get(&h);
+		r.get(&f);
+
+		handle[i] = (h >= 0 && h < (int)handles.size()) ? handles[h] : NULL;
+		first_run[i] = f;
+	}
+
+	if (r.failed) {
+		clear();
+		return false;
+	}
+
+	update_handles();
+	return true;
+}
+
+unsigned int BodyStore::size() {
+	return px.size();
+}
+
+glm::dvec3 BodyStore::get_position(int i) {
+	return glm::dvec3(px[i], py[i], pz[i]);
+}
+
+glm::dvec3 BodyStore::get_velocity(int i) {
+	return glm::dvec3(vx[i], vy[i], vz[i]);
+}
+
+glm::dmat3 BodyStore::get_attitude(int i) {
+	return glm::mat3_cast(get_quat(i));
+}
+
+void BodyStore::set_force(int i, glm::dvec3 force) {
+	fx[i] = force.x;
+	fy[i] = force.y;
+	fz[i] = force.z;
+}
+
+void BodyStore::set_ang_velocity(int i, glm::dvec3 w) {
+	wx[i] = w.x;
+	wy[i] = w.y;
+	wz[i] = w.z;
+}
+
+void BodyStore::set_attitude(int i, glm::dmat3 a) {
+	set_quat(i, glm::quat_cast(a));
+}
+
+glm::dquat BodyStore::get_quat(int i) const {
+	return glm::dquat(qw[i], qx[i], qy[i], qz[i]);
+}
+
+void BodyStore::set_quat(int i, glm::dquat q) {
+	qw[i] = q.w;
+	qx[i] = q.x;
+	qy[i] = q.y;
+	qz[i] = q.z;
+}
+
+void BodyStore::reset_integrator() {
+	for (unsigned int i = 0; i < first_run.size(); i++) {
+		first_run[i] = true;
+	}
+}
+
+void BodyStore::step(double delta_time, glm::dvec3 attractor_pos, double attractor_mu) {
+	if (delta_time == 0.0 || px.empty()) return;
+
+	// Bodies without history get a synthetic previous position, which makes the Verlet
+	// step below give the same position as an Euler step would
+	for (unsigned int i = 0; i < first_run.size(); i++) {
+		if (!first_run[i]) continue;
+
+		prev_px[i] = px[i] - vx[i] * delta_time;
+		prev_py[i] = py[i] - vy[i] * delta_time;
+		prev_pz[i] = pz[i] - vz[i] * delta_time;
+		first_run[i] = false;
+	}
+
+	BodyArrays b = {
+		px.data(), py.data(), pz.data(),
+		prev_px.data(), prev_py.data(), prev_pz.data(),
+		vx.data(), vy.data(), vz.data(),
+		fx.data(), fy.data(), fz.data(),
+		mass.data()
+	};
+
+	unsigned int done = 0;
+#ifdef BODY_STORE_AVX2
+	if (cpu_has_avx2()) done = verlet_kernel_avx2(b, px.size(), delta_time, attractor_pos, attractor_mu);
+#endif
+	verlet_kernel(b, done, px.size(), delta_time, attractor_pos, attractor_mu);
+
+	step_attitudes(delta_time);
+	update_handles();
+}
+
+void BodyStore::step_attitudes(double delta_time) {
+	for (unsigned int i = 0; i < qw.size(); i++) {
+		const glm::dvec3 ang_velocity(wx[i], wy[i], wz[i]);
+		double w = glm::length(ang_velocity);
+		if (w <= 1e-8) continue;
+
+		// Rotation about the body axis, same as Object::update()
+		set_quat(i, glm::normalize(get_quat(i) * glm::angleAxis(w * delta_time, ang_velocity / w)));
+	}
+}
+
+void BodyStore::update_handles() {
+	for (unsigned int i = 0; i < handle.size(); i++) {
+		if (handle[i] == NULL) continue;
+
+		handle[i]->position = glm::dvec3(px[i], py[i], pz[i]);
+		handle[i]->velocity = glm::dvec3(vx[i], vy[i], vz[i]);
+		handle[i]->ang_velocity = glm::dvec3(wx[i], wy[i], wz[i]);
+		handle[i]->attitude_matrix = glm::mat3_cast(get_quat(i));
+	}
+}
+
+// ==== ==== KERNELS ==== ====
+
+static void verlet_kernel(const BodyArrays& b, unsigned int begin, unsigned int end, double dt, glm::dvec3 c, double mu) {
+	const double dt2 = dt * dt;
+	const double inv_2dt = 1.0 / (2 * dt);
+
+	for (unsigned int i = begin; i < end; i++) {
+		double rx = b.px[i] - c.x;
+		double ry = b.py[i] - c.y;
+		double rz = b.pz[i] - c.z;
+		double inv_r = 1.0 / std::sqrt(rx * rx + ry * ry + rz * rz);
+		double g = -mu * inv_r * inv_r * inv_r;
+		double inv_m = 1.0 / b.mass[i];
+
+		double ax = b.fx[i] * inv_m + g * rx;
+		double ay = b.fy[i] * inv_m + g * ry;
+		double az = b.fz[i] * inv_m + g * rz;
+
+		double nx = 2.0 * b.px[i] - b.prev_px[i] + ax * dt2;
+		double ny = 2.0 * b.py[i] - b.prev_py[i] + ay * dt2;
+		double nz = 2.0 * b.pz[i] - b.prev_pz[i] + az * dt2;
+
+		b.vx[i] = (nx - b.prev_px[i]) * inv_2dt;
+		b.vy[i] = (ny - b.prev_py[i]) * inv_2dt;
+		b.vz[i] = (nz - b.prev_pz[i]) * inv_2dt;
+
+		b.prev_px[i] = b.px[i];
+		b.prev_py[i] = b.py[i];
+		b.prev_pz[i] = b.pz[i];
+		b.px[i] = nx;
+		b.py[i] = ny;
+		b.pz[i] = nz;
+	}
+}
+
+#ifdef BODY_STORE_AVX2
+// Same as verlet_kernel(), 4 bodies at a time. Returns number of bodies processed
+// (a multiple of 4, the rest is left to the scalar kernel). Operations are done in the
+// scalar kernel's order without FMA, so results are bit-identical to it.
+__attribute__((target("avx2")))
+static unsigned int verlet_kernel_avx2(const BodyArrays& b, unsigned int count, double dt, glm::dvec3 c, double mu) {
+	const __m256d cx = _mm256_set1_pd(c.x);
+	const __m256d cy = _mm256_set1_pd(c.y);
+	const __m256d cz = _mm256_set1_pd(c.z);
+	const __m256d neg_mu = _mm256_set1_pd(-mu);
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d two = _mm256_set1_pd(2.0);
+	const __m256d dt2 = _mm256_set1_pd(dt * dt);
+	const __m256d inv_2dt = _mm256_set1_pd(1.0 / (2 * dt));
+
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m256d x = _mm256_loadu_pd(b.px + i);
+		__m256d y = _mm256_loadu_pd(b.py + i);
+		__m256d z = _mm256_loadu_pd(b.pz + i);
+
+		__m256d rx = _mm256_sub_pd(x, cx);
+		__m256d ry = _mm256_sub_pd(y, cy);
+		__m256d rz = _mm256_sub_pd(z, cz);
+		__m256d r2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(rx, rx), _mm256_mul_pd(ry, ry)), _mm256_mul_pd(rz, rz));
+		__m256d inv_r = _mm256_div_pd(one, _mm256_sqrt_pd(r2));
+		__m256d g = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(neg_mu, inv_r), inv_r), inv_r);
+		__m256d inv_m = _mm256_div_pd(one, _mm256_loadu_pd(b.mass + i));
+
+		__m256d ax = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(b.fx + i), inv_m), _mm256_mul_pd(g, rx));
+		__m256d ay = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(b.fy + i), inv_m), _mm256_mul_pd(g, ry));
+		__m256d az = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(b.fz + i), inv_m), _mm256_mul_pd(g, rz));
+
+		__m256d prev_x = _mm256_loadu_pd(b.prev_px + i);
+		__m256d prev_y = _mm256_loadu_pd(b.prev_py + i);
+		__m256d prev_z = _mm256_loadu_pd(b.prev_pz + i);
+
+		__m256d nx = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(two, x), prev_x), _mm256_mul_pd(ax, dt2));
+		__m256d ny = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(two, y), prev_y), _mm256_mul_pd(ay, dt2));
+		__m256d nz = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(two, z), prev_z), _mm256_mul_pd(az, dt2));
+
+		_mm256_storeu_pd(b.vx + i, _mm256_mul_pd(_mm256_sub_pd(nx, prev_x), inv_2dt));
+		_mm256_storeu_pd(b.vy + i, _mm256_mul_pd(_mm256_sub_pd(ny, prev_y), inv_2dt));
+		_mm256_storeu_pd(b.vz + i, _mm256_mul_pd(_mm256_sub_pd(nz, prev_z), inv_2dt));
+
+		_mm256_storeu_pd(b.prev_px + i, x);
+		_mm256_storeu_pd(b.prev_py + i, y);
+		_mm256_storeu_pd(b.prev_pz + i, z);
+		_mm256_storeu_pd(b.px + i, nx);
+		_mm256_storeu_pd(b.py + i, ny);
+		_mm256_storeu_pd(b.pz + i, nz);
+	}
+
+	return i;
+}
+
+static bool cpu_has_avx2() {
+	static const bool has_avx2 = __builtin_cpu_supports("avx2");
+	return has_avx2;
+}
+#endif
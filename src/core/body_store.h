@@ -0,0 +1,69 @@
+// Ricardas Navickas 2020
+#ifndef BODY_STORE_H
+#define BODY_STORE_H
+
+#include "object.h"
+#include "glm/gtc/quaternion.hpp"
+
+#include <vector>
+
+// Structure-of-arrays storage for many simple bodies (debris, test particles) that only
+// feel the gravity of one attractor plus a constant external force. All bodies are
+// integrated together with the same Verlet scheme as Object::update(), using AVX2 when
+// the CPU supports it.
+//
+// A body may have an Object handle attached; after every step the handle's position,
+// velocity and attitude are updated so that it can be rendered like any other object.
+class BodyStore {
+public:
+	BodyStore();
+	~BodyStore();
+
+	// Returns index of the new body (indices stay valid until clear())
+	int add_body(glm::dvec3 pos, glm::dvec3 vel, double mass, Object* handle);
+	void clear();
+	unsigned int size();
+
+	glm::dvec3 get_position(int i);
+	glm::dvec3 get_velocity(int i);
+	glm::dmat3 get_attitude(int i);
+
+	void set_force(int i, glm::dvec3 force); // constant external force (on top of gravity)
+	void set_ang_velocity(int i, glm::dvec3 ang_velocity);
+	void set_attitude(int i, glm::dmat3 attitude);
+
+	void reset_integrator(); // next step uses the Euler method for all bodies
+
+	// State of all bodies. Handles are stored as indices into 'handles' (bodies whose handle
+	// isn't in it get none), so restore with the same list to reattach them.
+	void save_state(StateWriter& w, const std::vector<Object*>& handles) const;
+	bool restore_state(StateReader& r, const std::vector<Object*>& handles);
+
+	// Integrates all bodies over delta_time; attractor_mu is G * attractor mass
+	void step(double delta_time, glm::dvec3 attractor_pos, double attractor_mu);
+
+private:
+	void step_attitudes(double delta_time);
+	void update_handles();
+
+	glm::dquat get_quat(int i) const;
+	void set_quat(int i, glm::dquat q);
+
+	// Position & derivatives
+	std::vector<double> px, py, pz;
+	std::vector<double> prev_px, prev_py, prev_pz;
+	std::vector<double> vx, vy, vz;
+
+	// External force & mass
+	std::vector<double> fx, fy, fz;
+	std::vector<double> mass;
+
+	// Attitude (quaternion) & angular velocity
+	std::vector<double> qw, qx, qy, qz;
+	std::vector<double> wx, wy, wz;
+
+	std::vector<Object*> handle;
+	std::vector<bool> first_run;
+};
+
+#endif
@@ -0,0 +1,51 @@
+// Ricardas Navickas 2020
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <cstdint>
+
+// Counter-based random number generator (Widynski's "Squares"): the n-th number of a stream is a
+// pure function of (key, n), where the key is derived from a seed and a stream id. Streams with
+// different ids are independent, any number can be drawn directly with at() and the whole state
+// is two integers, so generators are cheap to copy, save and give to other threads.
+//
+// Satisfies UniformRandomBitGenerator, so it works with the <random> distributions.
+class CounterRng {
+public:
+	typedef uint32_t result_type;
+
+	CounterRng(uint64_t seed, uint64_t stream) : key(make_key(seed, stream)), counter(0) {}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return UINT32_MAX; }
+
+	result_type operator()() { return at(counter++); }
+
+	// n-th number of the stream (doesn't advance the counter)
+	result_type at(uint64_t n) const {
+		uint64_t x = n * key;
+		uint64_t y = x;
+		uint64_t z = y + key;
+
+		x = x * x + y; x = (x >> 32) | (x << 32);
+		x = x * x + z; x = (x >> 32) | (x << 32);
+		x = x * x + y; x = (x >> 32) | (x << 32);
+		return (x * x + z) >> 32;
+	}
+
+	uint64_t key;
+	uint64_t counter; // index of the next number
+
+private:
+	// SplitMix64 finalizer of (seed, stream); Squares wants an odd key with well mixed bits
+	static uint64_t make_key(uint64_t seed, uint64_t stream) {
+		uint64_t x = seed * 0x9e3779b97f4a7c15ull + stream;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+		x = x ^ (x >> 31);
+
+		return x | 1;
+	}
+};
+
+#endif
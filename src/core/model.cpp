@@ -2,9 +2,17 @@
 #include "model.h"
 #include <iostream>
 
-Model::Model() {}
+Model::Model() {
+	dynamic = false;
+}
 
 Model::Model(Mesh* m, GLuint mode) {
+	dynamic = false;
+	set_mesh(m, mode);
+}
+
+Model::Model(Mesh* m, GLuint mode, bool dynamic) {
+	this->dynamic = dynamic;
 	set_mesh(m, mode);
 }
 
@@ -12,6 +20,7 @@ Model::Model(const Model& b) {
 	mesh = new Mesh;
 	*mesh = *b.mesh; // copy mesh
 	draw_mode = b.draw_mode;
+	dynamic = b.dynamic;
 	set_mesh(mesh, draw_mode);
 }
 
@@ -32,10 +41,14 @@ void Model::set_mesh(Mesh* m, GLuint mode) {
 
 	glBindVertexArray(vertex_array);
 
+	const GLenum usage = dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
+	vertex_capacity = mesh->vertex_data.size();
+	index_capacity = mesh->indices.size();
+
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * mesh->vertex_data.size(), mesh->vertex_data.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertex_capacity, mesh->vertex_data.data(), usage);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * mesh->indices.size(), mesh->indices.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * index_capacity, mesh->indices.data(), usage);
 
 	// Vertex coords
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_DATA_LEN * sizeof(float), (void*)(VERTEX_COORD_OFFSET * sizeof(float)));
@@ -54,6 +67,22 @@ void Model::set_mesh(Mesh* m, GLuint mode) {
 }
 
 void Model::reload_mesh() {
+	if (dynamic && mesh->vertex_data.size() <= vertex_capacity && mesh->indices.size() <= index_capacity) {
+		// Orphan the old storage (draws still reading it keep it, instead of stalling the upload) and refill it
+		glBindVertexArray(vertex_array);
+
+		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertex_capacity, NULL, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * mesh->vertex_data.size(), mesh->vertex_data.data());
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * index_capacity, NULL, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(unsigned int) * mesh->indices.size(), mesh->indices.data());
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return;
+	}
+
 	// Free current VBO, VAO, EBO
 	glDeleteBuffers(1, &vertex_buffer);
 	glDeleteBuffers(1, &element_buffer);
@@ -62,6 +91,21 @@ void Model::reload_mesh() {
 	set_mesh(mesh, draw_mode);
 }
 
+void Model::reload_vertices(int first, int count) {
+	if (!dynamic || (first + count) * VERTEX_DATA_LEN > (int)vertex_capacity) {
+		reload_mesh();
+		return;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	if (first == 0 && count * VERTEX_DATA_LEN == (int)vertex_capacity) {
+		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertex_capacity, NULL, GL_DYNAMIC_DRAW); // orphan, as in reload_mesh()
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(float) * first * VERTEX_DATA_LEN, sizeof(float) * count * VERTEX_DATA_LEN,
+	                mesh->vertex_data.data() + first * VERTEX_DATA_LEN);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 void Model::draw_wire() {
 	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 	glBindVertexArray(vertex_array);
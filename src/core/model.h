@@ -7,27 +7,36 @@
 #include "GL/gl.h"
 #include "mesh.h"
 
+// Mesh uploaded to OpenGL buffers. Static models are meant to be uploaded once; dynamic ones keep
+// their buffers and update them in place, for meshes that change every frame.
 class Model {
 public:
 	Model();
 	Model(Mesh* m, GLuint mode);
+	Model(Mesh* m, GLuint mode, bool dynamic);
 	Model(const Model&);
 	~Model();
 
 	void set_mesh(Mesh* m, GLuint mode);
-	void reload_mesh(); // Updates model if mesh has changed
+	void reload_mesh(); // Updates model if mesh has changed (in place for dynamic models that still fit)
+	void reload_vertices(int first, int count); // Updates only these vertices (dynamic models)
 
 	void draw_wire();
 	void draw_solid();
 
 	Mesh* mesh;
 	GLuint draw_mode;
+	bool dynamic;
 
 private:
 	// VBO, VAO and EBO
 	GLuint vertex_buffer;
 	GLuint vertex_array;
 	GLuint element_buffer;
+
+	// Sizes of the buffers (floats & indices)
+	size_t vertex_capacity;
+	size_t index_capacity;
 };
 
 #endif
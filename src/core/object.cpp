@@ -1,6 +1,7 @@
 // Ricardas Navickas 2020
 #include "object.h"
 #include "error.h"
+#include "state_blob.h"
 #include <cmath>
 
 Object::Object(Model* m, glm::dvec3 pos, float specular_coef, int specular_exp) {
@@ -19,9 +20,13 @@ Object::Object(Model* m, glm::dvec3 pos, float specular_coef, int specular_exp)
 	net_force = glm::dvec3(0.0);
 	net_moment = glm::dvec3(0.0);
 
+	scale = glm::dvec3(1.0, 1.0, 1.0);
+	opacity = 1.0f;
+
 	model_matrix = get_model_matrix();
 
 	prev_delta_time = 0.0;
+	prev_position = glm::dvec3(0.0, 0.0, 0.0);
 	verlet_first_run = true;
 
 	specular_coefficient = specular_coef;
@@ -36,67 +41,80 @@ void Object::update(double delta_time) {
 	glm::dvec3 starting_position = position;
 
 	acceleration = net_force / mass;
-	ang_acceleration = net_moment / moment_of_inertia;
 
 	if (verlet_first_run) {
-		// If first run, use the Euler method
+		// If first run, start the Verlet sequence with a second order Taylor step (an Euler step
+		// would leave the next steps with a velocity error of half a step's acceleration)
+		position = position + velocity * delta_time + 0.5 * acceleration * delta_time * delta_time;
 		velocity = velocity + acceleration * delta_time;
-		position = position + velocity * delta_time;
 	} else {
 		// Otherwise use the Verlet method
 		position = 2.0 * position - prev_position + acceleration * delta_time * delta_time;
-		velocity = (position - prev_position) / (2 * delta_time);
+
+		// Velocity at the end of the step (not the central difference, which lags a step behind the position)
+		velocity = (position - starting_position) / delta_time + 0.5 * acceleration * delta_time;
 	}
 
-	ang_velocity = ang_velocity + ang_acceleration * delta_time;
-	if (glm::length(ang_velocity) > 1e-8)
-		attitude_matrix = glm::dmat3(glm::rotate(glm::dmat4(attitude_matrix), glm::length(ang_velocity) * delta_time, ang_velocity));
+	update_attitude(delta_time);
 
 	prev_delta_time = delta_time;
 	prev_position = starting_position;
 	verlet_first_run = false;
 }
 
-void Object::reset_integrator() {
-	verlet_first_run = true;
-}
+void Object::update_attitude(double delta_time) {
+	ang_acceleration = net_moment / moment_of_inertia;
 
-void Object::draw_model_solid(Shader* shader) {
-	if (model == NULL) return;
-	shader->setmat4("model", get_model_matrix());
-	shader->setf("specular_coefficient", specular_coefficient);
-	shader->seti("specular_exponent", specular_exponent);
-	model->draw_solid();
+	ang_velocity = ang_velocity + ang_acceleration * delta_time;
+	if (glm::length(ang_velocity) > 1e-8)
+		attitude_matrix = glm::dmat3(glm::rotate(glm::dmat4(attitude_matrix), glm::length(ang_velocity) * delta_time, ang_velocity));
 }
 
-void Object::draw_model_solid(Shader* shader, glm::dvec3 origin) {
-	if (model == NULL) return;
-	shader->setmat4("model", get_relative_model_matrix(origin));
-	shader->setf("specular_coefficient", specular_coefficient);
-	shader->seti("specular_exponent", specular_exponent);
-	model->draw_solid();
+void Object::save_state(StateWriter& w) const {
+	w.put(position);
+	w.put(velocity);
+	w.put(acceleration);
+	w.put(attitude_matrix);
+	w.put(ang_velocity);
+	w.put(ang_acceleration);
+	w.put(mass);
+	w.put(moment_of_inertia);
+	w.put(net_force);
+	w.put(net_moment);
+
+	w.put(verlet_first_run);
+	w.put(prev_delta_time);
+	w.put(prev_position);
 }
 
-void Object::draw_model_wire(Shader* shader) {
-	if (model == NULL) return;
-	shader->setmat4("model", get_model_matrix());
-	shader->setf("specular_coefficient", specular_coefficient);
-	shader->seti("specular_exponent", specular_exponent);
-	model->draw_wire();
+bool Object::restore_state(StateReader& r) {
+	r.get(&position);
+	r.get(&velocity);
+	r.get(&acceleration);
+	r.get(&attitude_matrix);
+	r.get(&ang_velocity);
+	r.get(&ang_acceleration);
+	r.get(&mass);
+	r.get(&moment_of_inertia);
+	r.get(&net_force);
+	r.get(&net_moment);
+
+	r.get(&verlet_first_run);
+	r.get(&prev_delta_time);
+	r.get(&prev_position);
+
+	return !r.failed;
 }
 
-void Object::draw_model_wire(Shader* shader, glm::dvec3 origin) {
-	if (model == NULL) return;
-	shader->setmat4("model", get_relative_model_matrix(origin));
-	shader->setf("specular_coefficient", specular_coefficient);
-	shader->seti("specular_exponent", specular_exponent);
-	model->draw_wire();
+void Object::reset_integrator() {
+	verlet_first_run = true;
 }
 
 glm::dmat4 Object::get_model_matrix() {
 	model_matrix = glm::dmat4(1.0f);
 	model_matrix = glm::translate(model_matrix, position);
 	model_matrix = model_matrix * glm::dmat4(attitude_matrix);
+	model_matrix = glm::scale(model_matrix, scale);
 	return model_matrix;
 }
 
@@ -104,6 +122,7 @@ glm::dmat4 Object::get_relative_model_matrix(glm::dvec3 origin) {
 	model_matrix = glm::dmat4(1.0f);
 	model_matrix = glm::translate(model_matrix, position - origin);
 	model_matrix = model_matrix * glm::dmat4(attitude_matrix);
+	model_matrix = glm::scale(model_matrix, scale);
 	return model_matrix;
 }
 
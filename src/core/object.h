@@ -2,13 +2,14 @@
 #ifndef OBJECT_H
 #define OBJECT_H
 
-#include "model.h"
-#include "camera.h"
-#include "shader.h"
 #include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
 
-#include <map>
-#include <string>
+// Rendering types are only referenced by pointer so that simulation code can be built without OpenGL
+class Model;
+class Shader;
+class StateWriter;
+class StateReader;
 
 class Object {
 public:
@@ -16,8 +17,13 @@ public:
 	~Object();
 
 	void update(double delta_time); // Integrates velocity, acceleration etc. using the Verlet method
+	void update_attitude(double delta_time); // Integrates only the rotation (used when position is integrated elsewhere)
 	void reset_integrator(); // Resets verlet_first_run to 1
 
+	// Kinematics, physical quantities and integrator history (not the model)
+	void save_state(StateWriter& w) const;
+	bool restore_state(StateReader& r);
+
 	void draw_model_wire(Shader* shader);
 	void draw_model_wire(Shader* shader, glm::dvec3 origin);
 	void draw_model_solid(Shader* shader);
@@ -46,14 +52,14 @@ public:
 
 	Model* model;
 
-	// Optional extra attributes (for example, lander fuel level)
-	std::map<std::string, double> attribute;
+	// Rendering only (not simulated)
+	glm::dvec3 scale; // in model space (default 1, 1, 1)
+	float opacity;    // multiplies the alpha of nofx objects (default 1)
 
 private:
 	bool verlet_first_run;
 	double prev_delta_time;
 	glm::dvec3 prev_position;
-	glm::dvec3 prev_attitude;
 
 	// Specular lighting model
 	float specular_coefficient;
@@ -0,0 +1,41 @@
+// Ricardas Navickas 2020
+// Object drawing functions (kept apart from object.cpp so that the physics can be built without OpenGL)
+#include "object.h"
+#include "model.h"
+#include "shader.h"
+
+void Object::draw_model_solid(Shader* shader) {
+	if (model == NULL) return;
+	shader->setmat4("model", get_model_matrix());
+	shader->setf("specular_coefficient", specular_coefficient);
+	shader->seti("specular_exponent", specular_exponent);
+	shader->setf("opacity", opacity);
+	model->draw_solid();
+}
+
+void Object::draw_model_solid(Shader* shader, glm::dvec3 origin) {
+	if (model == NULL) return;
+	shader->setmat4("model", get_relative_model_matrix(origin));
+	shader->setf("specular_coefficient", specular_coefficient);
+	shader->seti("specular_exponent", specular_exponent);
+	shader->setf("opacity", opacity);
+	model->draw_solid();
+}
+
+void Object::draw_model_wire(Shader* shader) {
+	if (model == NULL) return;
+	shader->setmat4("model", get_model_matrix());
+	shader->setf("specular_coefficient", specular_coefficient);
+	shader->seti("specular_exponent", specular_exponent);
+	shader->setf("opacity", opacity);
+	model->draw_wire();
+}
+
+void Object::draw_model_wire(Shader* shader, glm::dvec3 origin) {
+	if (model == NULL) return;
+	shader->setmat4("model", get_relative_model_matrix(origin));
+	shader->setf("specular_coefficient", specular_coefficient);
+	shader->seti("specular_exponent", specular_exponent);
+	shader->setf("opacity", opacity);
+	model->draw_wire();
+}
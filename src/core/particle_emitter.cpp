@@ -0,0 +1,187 @@
+// Ricardas Navickas 2020
+#include "particle_emitter.h"
+#include "error.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PARTICLES_AVX2
+#include <immintrin.h>
+#endif
+
+struct ParticleArrays {
+	float *x, *y, *z, *vx, *vy, *vz, *age;
+};
+
+#ifdef PARTICLES_AVX2
+// Moves particles [0, n) and returns how many were done (the rest are left to the scalar loop)
+static unsigned int move_particles_avx2(const ParticleArrays& p, unsigned int n, float delta_time, float damping, glm::vec3 ambient, glm::vec3 dv, glm::vec3 shift);
+static bool cpu_has_avx2();
+#endif
+
+ParticleEmitter::ParticleEmitter(unsigned int capacity, ParticleStyle style) {
+	if (capacity == 0) fatal("ParticleEmitter::ParticleEmitter()", "Capacity must be at least 1");
+
+	this->capacity = capacity;
+	this->style = style;
+	live = 0;
+
+	x.resize(capacity);
+	y.resize(capacity);
+	z.resize(capacity);
+	vx.resize(capacity);
+	vy.resize(capacity);
+	vz.resize(capacity);
+	age.resize(capacity);
+	life.resize(capacity);
+	instances.resize(capacity);
+
+	// Each particle is a quad (corners -1 to 1) drawn as a triangle strip, placed by its instance data
+	const float quad[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+
+	glGenVertexArrays(1, &vertex_array);
+	glGenBuffers(1, &quad_buffer);
+	glGenBuffers(1, &instance_buffer);
+
+	glBindVertexArray(vertex_array);
+
+	glBindBuffer(GL_ARRAY_BUFFER, quad_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec4) * capacity, NULL, GL_STREAM_DRAW);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+ParticleEmitter::~ParticleEmitter() {
+	glDeleteBuffers(1, &quad_buffer);
+	glDeleteBuffers(1, &instance_buffer);
+	glDeleteVertexArrays(1, &vertex_array);
+}
+
+bool ParticleEmitter::emit(glm::vec3 position, glm::vec3 velocity, float particle_life) {
+	if (live == capacity) return false;
+
+	x[live] = position.x;
+	y[live] = position.y;
+	z[live] = position.z;
+	vx[live] = velocity.x;
+	vy[live] = velocity.y;
+	vz[live] = velocity.z;
+	age[live] = 0.0f;
+	life[live] = particle_life;
+	live++;
+
+	return true;
+}
+
+void ParticleEmitter::update(float delta_time, glm::vec3 ambient_velocity, glm::vec3 shift) {
+	const float damping = std::exp(-style.damping * delta_time);
+	const glm::vec3 dv = ambient_velocity + style.acceleration * delta_time; // (added after damping)
+
+	ParticleArrays p = { x.data(), y.data(), z.data(), vx.data(), vy.data(), vz.data(), age.data() };
+	unsigned int done = 0;
+#ifdef PARTICLES_AVX2
+	if (cpu_has_avx2()) done = move_particles_avx2(p, live, delta_time, damping, ambient_velocity, dv, shift);
+#endif
+
+	for (unsigned int i = done; i < live; i++) {
+		vx[i] = (vx[i] - ambient_velocity.x) * damping + dv.x;
+		vy[i] = (vy[i] - ambient_velocity.y) * damping + dv.y;
+		vz[i] = (vz[i] - ambient_velocity.z) * damping + dv.z;
+		x[i] += vx[i] * delta_time + shift.x;
+		y[i] += vy[i] * delta_time + shift.y;
+		z[i] += vz[i] * delta_time + shift.z;
+		age[i] += delta_time;
+	}
+
+	// Remove dead particles & gather the live ones for drawing
+	unsigned int i = 0;
+	while (i < live) {
+		if (age[i] >= life[i]) {
+			live--;
+			x[i] = x[live];
+			y[i] = y[live];
+			z[i] = z[live];
+			vx[i] = vx[live];
+			vy[i] = vy[live];
+			vz[i] = vz[live];
+			age[i] = age[live];
+			life[i] = life[live];
+			continue;
+		}
+
+		instances[i] = glm::vec4(x[i], y[i], z[i], age[i] / life[i]);
+		i++;
+	}
+}
+
+void ParticleEmitter::draw(Shader* shader, glm::dvec3 origin, glm::dvec3 camera_pos) {
+	if (live == 0) return;
+
+	// Orphan last frame's data instead of waiting for draws still reading it
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec4) * capacity, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec4) * live, instances.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	shader->setmat4("model", glm::translate(glm::dmat4(1.0), origin - camera_pos));
+	shader->setf("size_start", style.size_start);
+	shader->setf("size_end", style.size_end);
+	shader->set4f("color_start", style.color_start.r, style.color_start.g, style.color_start.b, style.color_start.a);
+	shader->set4f("color_end", style.color_end.r, style.color_end.g, style.color_end.b, style.color_end.a);
+
+	glBindVertexArray(vertex_array);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, live);
+	glBindVertexArray(0);
+}
+
+void ParticleEmitter::clear() {
+	live = 0;
+}
+
+unsigned int ParticleEmitter::num_of_particles() {
+	return live;
+}
+
+#ifdef PARTICLES_AVX2
+__attribute__((target("avx2")))
+static unsigned int move_particles_avx2(const ParticleArrays& p, unsigned int n, float delta_time, float damping, glm::vec3 ambient, glm::vec3 dv, glm::vec3 shift) {
+	const __m256 dt = _mm256_set1_ps(delta_time);
+	const __m256 damp = _mm256_set1_ps(damping);
+	const __m256 ax = _mm256_set1_ps(ambient.x), ay = _mm256_set1_ps(ambient.y), az = _mm256_set1_ps(ambient.z);
+	const __m256 dvx = _mm256_set1_ps(dv.x), dvy = _mm256_set1_ps(dv.y), dvz = _mm256_set1_ps(dv.z);
+	const __m256 sx = _mm256_set1_ps(shift.x), sy = _mm256_set1_ps(shift.y), sz = _mm256_set1_ps(shift.z);
+
+	unsigned int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 vx = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(p.vx + i), ax), damp), dvx);
+		__m256 vy = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(p.vy + i), ay), damp), dvy);
+		__m256 vz = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(p.vz + i), az), damp), dvz);
+		_mm256_storeu_ps(p.vx + i, vx);
+		_mm256_storeu_ps(p.vy + i, vy);
+		_mm256_storeu_ps(p.vz + i, vz);
+
+		// Same operation order as the scalar loop: x + (v * dt + shift)
+		_mm256_storeu_ps(p.x + i, _mm256_add_ps(_mm256_loadu_ps(p.x + i), _mm256_add_ps(_mm256_mul_ps(vx, dt), sx)));
+		_mm256_storeu_ps(p.y + i, _mm256_add_ps(_mm256_loadu_ps(p.y + i), _mm256_add_ps(_mm256_mul_ps(vy, dt), sy)));
+		_mm256_storeu_ps(p.z + i, _mm256_add_ps(_mm256_loadu_ps(p.z + i), _mm256_add_ps(_mm256_mul_ps(vz, dt), sz)));
+		_mm256_storeu_ps(p.age + i, _mm256_add_ps(_mm256_loadu_ps(p.age + i), dt));
+	}
+
+	return i;
+}
+
+static bool cpu_has_avx2() {
+	static const bool has_avx2 = __builtin_cpu_supports("avx2");
+	return has_avx2;
+}
+#endif
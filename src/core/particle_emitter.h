@@ -0,0 +1,62 @@
+// Ricardas Navickas 2020
+#ifndef PARTICLE_EMITTER_H
+#define PARTICLE_EMITTER_H
+
+#include "GL/glew.h"
+#include "GL/gl.h"
+#include "glm/glm.hpp"
+#include "shader.h"
+
+#include <vector>
+
+// Appearance of an emitter's particles, interpolated over each particle's life
+struct ParticleStyle {
+	float size_start, size_end;   // half width of the (camera facing) particle
+	glm::vec4 color_start, color_end;
+	float damping;                // fraction of velocity relative to the surrounding air lost per second
+	glm::vec3 acceleration;       // e.g. gravity
+};
+
+// Pool of short-lived particles of one kind, drawn with a single instanced call.
+// Storage for capacity particles is allocated up front; particles emitted while the pool is full are
+// dropped. Particles are kept as arrays of each component (positions relative to an origin the owner
+// chooses, as floats) and moved 8 at a time with AVX2 where the CPU has it. Dead particles are replaced
+// by the last live one, so the live particles are always the first num_of_particles().
+class ParticleEmitter {
+public:
+	ParticleEmitter(unsigned int capacity, ParticleStyle style);
+	~ParticleEmitter();
+
+	// Returns false if the pool is full
+	bool emit(glm::vec3 position, glm::vec3 velocity, float life);
+
+	// Ages & moves the particles by delta_time, slowing them down towards ambient_velocity (of the air around
+	// them), and moves them all by shift (when the owner moves the origin)
+	void update(float delta_time, glm::vec3 ambient_velocity, glm::vec3 shift);
+
+	// Draws with shader (see shaders/particle.v.glsl) which must be in use, with view & projection set.
+	// origin - camera position goes in the model matrix.
+	void draw(Shader* shader, glm::dvec3 origin, glm::dvec3 camera_pos);
+
+	void clear();
+	unsigned int num_of_particles();
+
+	ParticleStyle style;
+
+private:
+	unsigned int capacity;
+	unsigned int live;
+
+	// Particle i is (x[i], y[i], z[i]) etc.
+	std::vector<float> x, y, z;
+	std::vector<float> vx, vy, vz;
+	std::vector<float> age, life;
+
+	std::vector<glm::vec4> instances; // position & age / life of live particles, for upload
+
+	GLuint quad_buffer;
+	GLuint instance_buffer;
+	GLuint vertex_array;
+};
+
+#endif
@@ -28,6 +28,14 @@ void Scene::add_light(Object* obj, glm::vec3 color) {
 	light_color.push_back(color);
 }
 
+void Scene::add_object_list(const std::vector<Object*>* list) {
+	object_lists.push_back(list);
+}
+
+void Scene::add_render_callback(RenderCallback callback) {
+	render_callbacks.push_back(callback);
+}
+
 void Scene::remove_object(Object* obj) {
 	for (unsigned int i = 0; i < objects.size(); i++) {
 		if (objects[i] == obj) objects.erase(objects.begin() + i);
@@ -40,6 +48,12 @@ void Scene::remove_nofx_object(Object* obj) {
 	}
 }
 
+void Scene::remove_object_list(const std::vector<Object*>* list) {
+	for (unsigned int i = 0; i < object_lists.size(); i++) {
+		if (object_lists[i] == list) object_lists.erase(object_lists.begin() + i);
+	}
+}
+
 void Scene::render() {
 	float frame_start_time = glfwGetTime();
 
@@ -98,6 +112,17 @@ void Scene::render_zrange(float z_near, float z_far) {
 			objects[i]->draw_model_solid(world_shader, camera->position);
 	}
 
+	for (unsigned int i = 0; i < object_lists.size(); i++) {
+		const std::vector<Object*>& list = *object_lists[i];
+
+		for (unsigned int j = 0; j < list.size(); j++) {
+			if (render_wireframe)
+				list[j]->draw_model_wire(world_shader, camera->position);
+			else
+				list[j]->draw_model_solid(world_shader, camera->position);
+		}
+	}
+
 	// **** Draw nofx objects ****
 	world_shader->use();
 	world_shader->setb("apply_lighting", false);
@@ -111,5 +136,13 @@ void Scene::render_zrange(float z_near, float z_far) {
 		else
 			nofx_objects[i]->draw_model_solid(world_shader, camera->position);
 	}
+
+	// **** Draw objects with their own shaders ****
+	const glm::mat4 view = camera->origin_view_matrix();
+	const glm::mat4 projection = camera->perspective_matrix(z_near, z_far, (float)wstate.window_width / wstate.window_height);
+
+	for (unsigned int i = 0; i < render_callbacks.size(); i++) {
+		render_callbacks[i](camera, view, projection);
+	}
 }
 
@@ -8,6 +8,9 @@
 #include "model.h"
 #include "glm/glm.hpp"
 
+#include <vector>
+#include <functional>
+
 /*
  * Scenes are rendered in two passes using different perspective matrices to provide
  * sufficient depth buffer precision both for objects close to the camera and objects
@@ -21,6 +24,10 @@
 #define Z_FAR            1000.0f * 3386.0f //1000*MARS_RADIUS
 #define Z_OVERLAP_FACTOR 1.05f
 
+// Draws something with its own shader (after the scene's objects, in both passes). The view matrix puts
+// the camera at the origin, so positions must be made relative to camera->position.
+typedef std::function<void(Camera* camera, glm::mat4 view, glm::mat4 projection)> RenderCallback;
+
 class Scene {
 public:
 	Scene(Camera* c, Shader* ws, Shader* ls);
@@ -29,9 +36,12 @@ public:
 	void add_object(Object* obj);
 	void add_nofx_object(Object* obj);
 	void add_light(Object* obj, glm::vec3 color);
+	void add_object_list(const std::vector<Object*>* list); // owned by the caller, which may change it between frames
+	void add_render_callback(RenderCallback callback);
 
 	void remove_object(Object* obj);
 	void remove_nofx_object(Object* obj);
+	void remove_object_list(const std::vector<Object*>* list);
 
 	void render();
 
@@ -47,6 +57,8 @@ private:
 	std::vector<Object*> objects; // objects to draw (using world shader)
 	std::vector<Object*> nofx_objects; // objects to draw (using world_nofx shader)
 	std::vector<Object*> lights;  // light objects to draw (using world_nofx shader)
+	std::vector<const std::vector<Object*>*> object_lists; // more objects to draw (using world shader)
+	std::vector<RenderCallback> render_callbacks;
 
 	std::vector<glm::vec3> light_pos;
 	std::vector<glm::vec3> light_color;
@@ -0,0 +1,81 @@
+// Ricardas Navickas 2020
+#ifndef STATE_BLOB_H
+#define STATE_BLOB_H
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+// Flat binary buffer for saving & restoring state (see checkpoint.h). Values are stored as raw
+// bytes in the order they are put, with no alignment or tags, so they must be read back in the
+// same order by the same build. Reading works straight from a memory-mapped file.
+class StateWriter {
+public:
+	StateWriter(std::vector<char>* out) : out(out) {}
+
+	template <typename T> void put(const T& value) {
+		static_assert(std::is_trivially_copyable<T>::value, "only plain data can be stored directly");
+		put_bytes(&value, sizeof(T));
+	}
+
+	void put_bytes(const void* data, size_t size) {
+		const char* bytes = static_cast<const char*>(data);
+		out->insert(out->end(), bytes, bytes + size);
+	}
+
+	void put_string(const std::string& s) {
+		put((uint32_t)s.size());
+		put_bytes(s.data(), s.size());
+	}
+
+	size_t size() { return out->size(); }
+
+private:
+	std::vector<char>* out;
+};
+
+class StateReader {
+public:
+	StateReader(const char* data, size_t size) : failed(false), next(data), end(data + size) {}
+
+	// All getters return false (and set failed) if the data ends too early
+	template <typename T> bool get(T* value) {
+		static_assert(std::is_trivially_copyable<T>::value, "only plain data can be stored directly");
+		return get_bytes(value, sizeof(T));
+	}
+
+	bool get_bytes(void* data, size_t size) {
+		if (failed || size_t(end - next) < size) {
+			failed = true;
+			return false;
+		}
+
+		memcpy(data, next, size);
+		next += size;
+		return true;
+	}
+
+	bool get_string(std::string* s) {
+		uint32_t size = 0;
+		if (!get(&size) || size_t(end - next) < size) {
+			failed = true;
+			return false;
+		}
+
+		s->assign(next, size);
+		next += size;
+		return true;
+	}
+
+	size_t remaining() { return end - next; }
+
+	bool failed;
+
+private:
+	const char* next;
+	const char* end;
+};
+
+#endif
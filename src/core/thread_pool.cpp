@@ -0,0 +1,132 @@
+// Ricardas Navickas 2020
+#include "thread_pool.h"
+
+// Index of the current worker in its pool (-1 outside of pool threads)
+static thread_local int worker_id = -1;
+static thread_local ThreadPool* worker_pool = NULL;
+
+ThreadPool::ThreadPool(unsigned int num_of_threads) {
+	if (num_of_threads == 0) num_of_threads = std::thread::hardware_concurrency();
+	if (num_of_threads == 0) num_of_threads = 1;
+
+	queued_tasks = 0;
+	pending_tasks = 0;
+	next_queue = 0;
+	stopping = false;
+
+	for (unsigned int i = 0; i < num_of_threads; i++) {
+		queues.push_back(new WorkerQueue);
+		queues[i]->sleeping = false;
+	}
+
+	for (unsigned int i = 0; i < num_of_threads; i++) {
+		threads.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	stopping = true;
+	for (unsigned int i = 0; i < queues.size(); i++) {
+		wake(i);
+	}
+
+	for (unsigned int i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+
+	for (unsigned int i = 0; i < queues.size(); i++) {
+		delete queues[i];
+	}
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+	const unsigned int target = (worker_pool == this) ? worker_id : next_queue++ % queues.size();
+	pending_tasks++;
+
+	{
+		std::lock_guard<std::mutex> guard(queues[target]->lock);
+		queues[target]->tasks.push_back(task);
+		queued_tasks++;
+	}
+
+	// Wake the owner of the queue, or if it's busy, some idle worker to steal the task
+	if (!queues[target]->sleeping) {
+		for (unsigned int i = 1; i < queues.size(); i++) {
+			const unsigned int thief = (target + i) % queues.size();
+			if (queues[thief]->sleeping) {
+				wake(thief);
+				return;
+			}
+		}
+	}
+
+	wake(target);
+}
+
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex> guard(done_lock);
+	all_done.wait(guard, [this] { return pending_tasks == 0; });
+}
+
+unsigned int ThreadPool::size() {
+	return threads.size();
+}
+
+// (taking the lock makes sure a worker that is about to sleep sees the change that woke it)
+void ThreadPool::wake(unsigned int id) {
+	std::lock_guard<std::mutex> guard(queues[id]->lock);
+	queues[id]->wakeup.notify_one();
+}
+
+void ThreadPool::worker_loop(unsigned int id) {
+	worker_id = id;
+	worker_pool = this;
+	WorkerQueue* own = queues[id];
+
+	while (true) {
+		std::function<void()> task;
+		if (pop_task(id, task) || steal_task(id, task)) {
+			task();
+
+			if (--pending_tasks == 0) {
+				std::lock_guard<std::mutex> guard(done_lock);
+				all_done.notify_all();
+			}
+			continue;
+		}
+
+		// Nothing anywhere: sleep until a task is queued here or there is one to steal
+		std::unique_lock<std::mutex> guard(own->lock);
+		own->sleeping = true;
+		own->wakeup.wait(guard, [this] { return queued_tasks > 0 || stopping; });
+		own->sleeping = false;
+
+		if (stopping && queued_tasks == 0) return;
+	}
+}
+
+bool ThreadPool::pop_task(unsigned int id, std::function<void()>& task) {
+	std::lock_guard<std::mutex> guard(queues[id]->lock);
+	if (queues[id]->tasks.empty()) return false;
+
+	task = std::move(queues[id]->tasks.back());
+	queues[id]->tasks.pop_back();
+	queued_tasks--;
+	return true;
+}
+
+bool ThreadPool::steal_task(unsigned int id, std::function<void()>& task) {
+	for (unsigned int i = 1; i < queues.size(); i++) {
+		WorkerQueue* victim = queues[(id + i) % queues.size()];
+		std::lock_guard<std::mutex> guard(victim->lock);
+
+		if (!victim->tasks.empty()) {
+			task = std::move(victim->tasks.front());
+			victim->tasks.pop_front();
+			queued_tasks--;
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,55 @@
+// Ricardas Navickas 2020
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+// Work-stealing thread pool
+// Each worker owns a task queue and sleeps on it; idle workers steal from the other queues, so long
+// and short tasks balance out across cores without a single shared queue. The task counters are
+// atomics, so a task only ever takes the lock of the queue it is pushed to / taken from.
+class ThreadPool {
+public:
+	ThreadPool(unsigned int num_of_threads); // 0 - one thread per hardware thread
+	~ThreadPool();
+
+	// Queues task (on the calling worker's own queue if called from a task)
+	void submit(std::function<void()> task);
+
+	// Blocks until every submitted task has finished
+	void wait();
+
+	unsigned int size();
+
+private:
+	struct WorkerQueue {
+		std::deque<std::function<void()>> tasks;
+		std::mutex lock;
+		std::condition_variable wakeup;
+		std::atomic<bool> sleeping;
+	};
+
+	void worker_loop(unsigned int id);
+	bool pop_task(unsigned int id, std::function<void()>& task); // newest task from own queue
+	bool steal_task(unsigned int id, std::function<void()>& task); // oldest task from another queue
+	void wake(unsigned int id);
+
+	std::vector<WorkerQueue*> queues;
+	std::vector<std::thread> threads;
+
+	std::atomic<unsigned int> queued_tasks;  // in some queue (changed under that queue's lock)
+	std::atomic<unsigned int> pending_tasks; // submitted, not yet finished
+	std::atomic<unsigned int> next_queue;    // round-robin target for submissions from outside the pool
+	std::atomic<bool> stopping;
+
+	std::mutex done_lock;
+	std::condition_variable all_done;
+};
+
+#endif
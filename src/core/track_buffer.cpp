@@ -0,0 +1,90 @@
+// Ricardas Navickas 2020
+#include "track_buffer.h"
+#include "error.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+// The buffer holds capacity + 1 points: the last one repeats the first, so that a track which wraps
+// around the end of the ring is drawn as two strips that meet without a gap
+
+TrackBuffer::TrackBuffer(unsigned int capacity) {
+	if (capacity < 2) fatal("TrackBuffer::TrackBuffer()", "Capacity must be at least 2");
+
+	this->capacity = capacity;
+	clear();
+
+	glGenVertexArrays(1, &vertex_array);
+	glGenBuffers(1, &vertex_buffer);
+
+	glBindVertexArray(vertex_array);
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * (capacity + 1), NULL, GL_DYNAMIC_DRAW);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+TrackBuffer::~TrackBuffer() {
+	glDeleteBuffers(1, &vertex_buffer);
+	glDeleteVertexArrays(1, &vertex_array);
+}
+
+void TrackBuffer::add_point(glm::dvec3 point) {
+	write_point(head, point);
+
+	head = (head + 1) % capacity;
+	if (count < capacity - 1) count++;
+	has_end = false;
+}
+
+void TrackBuffer::set_end(glm::dvec3 point) {
+	write_point(head, point);
+	has_end = true;
+}
+
+void TrackBuffer::clear() {
+	head = 0;
+	count = 0;
+	has_end = false;
+}
+
+void TrackBuffer::draw(Shader* shader, glm::dvec3 camera_pos, glm::vec3 color) {
+	// Oldest point to the loose end (or the newest point if there is no loose end yet)
+	const unsigned int length = count + (has_end ? 1 : 0);
+	if (length < 2) return;
+
+	const unsigned int last = has_end ? head : (head + capacity - 1) % capacity;
+	const unsigned int first = (last + capacity + 1 - length) % capacity;
+
+	shader->setmat4("model", glm::translate(glm::dmat4(1.0), -camera_pos));
+	shader->set3f("color", color.x, color.y, color.z);
+	shader->seti("last", last);
+	shader->seti("length", length);
+	shader->seti("capacity", capacity);
+
+	glBindVertexArray(vertex_array);
+
+	if (first <= last) {
+		glDrawArrays(GL_LINE_STRIP, first, length);
+	} else {
+		glDrawArrays(GL_LINE_STRIP, first, capacity + 1 - first); // up to the copy of slot 0
+		glDrawArrays(GL_LINE_STRIP, 0, last + 1);
+	}
+
+	glBindVertexArray(0);
+}
+
+unsigned int TrackBuffer::num_of_points() {
+	return count;
+}
+
+void TrackBuffer::write_point(unsigned int slot, glm::dvec3 point) {
+	const glm::vec3 p = point;
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * slot, sizeof(glm::vec3), &p);
+	if (slot == 0) glBufferSubData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * capacity, sizeof(glm::vec3), &p);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
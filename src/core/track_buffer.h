@@ -0,0 +1,43 @@
+// Ricardas Navickas 2020
+#ifndef TRACK_BUFFER_H
+#define TRACK_BUFFER_H
+
+#include "GL/glew.h"
+#include "GL/gl.h"
+#include "glm/glm.hpp"
+#include "shader.h"
+
+// Line through a series of points (e.g. the path a body took), kept in a ring buffer in OpenGL memory.
+// Adding a point uploads only that point and the newest points overwrite the oldest once the buffer is
+// full. The track fades from the newest point to the oldest; the fade is worked out in the vertex shader
+// from each vertex's distance to the ring's head, so no vertex is rewritten as the track grows and the
+// cost of a frame doesn't depend on the length of the track.
+//
+// Points are stored as floats, in the frame draw() is given the origin of.
+class TrackBuffer {
+public:
+	TrackBuffer(unsigned int capacity);
+	~TrackBuffer();
+
+	void add_point(glm::dvec3 point); // becomes the newest point
+	void set_end(glm::dvec3 point);   // the track's loose end (drawn after the newest point, e.g. where the body is now)
+	void clear();
+
+	// Draws with shader (see shaders/track.v.glsl) which must be in use, with view & projection set
+	void draw(Shader* shader, glm::dvec3 camera_pos, glm::vec3 color);
+
+	unsigned int num_of_points();
+
+private:
+	void write_point(unsigned int slot, glm::dvec3 point);
+
+	GLuint vertex_buffer;
+	GLuint vertex_array;
+
+	unsigned int capacity; // points, one slot is taken by the loose end
+	unsigned int head;     // slot of the loose end, the next point goes there
+	unsigned int count;    // points added (up to capacity - 1)
+	bool has_end;
+};
+
+#endif
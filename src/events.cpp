@@ -0,0 +1,175 @@
+// Ricardas Navickas 2020
+#include "events.h"
+#include "simulation.h"
+#include "mars.h"
+#include "lander.h"
+
+#include <cmath>
+#include <algorithm>
+
+static const double time_tolerance = 1e-9; // s
+static const int max_iterations = 100;
+
+static double surface_distance(SimulationContext* ctx, glm::dvec3 position, glm::dvec3 velocity);
+static double atmosphere_distance(SimulationContext* ctx, glm::dvec3 position, glm::dvec3 velocity);
+static double radial_velocity(SimulationContext* ctx, glm::dvec3 position, glm::dvec3 velocity);
+
+static void interpolate(glm::dvec3 x0, glm::dvec3 v0, glm::dvec3 x1, glm::dvec3 v1, double dt, double t, glm::dvec3& x, glm::dvec3& v);
+
+std::vector<EventDetector> make_default_event_detectors() {
+	std::vector<EventDetector> detectors;
+
+	detectors.push_back({ EVENT_SURFACE_CONTACT, surface_distance, -1, true, false });
+	detectors.push_back({ EVENT_ATMOSPHERE_ENTRY, atmosphere_distance, -1, true, false });
+	detectors.push_back({ EVENT_ATMOSPHERE_EXIT, atmosphere_distance, 1, false, false });
+	detectors.push_back({ EVENT_PERIAPSIS, radial_velocity, 1, false, true });
+	detectors.push_back({ EVENT_APOAPSIS, radial_velocity, -1, false, true });
+
+	return detectors;
+}
+
+const char* event_name(int type) {
+	switch (type) {
+	case EVENT_SURFACE_CONTACT: return "surface contact";
+	case EVENT_ATMOSPHERE_ENTRY: return "atmosphere entry";
+	case EVENT_ATMOSPHERE_EXIT: return "atmosphere exit";
+	case EVENT_PERIAPSIS: return "periapsis";
+	case EVENT_APOAPSIS: return "apoapsis";
+	default: return "unknown";
+	}
+}
+
+double locate_events(SimulationContext* ctx, double t0, glm::dvec3 x0, glm::dvec3 v0, double dt, EventRecord* terminal) {
+	Lander* lander = ctx->lander;
+	const glm::dvec3 x1 = lander->position;
+	const glm::dvec3 v1 = lander->velocity;
+	const bool coasting = (lander->state.me_throttle == 0.0) && !ctx->state.crashed;
+
+	std::vector<EventRecord> found;
+	double end = dt; // time of the earliest terminal event so far
+
+	for (unsigned int i = 0; i < ctx->event_detectors.size(); i++) {
+		const EventDetector& d = ctx->event_detectors[i];
+		if (d.coasting_only && !coasting) continue;
+
+		double a = 0.0, b = dt;
+		double ga = d.g(ctx, x0, v0);
+		double gb = d.g(ctx, x1, v1);
+
+		bool rising = (ga < 0.0 && gb >= 0.0);
+		bool falling = (ga > 0.0 && gb <= 0.0);
+		if (!(rising && d.direction >= 0) && !(falling && d.direction <= 0)) continue;
+
+		// Brent's method; [a, b] always brackets the crossing, b is on the far side of it
+		double c = a, gc = ga;
+		double e = b - a, step = e;
+		glm::dvec3 x, v;
+
+		for (int it = 0; it < max_iterations; it++) {
+			if ((gb > 0.0) == (gc > 0.0)) {
+				c = a;
+				gc = ga;
+				e = step = b - a;
+			}
+			if (std::abs(gc) < std::abs(gb)) {
+				a = b; b = c; c = a;
+				ga = gb; gb = gc; gc = ga;
+			}
+
+			double tol = 0.5 * time_tolerance;
+			double m = 0.5 * (c - b);
+			if (std::abs(m) <= tol || gb == 0.0) break;
+
+			if (std::abs(e) >= tol && std::abs(ga) > std::abs(gb)) {
+				// Inverse quadratic interpolation (or secant)
+				double s = gb / ga, p, q;
+				if (a == c) {
+					p = 2.0 * m * s;
+					q = 1.0 - s;
+				} else {
+					double r = gb / gc;
+					q = ga / gc;
+					p = s * (2.0 * m * q * (q - r) - (b - a) * (r - 1.0));
+					q = (q - 1.0) * (r - 1.0) * (s - 1.0);
+				}
+				if (p > 0.0) q = -q; else p = -p;
+
+				if (2.0 * p < std::min(3.0 * m * q - std::abs(tol * q), std::abs(e * q))) {
+					e = step;
+					step = p / q;
+				} else {
+					step = m;
+					e = m;
+				}
+			} else {
+				// Bisection
+				step = m;
+				e = m;
+			}
+
+			a = b;
+			ga = gb;
+			b += (std::abs(step) > tol) ? step : (m > 0.0 ? tol : -tol);
+
+			interpolate(x0, v0, x1, v1, dt, b, x, v);
+			gb = d.g(ctx, x, v);
+		}
+
+		// Take the point past the crossing so the event isn't found again next step
+		bool b_past = rising ? (gb >= 0.0) : (gb <= 0.0);
+		double t = b_past ? b : c;
+		interpolate(x0, v0, x1, v1, dt, t, x, v);
+
+		EventRecord record = { d.type, t0 + t, x, v };
+		found.push_back(record);
+		if (d.terminal && t < end) {
+			end = t;
+			*terminal = record;
+		}
+	}
+
+	// Log everything up to the first terminal event, in time order
+	std::sort(found.begin(), found.end(), [](const EventRecord& l, const EventRecord& r) { return l.time < r.time; });
+	for (unsigned int i = 0; i < found.size(); i++) {
+		if (found[i].time <= t0 + end) ctx->event_log.push_back(found[i]);
+	}
+
+	if (end < dt) {
+		lander->position = terminal->position;
+		lander->velocity = terminal->velocity;
+		lander->reset_integrator();
+	}
+
+	return end;
+}
+
+// ==== ==== EVENT FUNCTIONS ==== ====
+
+// Height of the lander's base above the terrain
+static double surface_distance(SimulationContext* ctx, glm::dvec3 position, glm::dvec3 velocity) {
+	Object* mars = ctx->mars;
+	double altitude = glm::length(position - mars->position) - MARS_RADIUS;
+
+	// Terrain is far below the top of the atmosphere, no need to sample it
+	if (altitude > MARS_ATMOSPHERE_HEIGHT) return altitude;
+
+	return altitude - BASE_COM_DIST - mars_surface_height(mars, &ctx->env, &ctx->terrain, TERRAIN_PHYSICS_LEVEL, position - mars->position);
+}
+
+static double atmosphere_distance(SimulationContext* ctx, glm::dvec3 position, glm::dvec3 velocity) {
+	return glm::length(position - ctx->mars->position) - MARS_RADIUS - MARS_ATMOSPHERE_HEIGHT;
+}
+
+static double radial_velocity(SimulationContext* ctx, glm::dvec3 position, glm::dvec3 velocity) {
+	return glm::dot(glm::normalize(position - ctx->mars->position), velocity - ctx->mars->velocity);
+}
+
+// Cubic Hermite interpolation of the state at time t in [0, dt]
+static void interpolate(glm::dvec3 x0, glm::dvec3 v0, glm::dvec3 x1, glm::dvec3 v1, double dt, double t, glm::dvec3& x, glm::dvec3& v) {
+	double s = t / dt;
+	double s2 = s * s;
+	double s3 = s2 * s;
+
+	x = (2 * s3 - 3 * s2 + 1) * x0 + (s3 - 2 * s2 + s) * dt * v0 + (-2 * s3 + 3 * s2) * x1 + (s3 - s2) * dt * v1;
+	v = ((6 * s2 - 6 * s) * x0 + (3 * s2 - 4 * s + 1) * dt * v0 + (-6 * s2 + 6 * s) * x1 + (3 * s2 - 2 * s) * dt * v1) / dt;
+}
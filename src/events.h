@@ -0,0 +1,47 @@
+// Ricardas Navickas 2020
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include "core/glm/glm.hpp"
+#include <vector>
+
+class SimulationContext;
+
+// Event types
+#define EVENT_SURFACE_CONTACT   0
+#define EVENT_ATMOSPHERE_ENTRY  1
+#define EVENT_ATMOSPHERE_EXIT   2
+#define EVENT_PERIAPSIS         3
+#define EVENT_APOAPSIS          4
+
+// Zero-crossing function of the lander state; an event happens where it changes sign
+typedef double (*EventFunction)(SimulationContext* ctx, glm::dvec3 position, glm::dvec3 velocity);
+
+struct EventDetector {
+	int type;         // EVENT_*
+	EventFunction g;
+	int direction;    // +1 - only rising crossings (- to +), -1 - only falling, 0 - both
+	bool terminal;    // the step is cut short at the event
+	bool coasting_only; // ignored while the main engine is firing
+};
+
+struct EventRecord {
+	int type;
+	double time;
+	glm::dvec3 position;
+	glm::dvec3 velocity;
+};
+
+// Surface contact, atmosphere entry/exit and apsis passage detectors
+std::vector<EventDetector> make_default_event_detectors();
+
+const char* event_name(int type);
+
+// Checks the lander's last move (from x0, v0 at time t0 to its current state at t0 + dt) for
+// events, locating them within the step with Brent's method on a cubic Hermite interpolant.
+// Events are appended to ctx->event_log in time order. If a terminal event happened, the lander
+// is moved back to the state just past the earliest one and that event is returned in *terminal.
+// Returns the part of dt actually covered by the step.
+double locate_events(SimulationContext* ctx, double t0, glm::dvec3 x0, glm::dvec3 v0, double dt, EventRecord* terminal);
+
+#endif
@@ -1,14 +1,28 @@
 // Ricardas Navickas 2020
 #include "global.h"
+#include "core/core.h"
+
+static void set_pose(Object* obj, const ObjectSnapshot& snapshot);
+
+SimulationContext* sim = NULL;
+SimulationThread* sim_thread = NULL;
+
+SimulationSnapshot sim_view;
+
+Lander* lander_view = NULL;
+Object* mars_view = NULL;
+std::vector<Object*> lander_debris_view;
 
-Object* lander = NULL;
 Object* lander_parachute = NULL;
 Object* lander_exhaust = NULL;
-std::vector<Object*> lander_debris;
 
-Object* mars = NULL;
 Object* sun = NULL;
 
+TrajectoryPredictor* trajectory_predictor = NULL;
+Object* predicted_path = NULL;
+Object* predicted_impact = NULL;
+Object* predicted_landing_site = NULL;
+
 Model* lander_default_model = NULL;
 Model* lander_crashed_model = NULL;
 Model* lander_debris1_model = NULL;
@@ -16,32 +30,42 @@ Model* lander_debris2_model = NULL;
 
 Shader* world_shader = NULL;
 Shader* world_nofx_shader = NULL;
+Shader* track_shader = NULL;
+Shader* orbit_shader = NULL;
+Shader* particle_shader = NULL;
 
 void init_global_vars() {
-	lander = make_lander_object();
 	lander_parachute = make_parachute_object();
 	lander_exhaust = make_exhaust_object();
-	mars = make_mars_object();
 	sun = make_sun_object();
 
-	lander_default_model = lander->model;
+	trajectory_predictor = new TrajectoryPredictor;
+	predicted_path = make_trajectory_object();
+	predicted_impact = make_impact_marker_object(MARS_RADIUS / 150.0f);
+	predicted_landing_site = make_impact_marker_object(0.01f);
+
+	lander_view = new Lander(*sim->lander);
+	mars_view = new Object(*sim->mars);
+	for (unsigned int i = 0; i < sim->lander_debris.size(); i++) {
+		lander_debris_view.push_back(new Object(*sim->lander_debris[i]));
+	}
+
+	lander_default_model = make_lander_model();
+	lander_view->model = lander_default_model;
+	mars_view->model = make_mars_model();
 
 	Mesh* lander_crashed_mesh = load_stl_mesh("models/lander_crashed.stl", 0.4f, 0.4f, 0.4f);
 	if (lander_crashed_mesh != NULL) {
 		transform_mesh(lander_crashed_mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(0.001, 0.001, 0.001)));
 		lander_crashed_model = new Model(lander_crashed_mesh, GL_TRIANGLES);
 	} else {
-		lander_crashed_model = lander->model;
+		lander_crashed_model = lander_default_model;
 	}
 
 	Mesh* lander_debris1_mesh = load_stl_mesh("models/lander_debris1.stl", 0.4f, 0.4f, 0.4f);
 	if (lander_debris1_mesh != NULL) {
 		transform_mesh(lander_debris1_mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(0.001, 0.001, 0.001)));
 		lander_debris1_model = new Model(lander_debris1_mesh, GL_TRIANGLES);
-
-		// Debris objects
-		lander_debris.push_back(new Object(lander_debris1_model, glm::dvec3(0.0), 1.0f, 128));
-		lander_debris.push_back(new Object(lander_debris1_model, glm::dvec3(0.0), 1.0f, 128));
 	} else {
 		lander_debris1_model = NULL;
 	}
@@ -50,14 +74,41 @@ void init_global_vars() {
 	if (lander_debris2_mesh != NULL) {
 		transform_mesh(lander_debris2_mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(0.001, 0.001, 0.001)));
 		lander_debris2_model = new Model(lander_debris2_mesh, GL_TRIANGLES);
-
-		// Debris objects
-		lander_debris.push_back(new Object(lander_debris2_model, glm::dvec3(0.0), 1.0f, 128));
 	} else {
 		lander_debris2_model = NULL;
 	}
 
+	// Debris objects (debris without a model is still simulated, but not drawn)
+	for (unsigned int i = 0; i < lander_debris_view.size(); i++) {
+		lander_debris_view[i]->model = (i < 2) ? lander_debris1_model : lander_debris2_model;
+	}
+
 	world_shader = new Shader("shaders/world.v.glsl", "shaders/world.f.glsl");
 	world_nofx_shader = new Shader("shaders/world_nofx.v.glsl", "shaders/world_nofx.f.glsl");
+	track_shader = new Shader("shaders/track.v.glsl", "shaders/track.f.glsl");
+	orbit_shader = new Shader("shaders/orbit.v.glsl", "shaders/orbit.f.glsl");
+	particle_shader = new Shader("shaders/particle.v.glsl", "shaders/particle.f.glsl");
+}
+
+
+static void set_pose(Object* obj, const ObjectSnapshot& snapshot) {
+	obj->position = snapshot.position;
+	obj->velocity = snapshot.velocity;
+	obj->attitude_matrix = glm::mat3_cast(snapshot.attitude);
+	obj->ang_velocity = snapshot.ang_velocity;
 }
 
+void update_view_objects() {
+	set_pose(mars_view, sim_view.mars);
+	set_pose(lander_view, sim_view.lander);
+	lander_view->state = sim_view.lander_state;
+	lander_view->model = sim_view.state.crashed ? lander_crashed_model : lander_default_model;
+
+	for (unsigned int i = 0; i < lander_debris_view.size() && i < sim_view.debris.size(); i++) {
+		set_pose(lander_debris_view[i], sim_view.debris[i]);
+	}
+
+	if (trajectory_predictor->update(sim_view, sim->env.terrain_seed, sim->env.wind_seed))
+		update_trajectory_object(predicted_path, trajectory_predictor->prediction);
+	update_impact_markers(predicted_impact, predicted_landing_site, mars_view, trajectory_predictor->prediction);
+}
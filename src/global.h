@@ -7,16 +7,36 @@
 #include "lander.h"
 #include "mars.h"
 #include "sun.h"
+#include "simulation.h"
+#include "sim_thread.h"
+#include "trajectory.h"
+
+#include <vector>
+
+// Simulation shown in the GUI, stepped by sim_thread (hold sim_thread->lock() to access it)
+extern SimulationContext* sim;
+extern SimulationThread* sim_thread;
+
+// Simulation state interpolated for the current frame (see update_view_objects())
+extern SimulationSnapshot sim_view;
+
+// Rendered copies of the simulated lander, mars and debris (the simulated ones are owned by sim)
+extern Lander* lander_view;
+extern Object* mars_view;
+extern std::vector<Object*> lander_debris_view;
 
 // Objects
-extern Object* lander;
 extern Object* lander_exhaust;
 extern Object* lander_parachute;
-extern std::vector<Object*> lander_debris;
 
-extern Object* mars;
 extern Object* sun;
 
+// Where the lander is headed (see TrajectoryPredictor)
+extern TrajectoryPredictor* trajectory_predictor;
+extern Object* predicted_path;
+extern Object* predicted_impact;       // impact point, for far views
+extern Object* predicted_landing_site; // on mars' surface, for close views
+
 // Models
 extern Model* lander_default_model;
 extern Model* lander_crashed_model;
@@ -26,7 +46,15 @@ extern Model* lander_debris2_model;
 // Shader programs
 extern Shader* world_shader;
 extern Shader* world_nofx_shader;
+extern Shader* track_shader;
+extern Shader* orbit_shader;
+extern Shader* particle_shader;
 
+// Creates models, shaders and the rendered copies of the simulated objects
+// NOTE: sim must be created first
 void init_global_vars();
 
+// Poses the rendered copies from sim_view
+void update_view_objects();
+
 #endif
@@ -6,7 +6,9 @@
 #include "lander.h"
 #include "mars.h"
 #include "simulation.h"
+#include "checkpoint.h"
 #include "global.h"
+#include "orbit_scene.h"
 
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_glfw.h"
@@ -34,12 +36,15 @@ void init_gui() {
 	guistate.frame_duration = 0.0f;
 	guistate.sim_time = 0.0f;
 	guistate.sim_timestep = 0.0f;
+	guistate.sim_busy_time = 0.0f;
+	guistate.sim_speed = 0.0f;
 	guistate.selected_scene = CLOSEUP_SCENE_SELECTED;
 	guistate.selected_scenario = 0;
 	guistate.scenario_changed = false;
 	guistate.custom_scenario_lander_pos = glm::dvec3(0.0);
 	guistate.custom_scenario_lander_vel = glm::dvec3(0.0);
 	guistate.physics_updates_per_frame = 1;
+	guistate.timestep_multiplier = 1;
 	guistate.lock_manual_controls = false;
 	guistate.autopilot_active = false;
 
@@ -71,9 +76,14 @@ void render_gui() {
 
 	if (guistate.show_mainmenu_window) draw_mainmenu_window();
 	if (guistate.show_help_window) draw_help_window();
+
+	// These windows read and modify the simulation directly (the draw data is rendered after unlocking)
+	sim_thread->lock();
 	if (guistate.show_sim_window) draw_sim_window();
 	if (guistate.show_lander_window) draw_lander_window();
 	if (guistate.show_autopilot_window) draw_autopilot_window();
+	sim_thread->unlock();
+
 	if (guistate.show_debug_window) draw_debug_window();
 
 	static unsigned int counter = 0;
@@ -195,19 +205,27 @@ static void draw_sim_window() {
 	ImGui::Text("Simulation timestep: %.1f ms", 1000 * guistate.sim_timestep);
 	ImGui::Text("Simulation time: %.2f s", guistate.sim_time);
 
-	static float ratio = guistate.sim_timestep / guistate.frame_duration;
-	if (guistate.should_update_indicators) ratio = guistate.sim_timestep / guistate.frame_duration;
-	ImGui::Text("Simulation speed vs. real time: %.2fx", ratio * guistate.physics_updates_per_frame);
+	static float speed = guistate.sim_speed;
+	if (guistate.should_update_indicators) speed = guistate.sim_speed;
+	ImGui::Text("Simulation speed vs. real time: %.2fx", speed);
 
 	ImGui::Text("Simulation state:");
 	ImGui::SameLine();
-	if (simstate.crashed) {
+	if (sim->state.crashed) {
 		ImGui::Text("CRASHED");
-	} else if (simstate.landed) {
+	} else if (sim->state.landed) {
 		ImGui::Text("LANDED");
 	} else {
 		ImGui::Text("NOT LANDED");
 	}
+	if (sim->state.on_rails) {
+		ImGui::SameLine();
+		ImGui::Text("(coasting, propagated analytically)");
+	}
+	if (!sim->event_log.empty()) {
+		const EventRecord& event = sim->event_log.back();
+		ImGui::Text("Last event: %s at %.3f s", event_name(event.type), event.time);
+	}
 
 	ImGui::Separator();
 
@@ -220,7 +238,7 @@ static void draw_sim_window() {
 	ImGui::SetColumnOffset(4, 590);
 	ImGui::Text("Physics updates per frame:");
 	ImGui::NextColumn();
-	if (simstate.paused) {
+	if (sim->state.paused) {
 		ImGui::Text("%.2f (PAUSED)", guistate.physics_updates_per_frame);
 	} else {
 		ImGui::Text("%.2f", guistate.physics_updates_per_frame);
@@ -235,7 +253,7 @@ static void draw_sim_window() {
 	}
 	ImGui::NextColumn();
 	if (ImGui::Button("II")) {
-		simstate.paused = !simstate.paused;
+		sim->state.paused = !sim->state.paused;
 	}
 	ImGui::NextColumn();
 	if (ImGui::Button(">>")) {
@@ -249,6 +267,110 @@ static void draw_sim_window() {
 
 	ImGui::Separator();
 
+	ImGui::Columns(2, "simulation_integrator", false);
+	ImGui::SetColumnOffset(1, 200);
+	ImGui::Text("Lander integrator:");
+	ImGui::NextColumn();
+	ImGui::RadioButton("Verlet", &sim->state.integrator, INTEGRATOR_VERLET);
+	ImGui::SameLine();
+	ImGui::RadioButton("Dormand-Prince 5(4)", &sim->state.integrator, INTEGRATOR_DOPRI5);
+	ImGui::SameLine();
+	ImGui::RadioButton("Yoshida 4", &sim->state.integrator, INTEGRATOR_YOSHIDA4);
+	ImGui::SameLine();
+	ImGui::RadioButton("Yoshida 6", &sim->state.integrator, INTEGRATOR_YOSHIDA6);
+	ImGui::NextColumn();
+
+	if (sim->state.integrator == INTEGRATOR_DOPRI5) {
+		ImGui::NextColumn();
+		ImGui::Text("%ld steps (%ld rejected)", sim->lander_dopri5.steps, sim->lander_dopri5.rejected_steps);
+		ImGui::NextColumn();
+	}
+
+	// Larger timesteps are meant for time-warping orbits (Yoshida integrators keep the orbit energy)
+	ImGui::Text("Timestep multiplier:");
+	ImGui::NextColumn();
+	ImGui::RadioButton("x1", &guistate.timestep_multiplier, 1);
+	ImGui::SameLine();
+	ImGui::RadioButton("x10", &guistate.timestep_multiplier, 10);
+	ImGui::SameLine();
+	ImGui::RadioButton("x100", &guistate.timestep_multiplier, 100);
+	ImGui::NextColumn();
+	ImGui::Columns(1);
+
+	ImGui::Separator();
+
+	// Flight recording (restarted with every scenario), can be replayed with lander-headless -R
+	static char recording_path[128] = "flight.rec";
+	ImGui::Text("Recording: %ld steps, %lu input changes. Save to $PWD/", sim->recording.steps, sim->recording.records.size());
+	ImGui::SameLine();
+	ImGui::PushItemWidth(150);
+	ImGui::InputText("##recording_path", recording_path, IM_ARRAYSIZE(recording_path));
+	ImGui::PopItemWidth();
+	ImGui::SameLine();
+	if (ImGui::Button("Save")) save_recording(sim, recording_path);
+
+	// In-memory checkpoint to return to, e.g. to try another approach from the same point
+	static std::vector<char> checkpoint;
+	static double checkpoint_time = 0.0;
+	if (ImGui::Button("Save state")) {
+		checkpoint = save_checkpoint(sim);
+		checkpoint_time = sim->state.time;
+	}
+	ImGui::SameLine();
+	if (checkpoint.empty()) {
+		ImGui::Text("No state saved");
+	} else {
+		double base_timestep = sim->state.timestep / guistate.timestep_multiplier;
+
+		if (ImGui::Button("Restore state") && restore_checkpoint(sim, checkpoint.data(), checkpoint.size())) {
+			// Otherwise the next frame would apply the current settings again
+			guistate.timestep_multiplier = glm::max(1, (int)glm::round(sim->state.timestep / base_timestep));
+			guistate.autopilot_active = sim->state.autopilot_active;
+			clear_rewind_buffer(&sim->rewind); // history of another flight
+			sim_thread->reset_interpolation();
+		}
+		ImGui::SameLine();
+		ImGui::Text("(%.2f s, %.1f KiB)", checkpoint_time, checkpoint.size() / 1024.0);
+	}
+
+	// Rewind: the slider follows the simulation time until it's dragged back, then the simulation
+	// is rebuilt up to the chosen time (from the keyframe before it) when it's released
+	static float rewind_time = 0.0f;
+	static bool rewind_dragging = false;
+	const double rewind_start = rewind_start_time(sim);
+	ImGui::Text("Rewind:");
+	ImGui::SameLine();
+	if (rewind_start < 0.0 || rewind_start >= sim->state.time) {
+		ImGui::Text("no history yet");
+		rewind_dragging = false;
+	} else {
+		ImGui::PushItemWidth(300);
+		if (!rewind_dragging) rewind_time = sim->state.time;
+		ImGui::SliderFloat("##rewind_time", &rewind_time, rewind_start, sim->state.time, "%.2f s");
+		ImGui::PopItemWidth();
+		rewind_dragging = ImGui::IsItemActive();
+
+		if (ImGui::IsItemDeactivatedAfterEdit() && rewind_time < sim->state.time) {
+			double base_timestep = sim->state.timestep / guistate.timestep_multiplier;
+
+			if (rewind_to(sim, rewind_time)) {
+				guistate.timestep_multiplier = glm::max(1, (int)glm::round(sim->state.timestep / base_timestep));
+				guistate.autopilot_active = sim->state.autopilot_active;
+				sim_thread->reset_interpolation();
+			}
+		}
+	}
+
+	static int rewind_memory = sim->rewind.max_bytes >> 20;
+	ImGui::SameLine();
+	ImGui::PushItemWidth(120);
+	if (ImGui::SliderInt("MiB history##rewind_memory", &rewind_memory, 1, 1024)) sim->rewind.max_bytes = (size_t)rewind_memory << 20;
+	ImGui::PopItemWidth();
+	ImGui::SameLine();
+	ImGui::Text("(%lu keyframes)", sim->rewind.keyframes.size());
+
+	ImGui::Separator();
+
 	ImGui::Text("Select scenario:");
 
 	static int combo_selection = 0;
@@ -331,13 +453,13 @@ static void draw_lander_window() {
 
 	ImGui::Text("Throttle");
 	ImGui::NextColumn();
-	ImGui::ProgressBar(lander->attribute["me_throttle"], ImVec2(-1.0, 0.0));
+	ImGui::ProgressBar(sim->lander->state.me_throttle, ImVec2(-1.0, 0.0));
 	ImGui::NextColumn();
 
 	ImGui::Text("Delta-V");
 	ImGui::NextColumn();
-	double delta_v = lander_delta_v(lander);
-	double delta_v_fraction = delta_v / lander_max_delta_v(lander);
+	double delta_v = lander_delta_v(sim->lander);
+	double delta_v_fraction = delta_v / lander_max_delta_v(sim->lander);
 	std::string delta_v_str = std::to_string(int(delta_v * 1000)) + " m/s";
 	ImGui::ProgressBar(delta_v_fraction, ImVec2(-1.0, 0.0), delta_v_str.c_str());
 	ImGui::NextColumn();
@@ -346,29 +468,29 @@ static void draw_lander_window() {
 
 	ImGui::Text("Altitude:");
 	ImGui::NextColumn();
-	ImGui::Text("%.2f m", 1000 * (glm::length(lander->position - mars->position) - MARS_RADIUS - mars_surface_height(mars, lander->position - mars->position) - BASE_COM_DIST));
+	ImGui::Text("%.2f m", 1000 * (glm::length(sim->lander->position - sim->mars->position) - MARS_RADIUS - mars_surface_height(sim->mars, &sim->env, &sim->terrain, TERRAIN_PHYSICS_LEVEL, sim->lander->position - sim->mars->position) - BASE_COM_DIST));
 	ImGui::NextColumn();
 
 	ImGui::Text("Velocity:");
 	ImGui::NextColumn();
-	ImGui::Text("%.2f m/s", 1000 * glm::length(lander->velocity));
+	ImGui::Text("%.2f m/s", 1000 * glm::length(sim->lander->velocity));
 	ImGui::NextColumn();
 
 	ImGui::Text("Surf. velocity:");
 	ImGui::NextColumn();
-	ImGui::Text("%.2f m/s", 1000 * glm::length(lander->velocity - mars_surface_velocity(mars, lander->position)));
+	ImGui::Text("%.2f m/s", 1000 * glm::length(sim->lander->velocity - mars_surface_velocity(sim->mars, sim->lander->position)));
 	ImGui::NextColumn();
 
 	ImGui::Text("Mass:");
 	ImGui::NextColumn();
-	ImGui::Text("%.2f kg", lander->mass);
+	ImGui::Text("%.2f kg", sim->lander->mass);
 	ImGui::NextColumn();
 
 	ImGui::Text("Parachute:");
 	ImGui::NextColumn();
-	if (lander->attribute["parachute_status"] == 0.0) {
+	if (sim->lander->state.parachute_status == 0.0) {
 		ImGui::Text("NOT DEPLOYED");
-	} else if (lander->attribute["parachute_status"] == 1.0) {
+	} else if (sim->lander->state.parachute_status == 1.0) {
 		ImGui::Text("DEPLOYED");
 	} else {
 		ImGui::Text("LOST");
@@ -384,15 +506,20 @@ static void draw_lander_window() {
 
 		ImGui::Text("Periapsis alt.:");
 		ImGui::NextColumn();
-		ImGui::Text("%.2f m", 1000 * periapsis_radius(mars, lander) - 1000 * MARS_RADIUS);
+		ImGui::Text("%.2f m", 1000 * periapsis_radius(sim->mars, sim->lander) - 1000 * MARS_RADIUS);
 		ImGui::NextColumn();
 
 		ImGui::Text("Apoapsis alt.:");
 		ImGui::NextColumn();
-		ImGui::Text("%.2f m", 1000 * apoapsis_radius(mars, lander) - 1000 * MARS_RADIUS);
+		ImGui::Text("%.2f m", 1000 * apoapsis_radius(sim->mars, sim->lander) - 1000 * MARS_RADIUS);
 		ImGui::NextColumn();
 
 		ImGui::Columns(1);
+
+		// Drawn in the orbit view
+		if (ImGui::Button("Pin orbit")) pin_current_orbit();
+		ImGui::SameLine();
+		if (ImGui::Button("Clear pinned orbits")) clear_pinned_orbits();
 	}
 
 	// LANDING INFO
@@ -402,12 +529,21 @@ static void draw_lander_window() {
 
 		ImGui::Text("Descent rate:");
 		ImGui::NextColumn();
-		ImGui::Text("%.2f m/s", 1000 * descent_rate(lander, mars));
+		ImGui::Text("%.2f m/s", 1000 * descent_rate(sim->lander, sim->mars));
 		ImGui::NextColumn();
 
 		ImGui::Text("Groundspeed:");
 		ImGui::NextColumn();
-		ImGui::Text("%.2f m/s", 1000 * groundspeed(lander, mars));
+		ImGui::Text("%.2f m/s", 1000 * groundspeed(sim->lander, sim->mars));
+		ImGui::NextColumn();
+
+		const TrajectoryPrediction& prediction = trajectory_predictor->prediction;
+		ImGui::Text("Impact in:");
+		ImGui::NextColumn();
+		if (prediction.impact)
+			ImGui::Text("%.1f s (coasting)", prediction.impact_time - sim->state.time);
+		else
+			ImGui::Text("%s", prediction.complete ? "NONE (coasting)" : "NOT FOUND YET");
 		ImGui::NextColumn();
 
 		ImGui::Columns(1);
@@ -420,33 +556,33 @@ static void draw_lander_window() {
 
 		ImGui::Text("Position:");
 		ImGui::NextColumn();
-		ImGui::Text("%.2f m", 1000 * glm::length(lander->position));
+		ImGui::Text("%.2f m", 1000 * glm::length(sim->lander->position));
 		ImGui::NextColumn();
-		ImGui::Text("(%.1f m, %.1f m, %.1f m)", 1000 * lander->position.x, 1000 * lander->position.y, 1000 * lander->position.z);
+		ImGui::Text("(%.1f m, %.1f m, %.1f m)", 1000 * sim->lander->position.x, 1000 * sim->lander->position.y, 1000 * sim->lander->position.z);
 		ImGui::NextColumn();
 
 		ImGui::Text("Velocity:");
 		ImGui::NextColumn();
-		ImGui::Text("%.2f m/s", 1000 * glm::length(lander->velocity));
+		ImGui::Text("%.2f m/s", 1000 * glm::length(sim->lander->velocity));
 		ImGui::NextColumn();
-		ImGui::Text("(%.1f m/s, %.1f m/s, %.1f m/s)", 1000 * lander->velocity.x, 1000 * lander->velocity.y, 1000 * lander->velocity.z);
+		ImGui::Text("(%.1f m/s, %.1f m/s, %.1f m/s)", 1000 * sim->lander->velocity.x, 1000 * sim->lander->velocity.y, 1000 * sim->lander->velocity.z);
 		ImGui::NextColumn();
 
 		ImGui::Text("Acceleration:");
 		ImGui::NextColumn();
-		ImGui::Text("%.2f m/s^2", 1000 * glm::length(lander->acceleration));
+		ImGui::Text("%.2f m/s^2", 1000 * glm::length(sim->lander->acceleration));
 		ImGui::NextColumn();
-		ImGui::Text("(%.1f m/s^2, %.1f m/s^2, %.1f m/s^2)", 1000 * lander->acceleration.x, 1000 * lander->acceleration.y, 1000 * lander->acceleration.z);
+		ImGui::Text("(%.1f m/s^2, %.1f m/s^2, %.1f m/s^2)", 1000 * sim->lander->acceleration.x, 1000 * sim->lander->acceleration.y, 1000 * sim->lander->acceleration.z);
 		ImGui::NextColumn();
 
 		ImGui::Text("Net force:");
 		ImGui::NextColumn();
-		ImGui::Text("%.2f N", 1000 * glm::length(lander->net_force));
+		ImGui::Text("%.2f N", 1000 * glm::length(sim->lander->net_force));
 		ImGui::NextColumn();
-		ImGui::Text("(%.1f N, %.1f N, %.1f N)", 1000 * lander->net_force.x, 1000 * lander->net_force.y, 1000 * lander->net_force.z);
+		ImGui::Text("(%.1f N, %.1f N, %.1f N)", 1000 * sim->lander->net_force.x, 1000 * sim->lander->net_force.y, 1000 * sim->lander->net_force.z);
 		ImGui::NextColumn();
 
-		glm::vec3 heading = lander->attitude_matrix * glm::vec3(0.0, 1.0, 0.0);
+		glm::vec3 heading = sim->lander->attitude_matrix * glm::vec3(0.0, 1.0, 0.0);
 		ImGui::Text("Lander heading");
 		ImGui::NextColumn();
 		ImGui::NextColumn();
@@ -455,35 +591,49 @@ static void draw_lander_window() {
 
 		ImGui::Text("Angular vel.:");
 		ImGui::NextColumn();
-		ImGui::Text("%.2f rad/s", glm::length(lander->ang_velocity));
+		ImGui::Text("%.2f rad/s", glm::length(sim->lander->ang_velocity));
 		ImGui::NextColumn();
-		ImGui::Text("(%.1f rad/s, %.1f rad/s, %.1f rad/s)", lander->ang_velocity.x, lander->ang_velocity.y, lander->ang_velocity.z);
+		ImGui::Text("(%.1f rad/s, %.1f rad/s, %.1f rad/s)", sim->lander->ang_velocity.x, sim->lander->ang_velocity.y, sim->lander->ang_velocity.z);
 		ImGui::NextColumn();
 
 		ImGui::Text("Angular accel.:");
 		ImGui::NextColumn();
-		ImGui::Text("%.2f rad/s^2", glm::length(lander->ang_acceleration));
+		ImGui::Text("%.2f rad/s^2", glm::length(sim->lander->ang_acceleration));
 		ImGui::NextColumn();
-		ImGui::Text("(%.1f rad/s^2, %.1f rad/s^2, %.1f rad/s^2)", lander->ang_acceleration.x, lander->ang_acceleration.y, lander->ang_acceleration.z);
+		ImGui::Text("(%.1f rad/s^2, %.1f rad/s^2, %.1f rad/s^2)", sim->lander->ang_acceleration.x, sim->lander->ang_acceleration.y, sim->lander->ang_acceleration.z);
 		ImGui::NextColumn();
 
 		ImGui::Text("Net moment:");
 		ImGui::NextColumn();
-		ImGui::Text("%.2f Nm", 1000 * glm::length(lander->net_moment));
+		ImGui::Text("%.2f Nm", 1000 * glm::length(sim->lander->net_moment));
 		ImGui::NextColumn();
-		ImGui::Text("(%.1f Nm, %.1f Nm, %.1f Nm)", 1000 * lander->net_moment.x, 1000 * lander->net_moment.y, 1000 * lander->net_moment.z);
+		ImGui::Text("(%.1f Nm, %.1f Nm, %.1f Nm)", 1000 * sim->lander->net_moment.x, 1000 * sim->lander->net_moment.y, 1000 * sim->lander->net_moment.z);
 		ImGui::NextColumn();
 
 		ImGui::Columns(1);
 	}
 
+	if (ImGui::CollapsingHeader("Lander state", ImGuiTreeNodeFlags_None)) {
+		ImGui::Columns(2, "lander_state", false);
+		ImGui::SetColumnOffset(1, 130);
+
+		for (int i = 0; i < lander_state_field_count; i++) {
+			ImGui::Text("%s", lander_state_fields[i].name);
+			ImGui::NextColumn();
+			ImGui::Text("%.6g", *lander_state_field(&sim->lander->state, lander_state_fields[i].name));
+			ImGui::NextColumn();
+		}
+
+		ImGui::Columns(1);
+	}
+
 	if (ImGui::CollapsingHeader("Mars", ImGuiTreeNodeFlags_None)) {
 		ImGui::Columns(2, "lander_mars", false);
 		ImGui::SetColumnOffset(1, 130);
 
 		ImGui::Text("Atm. density:");
 		ImGui::NextColumn();
-		ImGui::Text("%.6f kg/m^3", 1e-9 * mars_atm_density(mars, lander->position));
+		ImGui::Text("%.6f kg/m^3", 1e-9 * mars_atm_density(sim->mars, sim->lander->position));
 		ImGui::NextColumn();
 
 		ImGui::Columns(1);
@@ -515,19 +665,22 @@ static void draw_autopilot_window() {
 	ImGui::SameLine();
 	ImGui::InputText("", program_path, IM_ARRAYSIZE(program_path));
 	ImGui::NextColumn();
-	if (ImGui::Button("Load")) guistate.ap = make_autopilot_program(program_path);
+	if (ImGui::Button("Load")) {
+		free_autopilot_program(&sim->ap);
+		sim->ap = make_autopilot_program(sim, program_path);
+	}
 	ImGui::NextColumn();
 
 	ImGui::Columns(1);
 
 	ImGui::Separator();
 
-	if (guistate.ap.loaded) {
-		ImGui::Text("Loaded program: $PWD/%s", guistate.ap.path.c_str());
+	if (sim->ap.loaded) {
+		ImGui::Text("Loaded program: $PWD/%s", sim->ap.path.c_str());
 	} else {
 		ImGui::Text("Loaded program: none");
 	}
-	if (ImGui::Button("Clear log")) guistate.autopilot_message_log.clear();
+	if (ImGui::Button("Clear log")) sim->autopilot_message_log.clear();
 	ImGui::SameLine();
 	ImGui::Checkbox("Autopilot active", &guistate.autopilot_active);
 	ImGui::SameLine();
@@ -538,8 +691,8 @@ static void draw_autopilot_window() {
 	// Message log
 	ImGui::BeginChild("message_log", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
 
-	for (unsigned int i = 0; i < guistate.autopilot_message_log.size(); i++)
-		ImGui::Text("%s", guistate.autopilot_message_log[guistate.autopilot_message_log.size() - i - 1].c_str());
+	for (unsigned int i = 0; i < sim->autopilot_message_log.size(); i++)
+		ImGui::Text("%s", sim->autopilot_message_log[sim->autopilot_message_log.size() - i - 1].c_str());
 
 	ImGui::EndChild();
 	ImGui::Separator();
@@ -624,6 +777,13 @@ static void draw_debug_window() {
 	ImGui::Text("%.1f %%", 100 * shown_fc_duration / shown_frame_duration);
 	ImGui::NextColumn();
 
+	ImGui::Columns(1);
+	ImGui::Separator();
+
+	static float shown_sim_busy_time = guistate.sim_busy_time;
+	if (guistate.should_update_indicators) shown_sim_busy_time = guistate.sim_busy_time;
+	ImGui::Text("Simulation thread: %.2f ms per tick stepping", shown_sim_busy_time * 1000);
+
 	ImGui::End();
 }
 
@@ -3,7 +3,6 @@
 #define GUI_H
 
 #include "core/object.h"
-#include "autopilot.h"
 #include <vector>
 #include <string>
 
@@ -26,7 +25,7 @@ extern struct GUIState {
 	// ==== Inputs to UI ====
 	float frame_duration, render_duration, sim_duration, fc_duration, other_duration; // Frame timings
 	float sim_time, sim_timestep; // Simulation params
-	std::vector<std::string> autopilot_message_log;
+	float sim_busy_time, sim_speed; // Simulation thread: time spent stepping per tick, sim seconds per real second
 
 	// ==== Outputs from UI ====
 	int selected_scene;
@@ -34,9 +33,9 @@ extern struct GUIState {
 	bool scenario_changed;
 	glm::dvec3 custom_scenario_lander_pos;
 	glm::dvec3 custom_scenario_lander_vel;
-	AutopilotProgram ap;
 	bool lock_manual_controls;
 	bool autopilot_active;
+	int timestep_multiplier; // simulation timestep in frames
 
 	// ==== Inputs/outputs ====
 	float physics_updates_per_frame;
@@ -0,0 +1,441 @@
+// Ricardas Navickas 2020
+// Headless simulation runner: same physics as the GUI, no window/OpenGL, runs at full CPU speed
+//
+// Usage: lander-headless [-s scenario] [-a autopilot.lua] [-d duration] [-t timestep] [-i integrator] [-r seed] [-w recording]
+//                        [-K checkpoint] [-k checkpoint]
+//                        [-n runs [-j threads] [-r seed] [-p pos_sigma] [-v vel_sigma] [-f fuel_sigma] [-x exhaust_sigma]]
+//        lander-headless -R recording
+//        lander-headless -T [-s scenario] [-a autopilot.lua] [-d duration] [-t timestep] [-i integrator] [-r seed]
+//   -s  scenario id (see set_scenario()), default 1
+//   -a  path to autopilot program (run every step), default none
+//   -d  simulated duration in seconds (from the start or the checkpoint), default 3600
+//   -t  physics timestep in seconds, default 1/60
+//   -i  lander integrator: verlet (fixed step), dopri5 (adaptive Dormand-Prince 5(4)),
+//       yoshida4 or yoshida6 (symplectic, for long orbits with large timesteps), default verlet
+//   -r  terrain & wind seed, default 1
+//   -w  save the flight to a recording file (see recording.h)
+//   -K  start from a checkpoint (see checkpoint.h) instead of a scenario; -s, -t, -i and -r are ignored,
+//       the checkpoint's autopilot program carries on unless -a loads another one
+//   -k  save a checkpoint at the end of the run
+// The run stops early if the simulation pauses (landing, second impact after a crash or PAUSE() in Lua).
+// Several runs from one checkpoint (e.g. with different autopilot programs) are what-if branches
+// of the same flight.
+//
+// With -R the runner replays a recording (saved by -w or from the GUI) as fast as possible and
+// checks that it ends in exactly the recorded state (exit code 3 if it doesn't).
+//
+// With -T the runner flies the same flight at the given timestep and at a tenth of it, and checks
+// that the first surface contact time (within TIMESTEP_CHECK_TIME_TOL and a tenth of a step) and the touchdown
+// speed (within TIMESTEP_CHECK_SPEED_TOL of the finer run's) agree (exit code 3 if they don't).
+//
+// With -n the runner does a Monte Carlo campaign of that many runs with dispersed initial conditions
+// (see campaign.h) and prints one line per run followed by a summary:
+//   -j  worker threads, default one per hardware thread
+//   -r  campaign seed, default 1
+//   -p  position dispersion (m, per axis), default 100
+//   -v  velocity dispersion (m/s, per axis), default 1
+//   -f  fuel level dispersion (fraction of full tank), default 0.05
+//   -x  main engine exhaust velocity dispersion (fraction of nominal), default 0.01
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <unistd.h>
+
+#include "../core/error.h"
+#include "../simulation.h"
+#include "../autopilot.h"
+#include "../lander.h"
+#include "../mars.h"
+#include "../campaign.h"
+#include "../checkpoint.h"
+
+#define DEFAULT_SCENARIO 1
+#define DEFAULT_DURATION 3600.0
+#define DEFAULT_TIMESTEP (1.0 / 60.0)
+
+#define TIMESTEP_CHECK_TIME_TOL 0.01   // s, plus a tenth of the timestep
+#define TIMESTEP_CHECK_SPEED_TOL 0.005 // fraction
+
+static void print_usage(const char* argv0);
+static void print_new_autopilot_messages(SimulationContext* ctx);
+static void print_new_events(SimulationContext* ctx);
+static void print_results(SimulationContext* ctx, long steps, long on_rails_steps, long coasts, double wall_time);
+static int parse_integrator(std::string name);
+static int run_single(const CampaignConfig& cfg, std::string recording_path, std::string start_checkpoint_path, std::string end_checkpoint_path);
+static int run_replay(std::string recording_path);
+static int run_timestep_check(const CampaignConfig& cfg);
+static bool fly_to_touchdown(const CampaignConfig& cfg, double timestep, double* contact_time, double* touchdown_speed);
+static int run_multiple(const CampaignConfig& cfg);
+
+int main(int argc, char** argv) {
+	// Single runs use the same settings as a campaign (without dispersions)
+	CampaignConfig cfg = default_campaign_config();
+	cfg.scenario_id = DEFAULT_SCENARIO;
+	cfg.duration = DEFAULT_DURATION;
+	cfg.timestep = DEFAULT_TIMESTEP;
+	cfg.runs = 0;
+
+	std::string recording_path = "";
+	std::string replay_path = "";
+	std::string start_checkpoint_path = "";
+	std::string end_checkpoint_path = "";
+	bool timestep_check = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "s:a:d:t:i:w:R:K:k:n:j:r:p:v:f:x:Th")) != -1) {
+		switch (opt) {
+		case 's':
+			cfg.scenario_id = atoi(optarg);
+			break;
+		case 'a':
+			cfg.autopilot_path = optarg;
+			break;
+		case 'd':
+			cfg.duration = atof(optarg);
+			break;
+		case 't':
+			cfg.timestep = atof(optarg);
+			break;
+		case 'i':
+			cfg.integrator = parse_integrator(optarg);
+			if (cfg.integrator < 0) {
+				print_usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'w':
+			recording_path = optarg;
+			break;
+		case 'R':
+			replay_path = optarg;
+			break;
+		case 'K':
+			start_checkpoint_path = optarg;
+			break;
+		case 'k':
+			end_checkpoint_path = optarg;
+			break;
+		case 'T':
+			timestep_check = true;
+			break;
+		case 'n':
+			cfg.runs = atoi(optarg);
+			break;
+		case 'j':
+			cfg.threads = atoi(optarg);
+			break;
+		case 'r':
+			cfg.seed = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			cfg.position_sigma = atof(optarg) / 1000;
+			break;
+		case 'v':
+			cfg.velocity_sigma = atof(optarg) / 1000;
+			break;
+		case 'f':
+			cfg.fuel_level_sigma = atof(optarg);
+			break;
+		case 'x':
+			cfg.exhaust_vel_sigma = atof(optarg);
+			break;
+		default:
+			print_usage(argv[0]);
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	if (cfg.timestep <= 0.0 || cfg.duration < 0.0 || cfg.runs < 0) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	if (replay_path != "") return run_replay(replay_path);
+	if (timestep_check) return run_timestep_check(cfg);
+	if (cfg.runs > 0) return run_multiple(cfg);
+	return run_single(cfg, recording_path, start_checkpoint_path, end_checkpoint_path);
+}
+
+static int run_single(const CampaignConfig& cfg, std::string recording_path, std::string start_checkpoint_path, std::string end_checkpoint_path) {
+	SimulationContext* ctx;
+
+	if (start_checkpoint_path != "") {
+		ctx = new SimulationContext(cfg.timestep, cfg.seed, cfg.seed); // (all replaced by the checkpoint)
+		auto restore_begin = std::chrono::steady_clock::now();
+		if (!restore_checkpoint_file(ctx, start_checkpoint_path)) {
+			delete ctx;
+			return 1;
+		}
+		std::chrono::duration<double> restore_time = std::chrono::steady_clock::now() - restore_begin;
+
+		print_new_autopilot_messages(ctx);
+		printf("checkpoint:    %.3f s restored in %.1f us\n", ctx->state.time, 1e6 * restore_time.count());
+	} else {
+		ctx = new SimulationContext(cfg.timestep, cfg.seed, cfg.seed);
+		ctx->state.integrator = cfg.integrator;
+		set_scenario(ctx, cfg.scenario_id);
+	}
+
+	if (cfg.autopilot_path != "") {
+		free_autopilot_program(&ctx->ap);
+		ctx->ap = make_autopilot_program(ctx, cfg.autopilot_path);
+		print_new_autopilot_messages(ctx);
+		if (!ctx->ap.loaded) fatal("run_single()", "Failed to load autopilot program " + cfg.autopilot_path);
+
+		ctx->state.autopilot_active = true;
+	}
+
+	// Nothing steers the lander between our inputs, so unattended coasts can be skipped to their events
+	ctx->state.coast_to_events = true;
+
+	auto begin_time = std::chrono::steady_clock::now();
+	long steps = 0;
+	long on_rails_steps = 0;
+	long coasts = 0;
+	double end_time = ctx->state.time + cfg.duration;
+
+	while (ctx->state.time < end_time && !ctx->state.paused) {
+		const long remaining = (long)std::ceil((end_time - ctx->state.time) / ctx->state.timestep);
+		long coasted = simulation_coast(ctx, remaining);
+
+		if (coasted > 0) {
+			steps += coasted;
+			on_rails_steps += coasted;
+			coasts++;
+			print_new_events(ctx);
+
+			// Exactly as many steps as the replay will take (time may be short of end_time by rounding)
+			if (coasted == remaining) break;
+			continue;
+		}
+
+		simulation_step(ctx);
+		steps++;
+		if (ctx->state.on_rails) on_rails_steps++;
+		print_new_autopilot_messages(ctx);
+		print_new_events(ctx);
+	}
+
+	std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - begin_time;
+	print_results(ctx, steps, on_rails_steps, coasts, wall_time.count());
+
+	int exit_code = ctx->state.crashed ? 2 : 0;
+	if (recording_path != "" && !save_recording(ctx, recording_path)) exit_code = 1;
+	if (end_checkpoint_path != "" && !save_checkpoint_file(ctx, end_checkpoint_path)) exit_code = 1;
+	delete ctx;
+
+	return exit_code;
+}
+
+static int run_replay(std::string recording_path) {
+	Recording rec;
+	if (!load_recording(&rec, recording_path)) return 1;
+
+	SimulationContext* ctx = make_replay_context(rec);
+
+	auto begin_time = std::chrono::steady_clock::now();
+	long on_rails_steps = 0;
+	long coasts = 0;
+	unsigned int next_record = 0;
+
+	for (long step = 0; step < rec.steps; step++) {
+		apply_recorded_inputs(ctx, rec, step, &next_record);
+
+		// Coasts never reach past the next change of inputs
+		const long next_change = (next_record < rec.records.size()) ? rec.records[next_record].step : rec.steps;
+		long coasted = simulation_coast(ctx, next_change - step);
+		if (coasted > 0) {
+			step += coasted - 1;
+			on_rails_steps += coasted;
+			coasts++;
+			print_new_events(ctx);
+			continue;
+		}
+
+		simulation_step(ctx);
+		if (ctx->state.on_rails) on_rails_steps++;
+		print_new_autopilot_messages(ctx);
+		print_new_events(ctx);
+	}
+
+	std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - begin_time;
+	print_results(ctx, rec.steps, on_rails_steps, coasts, wall_time.count());
+
+	bool matches = replay_matches(ctx, rec);
+	printf("replay:        %s (%lu input changes)\n", matches ? "bit-exact" : "DIVERGED from recording", rec.records.size());
+
+	int exit_code = matches ? 0 : 3;
+	delete ctx;
+
+	return exit_code;
+}
+
+static int run_timestep_check(const CampaignConfig& cfg) {
+	const double fine_timestep = cfg.timestep / 10;
+	double contact_time, touchdown_speed, fine_contact_time, fine_touchdown_speed;
+
+	if (!fly_to_touchdown(cfg, cfg.timestep, &contact_time, &touchdown_speed) ||
+		!fly_to_touchdown(cfg, fine_timestep, &fine_contact_time, &fine_touchdown_speed)) {
+		error("run_timestep_check()", "The lander did not touch down within the duration");
+		return 1;
+	}
+
+	printf("timestep:      %.6f s / %.6f s\n", cfg.timestep, fine_timestep);
+	printf("contact time:  %.6f s / %.6f s\n", contact_time, fine_contact_time);
+	printf("touchdown:     %.3f m/s / %.3f m/s\n", 1000 * touchdown_speed, 1000 * fine_touchdown_speed);
+
+	bool time_ok = std::abs(contact_time - fine_contact_time) <= TIMESTEP_CHECK_TIME_TOL + 0.1 * cfg.timestep;
+	bool speed_ok = std::abs(touchdown_speed - fine_touchdown_speed) <= TIMESTEP_CHECK_SPEED_TOL * fine_touchdown_speed;
+	printf("check:         %s\n", (time_ok && speed_ok) ? "within tolerance" : "OUT OF TOLERANCE");
+
+	return (time_ok && speed_ok) ? 0 : 3;
+}
+
+// Flies a single run silently, returns false if the lander never touched down
+static bool fly_to_touchdown(const CampaignConfig& cfg, double timestep, double* contact_time, double* touchdown_speed) {
+	SimulationContext* ctx = new SimulationContext(timestep, cfg.seed, cfg.seed);
+	ctx->state.integrator = cfg.integrator;
+	set_scenario(ctx, cfg.scenario_id);
+
+	if (cfg.autopilot_path != "") {
+		ctx->ap = make_autopilot_program(ctx, cfg.autopilot_path);
+		if (!ctx->ap.loaded) fatal("fly_to_touchdown()", "Failed to load autopilot program " + cfg.autopilot_path);
+		ctx->state.autopilot_active = true;
+	}
+
+	*contact_time = -1.0;
+	while (ctx->state.time < cfg.duration && ctx->state.touchdown_speed < 0.0 && !ctx->state.paused) {
+		simulation_step(ctx);
+	}
+
+	for (unsigned int i = 0; i < ctx->event_log.size(); i++) {
+		if (ctx->event_log[i].type == EVENT_SURFACE_CONTACT) {
+			*contact_time = ctx->event_log[i].time;
+			break;
+		}
+	}
+	*touchdown_speed = ctx->state.touchdown_speed;
+
+	delete ctx;
+	return *contact_time >= 0.0 && *touchdown_speed >= 0.0;
+}
+
+static int run_multiple(const CampaignConfig& cfg) {
+	if (cfg.autopilot_path != "") {
+		// Load once up front so a broken script fails the campaign instead of every run
+		SimulationContext* ctx = new SimulationContext(cfg.timestep, cfg.scenario_id);
+		ctx->ap = make_autopilot_program(ctx, cfg.autopilot_path);
+		print_new_autopilot_messages(ctx);
+		if (!ctx->ap.loaded) fatal("run_multiple()", "Failed to load autopilot program " + cfg.autopilot_path);
+		delete ctx;
+	}
+
+	auto begin_time = std::chrono::steady_clock::now();
+	std::vector<CampaignRunResult> results = run_campaign(cfg);
+	std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - begin_time;
+
+	int landed = 0, crashed = 0, autopilot_failed = 0, touchdowns = 0;
+	double fuel_sum = 0.0, touchdown_speed_sum = 0.0, touchdown_speed_max = 0.0, sim_time = 0.0;
+
+	printf("run,wind_seed,status,time_s,fuel_level,touchdown_speed_mps\n");
+	for (unsigned int i = 0; i < results.size(); i++) {
+		const CampaignRunResult& r = results[i];
+		const char* status = r.crashed ? "CRASHED" : (r.landed ? "LANDED" : "NOT_LANDED");
+
+		printf("%d,%u,%s,%.3f,%.4f,%.3f\n", r.run, r.wind_seed, status, r.time, r.fuel_level, 1000 * r.touchdown_speed);
+
+		if (r.landed) {
+			landed++;
+			fuel_sum += r.fuel_level;
+		}
+		if (r.crashed) crashed++;
+		if (r.autopilot_failed) autopilot_failed++;
+		if (r.touchdown_speed >= 0.0) {
+			touchdowns++;
+			touchdown_speed_sum += r.touchdown_speed;
+			if (r.touchdown_speed > touchdown_speed_max) touchdown_speed_max = r.touchdown_speed;
+		}
+		sim_time += r.time;
+	}
+
+	int runs = results.size();
+	printf("\n");
+	printf("runs:              %d\n", runs);
+	printf("landed:            %d (%.2f%%)\n", landed, 100.0 * landed / runs);
+	printf("crashed:           %d (%.2f%%)\n", crashed, 100.0 * crashed / runs);
+	printf("not landed:        %d (%.2f%%)\n", runs - landed - crashed, 100.0 * (runs - landed - crashed) / runs);
+	if (autopilot_failed > 0) printf("autopilot errors:  %d\n", autopilot_failed);
+	if (landed > 0) printf("mean fuel left:    %.4f (landed runs)\n", fuel_sum / landed);
+	if (touchdowns > 0) {
+		printf("touchdown speed:   %.3f m/s mean, %.3f m/s max\n", 1000 * touchdown_speed_sum / touchdowns, 1000 * touchdown_speed_max);
+	}
+	printf("wall time:         %.3f s (%.1fx real time)\n", wall_time.count(), wall_time.count() > 0.0 ? sim_time / wall_time.count() : 0.0);
+
+	return 0;
+}
+
+// Returns INTEGRATOR_* or -1 if the name is not known
+static int parse_integrator(std::string name) {
+	if (name == "verlet") return INTEGRATOR_VERLET;
+	if (name == "dopri5") return INTEGRATOR_DOPRI5;
+	if (name == "yoshida4") return INTEGRATOR_YOSHIDA4;
+	if (name == "yoshida6") return INTEGRATOR_YOSHIDA6;
+	return -1;
+}
+
+static void print_usage(const char* argv0) {
+	std::cout << "Usage: " << argv0 << " [-s scenario] [-a autopilot.lua] [-d duration] [-t timestep] [-i verlet|dopri5|yoshida4|yoshida6] [-r seed] [-w recording] [-K checkpoint] [-k checkpoint]" << std::endl;
+	std::cout << "       " << argv0 << " -n runs [-j threads] [-r seed] [-p pos_sigma] [-v vel_sigma] [-f fuel_sigma] [-x exhaust_sigma] [...]" << std::endl;
+	std::cout << "       " << argv0 << " -R recording" << std::endl;
+	std::cout << "       " << argv0 << " -T [-s scenario] [-a autopilot.lua] [-d duration] [-t timestep] [-i integrator] [-r seed]" << std::endl;
+}
+
+static void print_new_autopilot_messages(SimulationContext* ctx) {
+	static unsigned int printed = 0;
+
+	for (; printed < ctx->autopilot_message_log.size(); printed++) {
+		std::cout << ctx->autopilot_message_log[printed] << std::endl;
+	}
+}
+
+static void print_new_events(SimulationContext* ctx) {
+	static unsigned int printed = 0;
+
+	for (; printed < ctx->event_log.size(); printed++) {
+		const EventRecord& event = ctx->event_log[printed];
+		double altitude = glm::length(event.position - ctx->mars->position) - MARS_RADIUS;
+		printf("[%.6f s] %s at %.3f km\n", event.time, event_name(event.type), altitude);
+	}
+}
+
+static void print_results(SimulationContext* ctx, long steps, long on_rails_steps, long coasts, double wall_time) {
+	const SimulationState& simstate = ctx->state;
+	Lander* lander = ctx->lander;
+	Object* mars = ctx->mars;
+
+	const char* status = simstate.crashed ? "CRASHED" : (simstate.landed ? "LANDED" : "NOT LANDED");
+	double altitude = glm::length(lander->position - mars->position) - MARS_RADIUS - mars_surface_height(mars, &ctx->env, &ctx->terrain, TERRAIN_PHYSICS_LEVEL, lander->position - mars->position) - BASE_COM_DIST;
+
+	printf("status:        %s\n", status);
+	printf("sim time:      %.3f s\n", simstate.time);
+	printf("altitude:      %.3f m\n", 1000 * altitude);
+	printf("descent rate:  %.3f m/s\n", 1000 * descent_rate(lander, mars));
+	printf("groundspeed:   %.3f m/s\n", 1000 * groundspeed(lander, mars));
+	printf("fuel level:    %.4f\n", lander->state.fuel_level);
+	if (simstate.touchdown_speed >= 0.0) printf("touchdown:     %.3f m/s\n", 1000 * simstate.touchdown_speed);
+	printf("steps:         %ld (%ld on rails, %ld coasted in one solve each)\n", steps, on_rails_steps, coasts);
+	if (simstate.integrator == INTEGRATOR_DOPRI5) {
+		const DormandPrinceIntegrator& integrator = ctx->lander_dopri5;
+		printf("integrator:    dopri5, %ld steps (%ld rejected), %ld force evaluations\n", integrator.steps, integrator.rejected_steps, integrator.evaluations);
+	} else if (simstate.integrator == INTEGRATOR_YOSHIDA4 || simstate.integrator == INTEGRATOR_YOSHIDA6) {
+		const YoshidaIntegrator& integrator = ctx->lander_yoshida;
+		printf("integrator:    yoshida%d, %ld steps, %ld force evaluations\n", integrator.order, integrator.steps, integrator.evaluations);
+	} else {
+		printf("integrator:    verlet, %ld steps, %ld force evaluations\n", steps - on_rails_steps, steps - on_rails_steps);
+	}
+	printf("wall time:     %.3f s (%.1fx real time)\n", wall_time, wall_time > 0.0 ? simstate.time / wall_time : 0.0);
+}
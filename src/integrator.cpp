@@ -0,0 +1,194 @@
+// Ricardas Navickas 2020
+#include "integrator.h"
+#include "core/state_blob.h"
+
+#include <cmath>
+#include <algorithm>
+
+// Dormand-Prince 5(4) Butcher tableau
+static const double C2 = 1.0 / 5, C3 = 3.0 / 10, C4 = 4.0 / 5, C5 = 8.0 / 9;
+static const double A21 = 1.0 / 5;
+static const double A31 = 3.0 / 40, A32 = 9.0 / 40;
+static const double A41 = 44.0 / 45, A42 = -56.0 / 15, A43 = 32.0 / 9;
+static const double A51 = 19372.0 / 6561, A52 = -25360.0 / 2187, A53 = 64448.0 / 6561, A54 = -212.0 / 729;
+static const double A61 = 9017.0 / 3168, A62 = -355.0 / 33, A63 = 46732.0 / 5247, A64 = 49.0 / 176, A65 = -5103.0 / 18656;
+static const double A71 = 35.0 / 384, A73 = 500.0 / 1113, A74 = 125.0 / 192, A75 = -2187.0 / 6784, A76 = 11.0 / 84;
+
+// Difference between the 5th order solution (= row 7) and the embedded 4th order one
+static const double E1 = 71.0 / 57600, E3 = -71.0 / 16695, E4 = 71.0 / 1920, E5 = -17253.0 / 339200, E6 = 22.0 / 525, E7 = -1.0 / 40;
+
+// Step size controller
+static const double SAFETY = 0.9;
+static const double MIN_SCALE = 0.2;
+static const double MAX_SCALE = 5.0;
+static const double MIN_STEP = 1e-9;
+
+// Yoshida composition coefficients (fractions of the step taken by each Verlet substep)
+static const double CBRT2 = 1.2599210498948732; // 2^(1/3)
+static const double YOSHIDA4[] = {
+	1.0 / (2.0 - CBRT2),
+	-CBRT2 / (2.0 - CBRT2),
+	1.0 / (2.0 - CBRT2)
+};
+static const double YOSHIDA6_W1 = -1.17767998417887;
+static const double YOSHIDA6_W2 = 0.235573213359357;
+static const double YOSHIDA6_W3 = 0.784513610477560;
+static const double YOSHIDA6[] = {
+	YOSHIDA6_W3, YOSHIDA6_W2, YOSHIDA6_W1,
+	1.0 - 2.0 * (YOSHIDA6_W1 + YOSHIDA6_W2 + YOSHIDA6_W3),
+	YOSHIDA6_W1, YOSHIDA6_W2, YOSHIDA6_W3
+};
+
+static double error_norm(glm::dvec3 err, glm::dvec3 y0, glm::dvec3 y1, double atol, double rtol);
+
+DormandPrinceIntegrator::DormandPrinceIntegrator(double abs_tol, double rel_tol) {
+	abs_tolerance = abs_tol;
+	rel_tolerance = rel_tol;
+	reset();
+}
+
+DormandPrinceIntegrator::~DormandPrinceIntegrator() {}
+
+void DormandPrinceIntegrator::reset() {
+	step_size = 0.0;
+	steps = 0;
+	rejected_steps = 0;
+	evaluations = 0;
+}
+
+void DormandPrinceIntegrator::advance(glm::dvec3& x, glm::dvec3& v, double time, double duration, const AccelerationFunction& acceleration) {
+	if (duration <= 0.0) return;
+
+	const double end_time = time + duration;
+	double h = (step_size > 0.0) ? step_size : duration;
+
+	// Stage derivatives: k*x are velocities, k*v accelerations
+	glm::dvec3 k1v = acceleration(time, x, v);
+	glm::dvec3 k1x = v;
+	evaluations++;
+
+	while (time < end_time) {
+		// Don't step past the end (keep the untruncated step size for the next call)
+		double remaining = end_time - time;
+		bool last = (h >= remaining);
+		double dt = last ? remaining : h;
+
+		glm::dvec3 x2 = x + dt * (A21 * k1x);
+		glm::dvec3 v2 = v + dt * (A21 * k1v);
+		glm::dvec3 k2x = v2, k2v = acceleration(time + C2 * dt, x2, v2);
+
+		glm::dvec3 x3 = x + dt * (A31 * k1x + A32 * k2x);
+		glm::dvec3 v3 = v + dt * (A31 * k1v + A32 * k2v);
+		glm::dvec3 k3x = v3, k3v = acceleration(time + C3 * dt, x3, v3);
+
+		glm::dvec3 x4 = x + dt * (A41 * k1x + A42 * k2x + A43 * k3x);
+		glm::dvec3 v4 = v + dt * (A41 * k1v + A42 * k2v + A43 * k3v);
+		glm::dvec3 k4x = v4, k4v = acceleration(time + C4 * dt, x4, v4);
+
+		glm::dvec3 x5 = x + dt * (A51 * k1x + A52 * k2x + A53 * k3x + A54 * k4x);
+		glm::dvec3 v5 = v + dt * (A51 * k1v + A52 * k2v + A53 * k3v + A54 * k4v);
+		glm::dvec3 k5x = v5, k5v = acceleration(time + C5 * dt, x5, v5);
+
+		glm::dvec3 x6 = x + dt * (A61 * k1x + A62 * k2x + A63 * k3x + A64 * k4x + A65 * k5x);
+		glm::dvec3 v6 = v + dt * (A61 * k1v + A62 * k2v + A63 * k3v + A64 * k4v + A65 * k5v);
+		glm::dvec3 k6x = v6, k6v = acceleration(time + dt, x6, v6);
+
+		glm::dvec3 x7 = x + dt * (A71 * k1x + A73 * k3x + A74 * k4x + A75 * k5x + A76 * k6x);
+		glm::dvec3 v7 = v + dt * (A71 * k1v + A73 * k3v + A74 * k4v + A75 * k5v + A76 * k6v);
+		glm::dvec3 k7x = v7, k7v = acceleration(time + dt, x7, v7);
+		evaluations += 6;
+
+		glm::dvec3 x_err = dt * (E1 * k1x + E3 * k3x + E4 * k4x + E5 * k5x + E6 * k6x + E7 * k7x);
+		glm::dvec3 v_err = dt * (E1 * k1v + E3 * k3v + E4 * k4v + E5 * k5v + E6 * k6v + E7 * k7v);
+		double err = std::max(error_norm(x_err, x, x7, abs_tolerance, rel_tolerance), error_norm(v_err, v, v7, abs_tolerance, rel_tolerance));
+
+		double scale = (err == 0.0) ? MAX_SCALE : glm::clamp(SAFETY * std::pow(err, -0.2), MIN_SCALE, MAX_SCALE);
+
+		if (err <= 1.0 || dt <= MIN_STEP) {
+			// Accept (the last stage is the first stage of the next step)
+			time = last ? end_time : time + dt;
+			x = x7;
+			v = v7;
+			k1x = k7x;
+			k1v = k7v;
+			steps++;
+
+			if (!last || dt * scale < h) h = std::max(dt * scale, MIN_STEP);
+		} else {
+			rejected_steps++;
+			h = std::max(dt * scale, MIN_STEP);
+		}
+	}
+
+	step_size = h;
+}
+
+void DormandPrinceIntegrator::save_state(StateWriter& w) const {
+	w.put(abs_tolerance);
+	w.put(rel_tolerance);
+	w.put(step_size);
+	w.put(steps);
+	w.put(rejected_steps);
+	w.put(evaluations);
+}
+
+bool DormandPrinceIntegrator::restore_state(StateReader& r) {
+	r.get(&abs_tolerance);
+	r.get(&rel_tolerance);
+	r.get(&step_size);
+	r.get(&steps);
+	r.get(&rejected_steps);
+	r.get(&evaluations);
+
+	return !r.failed;
+}
+
+YoshidaIntegrator::YoshidaIntegrator(int o) {
+	order = o;
+	reset();
+}
+
+YoshidaIntegrator::~YoshidaIntegrator() {}
+
+void YoshidaIntegrator::reset() {
+	steps = 0;
+	evaluations = 0;
+}
+
+void YoshidaIntegrator::advance(glm::dvec3& x, glm::dvec3& v, double time, double duration, const AccelerationFunction& acceleration) {
+	if (duration <= 0.0) return;
+
+	const double* w = (order == 6) ? YOSHIDA6 : YOSHIDA4;
+	const int substeps = (order == 6) ? 7 : 3;
+
+	// Each substep is kick (half) - drift - kick (half); the closing kick of one
+	// substep and the opening kick of the next share one acceleration evaluation
+	glm::dvec3 a = acceleration(time, x, v);
+	evaluations++;
+
+	for (int i = 0; i < substeps; i++) {
+		double h = w[i] * duration;
+
+		v += 0.5 * h * a;
+		x += h * v;
+		time += h;
+
+		a = acceleration(time, x, v);
+		v += 0.5 * h * a;
+		evaluations++;
+	}
+
+	steps++;
+}
+
+// Largest component error relative to the allowed error
+static double error_norm(glm::dvec3 err, glm::dvec3 y0, glm::dvec3 y1, double atol, double rtol) {
+	double norm = 0.0;
+
+	for (int i = 0; i < 3; i++) {
+		double tolerance = atol + rtol * std::max(std::abs(y0[i]), std::abs(y1[i]));
+		norm = std::max(norm, std::abs(err[i]) / tolerance);
+	}
+
+	return norm;
+}
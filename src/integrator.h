@@ -0,0 +1,69 @@
+// Ricardas Navickas 2020
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "core/glm/glm.hpp"
+#include <functional>
+
+class StateWriter;
+class StateReader;
+
+// Integrator selection (see SimulationState::integrator)
+#define INTEGRATOR_VERLET 0 // fixed step, Object::update()
+#define INTEGRATOR_DOPRI5 1 // adaptive step Dormand-Prince 5(4)
+#define INTEGRATOR_YOSHIDA4 2 // fixed step symplectic, 4th order
+#define INTEGRATOR_YOSHIDA6 3 // fixed step symplectic, 6th order
+
+// Acceleration of a body at a given time and state
+typedef std::function<glm::dvec3(double time, glm::dvec3 position, glm::dvec3 velocity)> AccelerationFunction;
+
+// Adaptive Dormand-Prince 5(4) integrator for the translational motion of one body.
+// The step size is kept between calls, so a body coasting in orbit covers a whole
+// simulation step in a single integrator step while burns and atmospheric entry are
+// split into as many smaller steps as the error tolerance requires.
+class DormandPrinceIntegrator {
+public:
+	DormandPrinceIntegrator(double abs_tolerance, double rel_tolerance);
+	~DormandPrinceIntegrator();
+
+	void reset(); // forget the step size & statistics
+
+	// Integrates position & velocity from time to time + duration
+	void advance(glm::dvec3& position, glm::dvec3& velocity, double time, double duration, const AccelerationFunction& acceleration);
+
+	// Step size, tolerances & statistics
+	void save_state(StateWriter& w) const;
+	bool restore_state(StateReader& r);
+
+	double abs_tolerance, rel_tolerance;
+
+	// Statistics (since the last reset())
+	long steps;          // accepted steps
+	long rejected_steps;
+	long evaluations;    // calls to the acceleration function
+
+private:
+	double step_size; // next trial step (0.0 - not known yet)
+};
+
+// Yoshida's symplectic composition of velocity Verlet (kick-drift-kick) steps.
+// For motion under gravity alone the orbit energy does not drift, so orbits can be
+// run with timesteps far larger than Verlet or Euler would allow.
+class YoshidaIntegrator {
+public:
+	YoshidaIntegrator(int order); // 4 or 6
+	~YoshidaIntegrator();
+
+	void reset(); // forget statistics
+
+	// Integrates position & velocity from time to time + duration in one step
+	void advance(glm::dvec3& position, glm::dvec3& velocity, double time, double duration, const AccelerationFunction& acceleration);
+
+	int order;
+
+	// Statistics (since the last reset())
+	long steps;
+	long evaluations; // calls to the acceleration function
+};
+
+#endif
@@ -1,136 +1,123 @@
 // Ricardas Navickas 2020
 #include "lander.h"
-#include "noise.h"
-#include "global.h"
-
-static const glm::vec3 exhaust_color(0.8f, 0.8f, 0.1f);
-
-Object* make_lander_object() {
-	Mesh* lander_mesh = load_stl_mesh("models/lander.stl", 0.4f, 0.4f, 0.4f);
-
-	// If failed to load from file, use simple cone mesh
-	if (lander_mesh == NULL) {
-		lander_mesh = new Mesh;
-		*lander_mesh = make_truncated_cone_mesh(30, 0.5f, 0.4f, 0.4f, 0.4f);
-		transform_mesh(lander_mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(1.0, 0.5, 1.0)));
+#include "mars.h"
+
+#include <cmath>
+#include <cstddef>
+
+#define LANDER_STATE_FIELD(name) { #name, offsetof(LanderState, name) }
+
+const LanderStateField lander_state_fields[] = {
+	LANDER_STATE_FIELD(dry_mass),
+	LANDER_STATE_FIELD(fuel_level),
+	LANDER_STATE_FIELD(fuel_density),
+	LANDER_STATE_FIELD(fuel_capacity),
+	LANDER_STATE_FIELD(me_max_fuel_rate),
+	LANDER_STATE_FIELD(me_exhaust_vel),
+	LANDER_STATE_FIELD(me_throttle),
+	LANDER_STATE_FIELD(rcs_max_fuel_rate),
+	LANDER_STATE_FIELD(rcs_exhaust_vel),
+	LANDER_STATE_FIELD(rcs_throttle),
+	{ "rcs_axis_x", offsetof(LanderState, rcs_axis) + 0 * sizeof(double) },
+	{ "rcs_axis_y", offsetof(LanderState, rcs_axis) + 1 * sizeof(double) },
+	{ "rcs_axis_z", offsetof(LanderState, rcs_axis) + 2 * sizeof(double) },
+	LANDER_STATE_FIELD(frontal_area),
+	LANDER_STATE_FIELD(parachute_status)
+};
+
+const int lander_state_field_count = sizeof(lander_state_fields) / sizeof(lander_state_fields[0]);
+
+Lander::Lander(Model* m, glm::dvec3 pos, float specular_coef, int specular_exp) :
+	Object(m, pos, specular_coef, specular_exp) {}
+
+double* lander_state_field(LanderState* state, const std::string& name) {
+	for (int i = 0; i < lander_state_field_count; i++) {
+		if (name == lander_state_fields[i].name)
+			return (double*)((char*)state + lander_state_fields[i].offset);
 	}
 
-	transform_mesh(lander_mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(0.001, 0.001, 0.001))); // from meters to kilometers
-
-	// Add color noise
-	Noise3d noise(0.0001f);
-	for (int i = 0; i < num_of_vertices(lander_mesh); i++) {
-		float val = noise.get_value(get_vertex_coords(lander_mesh, i)) / 10.0f;
-		glm::vec3 color = get_vertex_color(lander_mesh, i);
-
-		color.x = glm::clamp(color.x + val, 0.0f, 1.0f);
-		color.y = glm::clamp(color.y + val, 0.0f, 1.0f);
-		color.z = glm::clamp(color.z + val, 0.0f, 1.0f);
-
-		set_vertex_color(lander_mesh, i, color);
-	}
+	return NULL;
+}
 
-	Model* lander_model = new Model(lander_mesh, GL_TRIANGLES);
-	Object* lander = new Object(lander_model, glm::dvec3(0.0), 1.0f, 128);
+Lander* make_lander_object() {
+	Lander* lander = new Lander(NULL, glm::dvec3(0.0), 1.0f, 128);
 
 	reset_lander_attributes(lander);
 
 	return lander;
 }
 
-Object* make_parachute_object() {
-	Mesh* parachute_mesh = load_stl_mesh("models/lander_parachute.stl", 0.3f, 0.3f, 0.6f);
-
-	if (parachute_mesh == NULL) {
-		parachute_mesh = new Mesh;
-		*parachute_mesh = make_truncated_cone_mesh(30, 0.01f, 0.3f, 0.3f, 0.6f);
-		transform_mesh(parachute_mesh, glm::translate(glm::dmat4(1.0), glm::dvec3(0.0, 0.003, 0.0)));
-		transform_mesh(parachute_mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(2.0, 0.2, 2.0)));
-	}
-
-	transform_mesh(parachute_mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(0.001, 0.001, 0.001)));
+void reset_lander_attributes(Lander* lander) {
+	lander->state.dry_mass = 150.0;
+	lander->state.fuel_level = 1.0; // 0.0 - empty, 1.0 - full
+	lander->state.fuel_density = 1.0;
+	lander->state.fuel_capacity = 50.0;
 
-	Model* parachute_model = new Model(parachute_mesh, GL_TRIANGLES);
-	Object* parachute = new Object(parachute_model, glm::dvec3(0.0), 1.0f, 8);
+	lander->state.me_max_fuel_rate = 0.5;
+	lander->state.me_exhaust_vel = 3.0; // km/s
+	lander->state.me_throttle = 0.0;
 
-	return parachute;
-}
-
-Object* make_exhaust_object() {
-	Mesh* exhaust_mesh = new Mesh;
-	*exhaust_mesh = make_truncated_cone_mesh(15, 0.0f, 0.8f, 0.8f, 0.1f);
-	transform_mesh(exhaust_mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(0.00025, -EXHAUST_MAX_LENGTH, 0.00025)));
+	lander->state.rcs_max_fuel_rate = 0.1;
+	lander->state.rcs_exhaust_vel = 2.0; // km/s
+	lander->state.rcs_throttle = 0.0;
+	lander->state.rcs_axis = glm::dvec3(0.0, 1.0, 0.0);
 
-	Model* exhaust_model = new Model(exhaust_mesh, GL_TRIANGLES);
-	Object* exhaust = new Object(exhaust_model, glm::dvec3(0.0), 1.0f, 8);
+	lander->state.frontal_area = M_PI * 0.001 * 0.001;
+	lander->state.parachute_status = 0.0; // 0.0 - not deployed, 0.0-1.0 - deployed, >1.0 - destroyed
 
-	return exhaust;
+	set_fuel_level(lander, lander->state.fuel_level);
 }
 
-void reset_lander_attributes(Object* lander) {
-	lander->attribute["dry_mass"] = 150.0;
-	lander->attribute["fuel_level"] = 1.0; // 0.0 - empty, 1.0 - full
-	lander->attribute["fuel_density"] = 1.0;
-	lander->attribute["fuel_capacity"] = 50.0;
-
-	lander->attribute["me_max_fuel_rate"] = 0.5;
-	lander->attribute["me_exhaust_vel"] = 3.0; // km/s
-	lander->attribute["me_throttle"] = 0.0;
+void set_fuel_level(Lander* lander, double fuel_level) {
+	lander->state.fuel_level = glm::clamp(fuel_level, 0.0, 1.0);
 
-	lander->attribute["rcs_max_fuel_rate"] = 0.1;
-	lander->attribute["rcs_exhaust_vel"] = 2.0; // km/s
-	lander->attribute["rcs_throttle"] = 0.0;
-	lander->attribute["rcs_axis_x"] = 0.0;
-	lander->attribute["rcs_axis_y"] = 1.0;
-	lander->attribute["rcs_axis_z"] = 0.0;
-
-	lander->attribute["frontal_area"] = M_PI * 0.001 * 0.001;
-	lander->attribute["parachute_status"] = 0.0; // 0.0 - not deployed, 0.0-1.0 - deployed, >1.0 - destroyed
-
-	double fuel_mass = lander->attribute["fuel_level"] * lander->attribute["fuel_capacity"] * lander->attribute["fuel_density"];
-	lander->mass = lander->attribute["dry_mass"] + fuel_mass;
+	double fuel_mass = lander->state.fuel_level * lander->state.fuel_capacity * lander->state.fuel_density;
+	lander->mass = lander->state.dry_mass + fuel_mass;
 	lander->moment_of_inertia = lander->mass * 1e-6; // approximate, assuming radius is about 1e-3 km
 }
 
-void setup_rcs(Object* lander, glm::dvec3 axis, double throttle) {
-	lander->attribute["rcs_axis_x"] = axis.x;
-	lander->attribute["rcs_axis_y"] = axis.y;
-	lander->attribute["rcs_axis_z"] = axis.z;
-	lander->attribute["rcs_throttle"] = glm::clamp(throttle, -1.0, 1.0);
+void setup_rcs(Lander* lander, glm::dvec3 axis, double throttle) {
+	lander->state.rcs_axis = axis;
+	lander->state.rcs_throttle = glm::clamp(throttle, -1.0, 1.0);
 }
 
-void setup_main_engine(Object* lander, double throttle) {
-	lander->attribute["me_throttle"] = glm::clamp(throttle, 0.0, 1.0);
+void setup_main_engine(Lander* lander, double throttle) {
+	lander->state.me_throttle = glm::clamp(throttle, 0.0, 1.0);
 }
 
-void fire_engines(Object* lander, double timestep) {
+void fire_engines(Lander* lander, double timestep) {
 	// If no fuel left, do nothing
-	if (lander->mass <= lander->attribute["dry_mass"]) {
-		lander->mass = lander->attribute["dry_mass"];
+	if (lander->mass <= lander->state.dry_mass) {
+		lander->mass = lander->state.dry_mass;
 		return;
 	}
 
 	// Fire RCS (assuming thrusters are 1m away from the center of mass)
-	double thruster_force = std::abs(lander->attribute["rcs_throttle"]) * lander->attribute["rcs_max_fuel_rate"] * lander->attribute["rcs_exhaust_vel"];
-	glm::dvec3 axis(lander->attribute["rcs_axis_x"], lander->attribute["rcs_axis_y"], lander->attribute["rcs_axis_z"]);
-	lander->net_moment += 1e-3 * thruster_force * glm::normalize(axis);
+	double thruster_force = std::abs(lander->state.rcs_throttle) * lander->state.rcs_max_fuel_rate * lander->state.rcs_exhaust_vel;
+	lander->net_moment += 1e-3 * thruster_force * glm::normalize(lander->state.rcs_axis);
 
 	// Fire main engine
 	glm::dvec3 up_vector = lander->attitude_matrix * glm::dvec3(0.0, 1.0, 0.0);
-	lander->net_force += up_vector * lander->attribute["me_throttle"] * lander->attribute["me_max_fuel_rate"] * lander->attribute["me_exhaust_vel"];
+	lander->net_force += up_vector * lander->state.me_throttle * lander->state.me_max_fuel_rate * lander->state.me_exhaust_vel;
+
+	burn_fuel(lander, timestep);
+}
+
+void burn_fuel(Lander* lander, double timestep) {
+	if (lander->mass <= lander->state.dry_mass) return;
 
 	// Update mass
-	lander->mass -= lander->attribute["me_throttle"] * lander->attribute["me_max_fuel_rate"] * timestep;
-	lander->mass -= lander->attribute["rcs_throttle"] * lander->attribute["rcs_max_fuel_rate"] * timestep;
+	lander->mass -= lander->state.me_throttle * lander->state.me_max_fuel_rate * timestep;
+	lander->mass -= lander->state.rcs_throttle * lander->state.rcs_max_fuel_rate * timestep;
 	lander->moment_of_inertia = lander->mass * 1e-6; // approximate, assuming radius is about 1e-3 km
 
 	// Update fuel-related attributes
-	lander->attribute["fuel_level"] = (lander->mass - lander->attribute["dry_mass"]) / (lander->attribute["fuel_capacity"] * lander->attribute["fuel_density"]);
+	lander->state.fuel_level = (lander->mass - lander->state.dry_mass) / (lander->state.fuel_capacity * lander->state.fuel_density);
 }
 
-void deploy_parachute(Object* lander) {
+void deploy_parachute(Lander* lander, Object* mars) {
 	// If parachute is destroyed, do nothing
-	if (lander->attribute["parachute_status"] > 1.0)
+	if (lander->state.parachute_status > 1.0)
 		return;
 	
 	// If moving too fast, destroy parachute
@@ -139,13 +126,13 @@ void deploy_parachute(Object* lander) {
 		return;
 	}
 
-	lander->attribute["parachute_status"] = 1.0;
-	lander->attribute["frontal_area"] = 5 * M_PI * 0.001 * 0.001;
+	lander->state.parachute_status = 1.0;
+	lander->state.frontal_area = 5 * M_PI * 0.001 * 0.001;
 }
 
-void cut_parachute(Object* lander) {
-	lander->attribute["parachute_status"] = 2.0; // lose parachute
-	lander->attribute["frontal_area"] = M_PI * 0.001 * 0.001;
+void cut_parachute(Lander* lander) {
+	lander->state.parachute_status = 2.0; // lose parachute
+	lander->state.frontal_area = M_PI * 0.001 * 0.001;
 }
 
 double descent_rate(Object* lander, Object* mars) {
@@ -156,22 +143,14 @@ double groundspeed(Object* lander, Object* mars) {
 	return glm::length(lander->velocity + glm::normalize(lander->position - mars->position) * descent_rate(lander, mars) - mars_surface_velocity(mars, lander->position));
 }
 
-bool soft_landing(Object* lander) {
+bool soft_landing(Object* lander, Object* mars) {
 	return (descent_rate(lander, mars) <= 0.001) && (groundspeed(lander, mars) <= 0.001);
 }
 
-double lander_delta_v(Object* lander) {
-	return lander->attribute["me_exhaust_vel"] * log(lander->mass / lander->attribute["dry_mass"]);
+double lander_delta_v(Lander* lander) {
+	return lander->state.me_exhaust_vel * log(lander->mass / lander->state.dry_mass);
 }
 
-double lander_max_delta_v(Object* lander) {
-	return lander->attribute["me_exhaust_vel"] * log((lander->attribute["dry_mass"] + lander->attribute["fuel_capacity"] * lander->attribute["fuel_density"]) / lander->attribute["dry_mass"]);
+double lander_max_delta_v(Lander* lander) {
+	return lander->state.me_exhaust_vel * log((lander->state.dry_mass + lander->state.fuel_capacity * lander->state.fuel_density) / lander->state.dry_mass);
 }
-
-void update_exhaust_model(Object* lander, Object* exhaust) {
-	static const Mesh full_length_exhaust_mesh = *exhaust->model->mesh;
-	*exhaust->model->mesh = full_length_exhaust_mesh;
-	transform_mesh(exhaust->model->mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(1.0, lander->attribute["me_throttle"], 1.0)));
-	exhaust->model->reload_mesh();
-}
-
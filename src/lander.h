@@ -9,28 +9,72 @@
 #define PARACHUTE_MAX_VELOCITY 0.5
 #define BASE_COM_DIST 0.0007 // distance between lander base and center of mass
 
-Object* make_lander_object();
+#include <string>
+
+// Lander-specific quantities, kept in one flat struct so the physics step
+// never has to look anything up by name
+struct LanderState {
+	double dry_mass;
+	double fuel_level; // 0.0 - empty, 1.0 - full
+	double fuel_density;
+	double fuel_capacity;
+
+	double me_max_fuel_rate;
+	double me_exhaust_vel; // km/s
+	double me_throttle;
+
+	double rcs_max_fuel_rate;
+	double rcs_exhaust_vel; // km/s
+	double rcs_throttle;
+	glm::dvec3 rcs_axis;
+
+	double frontal_area;
+	double parachute_status; // 0.0 - not deployed, 0.0-1.0 - deployed, >1.0 - destroyed
+};
+
+class Lander : public Object {
+public:
+	Lander(Model* m, glm::dvec3 pos, float specular_coef, int specular_exp);
+
+	LanderState state;
+};
+
+// Name -> LanderState slot table, for introspection (GUI, Lua) only
+struct LanderStateField {
+	const char* name;
+	size_t offset; // of a double in LanderState
+};
+
+extern const LanderStateField lander_state_fields[];
+extern const int lander_state_field_count;
+
+double* lander_state_field(LanderState* state, const std::string& name); // NULL if there is no such field
+
+Lander* make_lander_object(); // Lander body with no model attached (physics only)
+
+// Rendering (defined in lander_model.cpp)
+Model* make_lander_model();
 Object* make_parachute_object();
 Object* make_exhaust_object();
+void update_exhaust_model(Lander* lander, Object* exhaust);
 
-void reset_lander_attributes(Object* lander);
+void reset_lander_attributes(Lander* lander);
+void set_fuel_level(Lander* lander, double fuel_level); // 0.0 - empty, 1.0 - full (updates mass)
 
 // Lander controls
-void setup_rcs(Object* lander, glm::dvec3 axis, double throttle); // set RCS rotation axis and throttle
-void setup_main_engine(Object* lander, double throttle);          // set main engine throttle
-void fire_engines(Object* lander, double timestep);               // apply thrust and torque (as configured by setup_rcs() and setup_main_engine())
-void deploy_parachute(Object* lander);
-void cut_parachute(Object* lander);
+void setup_rcs(Lander* lander, glm::dvec3 axis, double throttle);  // set RCS rotation axis and throttle
+void setup_main_engine(Lander* lander, double throttle);           // set main engine throttle
+void fire_engines(Lander* lander, double timestep);                // apply thrust and torque (as configured by setup_rcs() and setup_main_engine())
+void burn_fuel(Lander* lander, double timestep);                   // only the mass (fuel) part of fire_engines()
+void deploy_parachute(Lander* lander, Object* mars);
+void cut_parachute(Lander* lander);
 
-double lander_delta_v(Object* lander);
-double lander_max_delta_v(Object* lander);
+double lander_delta_v(Lander* lander);
+double lander_max_delta_v(Lander* lander);
 
 // Helper functions
 double descent_rate(Object* lander, Object* mars);
 double groundspeed(Object* lander, Object* mars);
-bool soft_landing(Object* lander); // Returns true if soft landing conditions are satisfied
-
-// Exhaust effects
-void update_exhaust_model(Object* lander, Object* exhaust);
+bool soft_landing(Object* lander, Object* mars); // Returns true if soft landing conditions are satisfied
 
 #endif
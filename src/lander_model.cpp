@@ -0,0 +1,80 @@
+// Ricardas Navickas 2020
+#include "core/core.h"
+#include "lander.h"
+#include "noise.h"
+
+#include <vector>
+
+static const glm::vec3 exhaust_color(0.8f, 0.8f, 0.1f);
+
+Model* make_lander_model() {
+	Mesh* lander_mesh = load_stl_mesh("models/lander.stl", 0.4f, 0.4f, 0.4f);
+
+	// If failed to load from file, use simple cone mesh
+	if (lander_mesh == NULL) {
+		lander_mesh = new Mesh;
+		*lander_mesh = make_truncated_cone_mesh(30, 0.5f, 0.4f, 0.4f, 0.4f);
+		transform_mesh(lander_mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(1.0, 0.5, 1.0)));
+	}
+
+	transform_mesh(lander_mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(0.001, 0.001, 0.001))); // from meters to kilometers
+
+	// Add color noise (evaluated for all vertices at once)
+	const int n = num_of_vertices(lander_mesh);
+	std::vector<glm::vec3> coords(n);
+	std::vector<float> values(n);
+	for (int i = 0; i < n; i++) {
+		coords[i] = get_vertex_coords(lander_mesh, i);
+	}
+
+	Noise3d noise(0.0001f);
+	noise.get_values(coords.data(), values.data(), n, 1);
+	for (int i = 0; i < n; i++) {
+		float val = values[i] / 10.0f;
+		glm::vec3 color = get_vertex_color(lander_mesh, i);
+
+		color.x = glm::clamp(color.x + val, 0.0f, 1.0f);
+		color.y = glm::clamp(color.y + val, 0.0f, 1.0f);
+		color.z = glm::clamp(color.z + val, 0.0f, 1.0f);
+
+		set_vertex_color(lander_mesh, i, color);
+	}
+
+	return new Model(lander_mesh, GL_TRIANGLES);
+}
+
+Object* make_parachute_object() {
+	Mesh* parachute_mesh = load_stl_mesh("models/lander_parachute.stl", 0.3f, 0.3f, 0.6f);
+
+	if (parachute_mesh == NULL) {
+		parachute_mesh = new Mesh;
+		*parachute_mesh = make_truncated_cone_mesh(30, 0.01f, 0.3f, 0.3f, 0.6f);
+		transform_mesh(parachute_mesh, glm::translate(glm::dmat4(1.0), glm::dvec3(0.0, 0.003, 0.0)));
+		transform_mesh(parachute_mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(2.0, 0.2, 2.0)));
+	}
+
+	transform_mesh(parachute_mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(0.001, 0.001, 0.001)));
+
+	Model* parachute_model = new Model(parachute_mesh, GL_TRIANGLES);
+	Object* parachute = new Object(parachute_model, glm::dvec3(0.0), 1.0f, 8);
+
+	return parachute;
+}
+
+Object* make_exhaust_object() {
+	Mesh* exhaust_mesh = new Mesh;
+	*exhaust_mesh = make_truncated_cone_mesh(15, 0.0f, 0.8f, 0.8f, 0.1f);
+	transform_mesh(exhaust_mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(0.00025, -EXHAUST_MAX_LENGTH, 0.00025)));
+
+	Model* exhaust_model = new Model(exhaust_mesh, GL_TRIANGLES);
+	Object* exhaust = new Object(exhaust_model, glm::dvec3(0.0), 1.0f, 8);
+
+	return exhaust;
+}
+
+// The mesh is the full length plume; throttle only changes the exhaust object's scale & opacity
+void update_exhaust_model(Lander* lander, Object* exhaust) {
+	exhaust->scale = glm::dvec3(1.0, lander->state.me_throttle, 1.0);
+	exhaust->opacity = 0.5f + 0.5f * lander->state.me_throttle;
+}
+
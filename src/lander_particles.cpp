@@ -0,0 +1,180 @@
+// Ricardas Navickas 2020
+#include "lander_particles.h"
+
+#include <cmath>
+
+static const ParticleStyle main_engine_style = {
+	0.0003f, 0.0015f, glm::vec4(1.0f, 0.85f, 0.4f, 0.8f), glm::vec4(0.6f, 0.55f, 0.5f, 0.0f), 1.5f, glm::vec3(0.0f)
+};
+
+static const ParticleStyle rcs_style = {
+	0.0001f, 0.0006f, glm::vec4(0.9f, 0.9f, 1.0f, 0.6f), glm::vec4(0.9f, 0.9f, 1.0f, 0.0f), 3.0f, glm::vec3(0.0f)
+};
+
+static const ParticleStyle dust_style = {
+	0.001f, 0.006f, glm::vec4(0.7f, 0.45f, 0.3f, 0.5f), glm::vec4(0.75f, 0.5f, 0.35f, 0.0f), 1.0f, glm::vec3(0.0f)
+};
+
+static const float me_exhaust_speed = 0.06f; // km/s, relative to the lander
+static const float me_life = 0.6f;
+static const float rcs_exhaust_speed = 0.03f;
+static const float rcs_life = 0.3f;
+static const float dust_speed = 0.02f; // km/s, along the ground
+static const float dust_life = 2.5f;
+
+LanderParticles::LanderParticles(MarsEnvironment* env) :
+	main_engine(PARTICLES_ME_MAX, main_engine_style),
+	rcs(PARTICLES_RCS_MAX, rcs_style),
+	dust(PARTICLES_DUST_MAX, dust_style),
+	rng(1, 1) {
+	this->env = env;
+	origin = glm::dvec3(0.0);
+	last_time = 0.0;
+	last_wall_time = 0.0;
+	was_touched_down = false;
+	clear();
+}
+
+LanderParticles::~LanderParticles() {}
+
+void LanderParticles::update(Lander* lander, Object* mars, double time, double wall_time, double ground_height, double touchdown_speed) {
+	const bool touched_down = touchdown_speed >= 0.0;
+	const double sim_delta = time - last_time;
+	const double wall_delta = wall_time - last_wall_time;
+	last_time = time;
+	last_wall_time = wall_time;
+
+	// Time went back (rewind, new scenario): the particles belong to another past
+	if (sim_delta < 0.0) {
+		clear();
+		was_touched_down = touched_down;
+		return;
+	}
+
+	const bool running = sim_delta > 0.0;
+	const double delta_time = glm::clamp(running ? sim_delta : wall_delta, 0.0, (double)PARTICLES_MAX_TIMESTEP);
+
+	// Keep the origin near the lander, so that float positions stay precise around it
+	glm::dvec3 new_origin = origin;
+	if (glm::length(lander->position - origin) > PARTICLES_RECENTER_DISTANCE) new_origin = lander->position;
+	glm::vec3 shift = origin - new_origin;
+	origin = new_origin;
+
+	// Mars & the lander stand still while paused, so the particles are moved relative to the ground rather
+	// than flying off at the speed it turns
+	if (!running) shift -= glm::vec3(mars_surface_velocity(mars, lander->position) * delta_time);
+
+	const glm::vec3 air_velocity = mars_wind_velocity(mars, env, lander->position, time);
+	main_engine.update(delta_time, air_velocity, shift);
+	rcs.update(delta_time, air_velocity, shift);
+	dust.update(delta_time, air_velocity, shift);
+
+	const LanderState& s = lander->state;
+	const bool has_fuel = running && s.fuel_level > 0.0;
+
+	// Main engine
+	const double me_rate = has_fuel ? PARTICLES_ME_RATE * s.me_throttle : 0.0;
+	me_carry += me_rate * delta_time;
+	emit_main_engine(lander, int(me_carry));
+	me_carry -= int(me_carry);
+
+	// RCS
+	const double rcs_rate = has_fuel ? PARTICLES_RCS_RATE * std::abs(s.rcs_throttle) : 0.0;
+	rcs_carry += rcs_rate * delta_time;
+	emit_rcs(lander, int(rcs_carry));
+	rcs_carry -= int(rcs_carry);
+
+	// Dust blown off the ground under the main engine, the more the closer it is
+	const glm::dvec3 radius = lander->position - mars->position;
+	const double altitude = glm::length(radius) - ground_height - BASE_COM_DIST;
+	const glm::dvec3 ground = mars->position + glm::normalize(radius) * ground_height;
+
+	if (altitude < PARTICLES_DUST_ALTITUDE && me_rate > 0.0) {
+		const double closeness = 1.0 - glm::max(altitude, 0.0) / PARTICLES_DUST_ALTITUDE;
+		dust_carry += PARTICLES_DUST_RATE * s.me_throttle * closeness * delta_time;
+		emit_dust(lander, mars, ground, int(dust_carry), dust_speed);
+		dust_carry -= int(dust_carry);
+	}
+
+	// A puff on touchdown, bigger the harder it was (the lander's velocity is already the bounce's by now)
+	if (touched_down && !was_touched_down) {
+		emit_dust(lander, mars, ground, int(PARTICLES_DUST_TOUCHDOWN * glm::min(touchdown_speed / 0.01, 4.0)), 0.5f * dust_speed);
+	}
+	was_touched_down = touched_down;
+}
+
+void LanderParticles::draw(Shader* shader, glm::dvec3 camera_pos) {
+	// Particles are translucent and unsorted: test against depth, but don't write it
+	glDepthMask(GL_FALSE);
+	dust.draw(shader, origin, camera_pos);
+	main_engine.draw(shader, origin, camera_pos);
+	rcs.draw(shader, origin, camera_pos);
+	glDepthMask(GL_TRUE);
+}
+
+void LanderParticles::clear() {
+	main_engine.clear();
+	rcs.clear();
+	dust.clear();
+	me_carry = 0.0;
+	rcs_carry = 0.0;
+	dust_carry = 0.0;
+}
+
+unsigned int LanderParticles::num_of_particles() {
+	return main_engine.num_of_particles() + rcs.num_of_particles() + dust.num_of_particles();
+}
+
+void LanderParticles::emit_main_engine(Lander* lander, int n) {
+	const glm::dvec3 down = lander->attitude_matrix * glm::dvec3(0.0, -1.0, 0.0);
+	const glm::vec3 nozzle = lander->position + 0.0004 * down - origin;
+	const glm::vec3 velocity = lander->velocity;
+
+	for (int i = 0; i < n; i++) {
+		glm::vec3 direction = glm::normalize(glm::vec3(down) + 0.15f * random_vector());
+		if (!main_engine.emit(nozzle, velocity + me_exhaust_speed * random(0.8f, 1.2f) * direction, me_life * random(0.6f, 1.0f))) return;
+	}
+}
+
+// Two thrusters on opposite sides (1m from the center of mass) turn the lander about rcs_axis
+void LanderParticles::emit_rcs(Lander* lander, int n) {
+	glm::dvec3 axis = lander->state.rcs_axis;
+	if (glm::length(axis) < 1e-8 || n == 0) return;
+	axis = glm::normalize(axis) * (lander->state.rcs_throttle < 0.0 ? -1.0 : 1.0);
+
+	const glm::dvec3 other = (std::abs(axis.x) < 0.9) ? glm::dvec3(1.0, 0.0, 0.0) : glm::dvec3(0.0, 1.0, 0.0);
+	const glm::dvec3 arm = 0.001 * glm::normalize(glm::cross(axis, other));
+	const glm::vec3 exhaust_dir = glm::normalize(glm::cross(axis, arm)); // thrust at +arm pushes along -exhaust_dir
+
+	for (int i = 0; i < n; i++) {
+		const float side = (i & 1) ? 1.0f : -1.0f;
+		const glm::vec3 position = lander->position + double(side) * arm - origin;
+		const glm::vec3 direction = glm::normalize(-side * exhaust_dir + 0.2f * random_vector());
+		if (!rcs.emit(position, glm::vec3(lander->velocity) + rcs_exhaust_speed * direction, rcs_life * random(0.6f, 1.0f))) return;
+	}
+}
+
+// Dust thrown outwards along the ground from the point under the lander
+void LanderParticles::emit_dust(Lander* lander, Object* mars, glm::dvec3 ground, int n, float speed) {
+	const glm::vec3 up = glm::normalize(ground - mars->position);
+	const glm::vec3 position = ground - origin;
+	const glm::vec3 surface_velocity = mars_surface_velocity(mars, ground);
+
+	for (int i = 0; i < n; i++) {
+		glm::vec3 along = random_vector();
+		along -= glm::dot(along, up) * up;
+		if (glm::length(along) < 1e-4f) continue;
+
+		const glm::vec3 direction = glm::normalize(glm::normalize(along) + random(0.05f, 0.3f) * up);
+		const glm::vec3 offset = 0.002f * random(0.0f, 1.0f) * glm::normalize(along);
+		if (!dust.emit(position + offset, surface_velocity + speed * random(0.5f, 1.5f) * direction, dust_life * random(0.5f, 1.0f))) return;
+	}
+}
+
+float LanderParticles::random(float min, float max) {
+	return min + (max - min) * float(rng() >> 8) * (1.0f / 16777216.0f);
+}
+
+glm::vec3 LanderParticles::random_vector() {
+	return glm::vec3(random(-1.0f, 1.0f), random(-1.0f, 1.0f), random(-1.0f, 1.0f));
+}
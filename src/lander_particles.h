@@ -0,0 +1,63 @@
+// Ricardas Navickas 2020
+#ifndef LANDER_PARTICLES_H
+#define LANDER_PARTICLES_H
+
+#include "core/particle_emitter.h"
+#include "core/counter_rng.h"
+#include "lander.h"
+#include "mars.h"
+
+// Particles per second (at full throttle) and pool sizes (~100k particles in all)
+#define PARTICLES_ME_RATE 40000.0
+#define PARTICLES_ME_MAX 32768
+#define PARTICLES_RCS_RATE 12000.0
+#define PARTICLES_RCS_MAX 8192
+#define PARTICLES_DUST_RATE 30000.0
+#define PARTICLES_DUST_MAX 65536
+#define PARTICLES_DUST_TOUCHDOWN 8000   // particles thrown up on touchdown (at 10 m/s, in proportion)
+#define PARTICLES_DUST_ALTITUDE 0.03    // km; the main engine raises dust below this altitude
+#define PARTICLES_MAX_TIMESTEP 0.1      // s of simulation time per update at most (the rest of a time warp is skipped)
+#define PARTICLES_RECENTER_DISTANCE 1.0 // km the lander may move from the particles' origin before it is moved
+
+// Main engine & RCS exhaust, and dust raised by the main engine near the ground or by touching down.
+// Each kind is a ParticleEmitter (drawn with one instanced call). Particles live in simulation time and
+// are slowed down by the air, which turns with mars. While the simulation is paused (e.g. after touching
+// down) they settle in real time in the frame of the ground under the lander, but none are emitted.
+class LanderParticles {
+public:
+	LanderParticles(MarsEnvironment* env); // env is read for wind
+	~LanderParticles();
+
+	// Emits & moves particles up to time (simulation time of the lander's & mars' pose).
+	// ground_height is the distance from mars' center to the terrain under the lander (from the simulation's
+	// snapshot: terrain is not sampled here), touchdown_speed is the simulation's (< 0 before touching down).
+	// wall_time is in seconds from any point.
+	void update(Lander* lander, Object* mars, double time, double wall_time, double ground_height, double touchdown_speed);
+
+	// Draws with shader (see shaders/particle.v.glsl) which must be in use, with view & projection set
+	void draw(Shader* shader, glm::dvec3 camera_pos);
+
+	void clear();
+	unsigned int num_of_particles();
+
+private:
+	void emit_main_engine(Lander* lander, int n);
+	void emit_rcs(Lander* lander, int n);
+	void emit_dust(Lander* lander, Object* mars, glm::dvec3 ground, int n, float speed);
+	float random(float min, float max);
+	glm::vec3 random_vector(); // in a unit cube
+
+	ParticleEmitter main_engine, rcs, dust;
+
+	glm::dvec3 origin; // particle positions are relative to this point (near the lander)
+	double last_time, last_wall_time;
+	bool was_touched_down;
+
+	// Fractions of particles carried over to the next update
+	double me_carry, rcs_carry, dust_carry;
+
+	MarsEnvironment* env;
+	CounterRng rng; // looks only, not one of the simulation's streams
+};
+
+#endif
@@ -14,12 +14,11 @@
 #include "orbit_scene.h"
 #include "autopilot.h"
 
-#include <fenv.h>
-
 #define FPS_MAX 60
 
 static void init_everything();
 static void process_input(GLFWwindow* window);
+static unsigned int read_control_input(GLFWwindow* window);
 static void do_frame();
 static void do_rendering();
 static void do_simulation();
@@ -32,6 +31,8 @@ int main(int argc, char** argv) {
 		do_frame();
 	}
 
+	delete sim_thread;
+	delete trajectory_predictor;
 	glfwTerminate();
 	debug("main()", "Quitting.");
 
@@ -41,9 +42,19 @@ int main(int argc, char** argv) {
 static void init_everything() {
 	// NOTE: init_graphics() must be called before anything else to set up all OpenGL function pointers
 	init_graphics();
-	init_global_vars();
 	init_gui();
-	init_simulation(1.0 / FPS_MAX);
+	sim = new SimulationContext(1.0 / FPS_MAX, guistate.selected_scenario);
+	init_global_vars();
+
+	// Keyframes every 5 simulated seconds (at the normal timestep), for rewinding from the GUI
+	sim->rewind.keyframe_interval = 5 * FPS_MAX;
+	sim->rewind.max_bytes = 64 << 20;
+
+	// Physics runs on its own thread, one tick per (nominal) frame
+	sim_thread = new SimulationThread(sim, FPS_MAX);
+	sim_view = sim_thread->get_view();
+	update_view_objects();
+
 	init_orbit_scene(world_shader, world_nofx_shader);
 	init_closeup_scene(world_shader, world_nofx_shader);
 
@@ -70,6 +81,25 @@ static void process_input(GLFWwindow* window) {
 	down_prev_status = glfwGetKey(window, GLFW_KEY_DOWN);
 }
 
+// Lander controls (held for every physics update in the frame)
+static unsigned int read_control_input(GLFWwindow* window) {
+	if (ImGui::GetIO().WantCaptureKeyboard == 1) return 0;
+
+	unsigned int input = 0;
+
+	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) input |= CONTROL_RCS_NEG_X;
+	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) input |= CONTROL_RCS_POS_Z;
+	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) input |= CONTROL_RCS_POS_X;
+	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) input |= CONTROL_RCS_NEG_Z;
+	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) input |= CONTROL_RCS_NEG_Y;
+	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) input |= CONTROL_RCS_POS_Y;
+	if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) input |= CONTROL_THROTTLE_UP;
+	if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) input |= CONTROL_THROTTLE_DOWN;
+	if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) input |= CONTROL_PARACHUTE;
+
+	return input;
+}
+
 static void do_frame() {
 	// Timings
 	float frame_begin_time, render_begin_time, sim_begin_time, fc_begin_time, other_begin_time;
@@ -82,10 +112,9 @@ static void do_frame() {
 	guistate.render_duration = glfwGetTime() - render_begin_time;
 
 	// ======== SIMULATION PHASE ========
+	// (only passes inputs, the simulation steps on sim_thread)
 	sim_begin_time = glfwGetTime();
-	//feenableexcept(FE_ALL_EXCEPT ^ FE_INEXACT);
 	do_simulation();
-	feenableexcept(0);
 	guistate.sim_duration = glfwGetTime() - sim_begin_time;
 
 	// ======== FRAMERATE CONTROL ========
@@ -97,11 +126,16 @@ static void do_frame() {
 	other_begin_time = glfwGetTime();
 
 	process_input(wstate.window);
+
+	sim_view = sim_thread->get_view();
+	update_view_objects();
 	update_closeup_scene();
 	update_orbit_scene();
 
-	guistate.sim_time = simstate.time;
-	guistate.sim_timestep = simstate.timestep;
+	guistate.sim_time = sim_view.state.time;
+	guistate.sim_timestep = sim_view.state.timestep;
+	guistate.sim_busy_time = sim_view.busy_time;
+	guistate.sim_speed = sim_view.speed;
 
 	guistate.other_duration = glfwGetTime() - other_begin_time;
 	guistate.frame_duration = glfwGetTime() - frame_begin_time;
@@ -109,7 +143,7 @@ static void do_frame() {
 
 static void do_rendering() {
 	const glm::vec3 fog_color(0.6f, 0.5f, 0.5f);
-	const float fog_density = mars_atm_density(mars, wstate.current_scene->camera->position);
+	const float fog_density = mars_atm_density(mars_view, wstate.current_scene->camera->position);
 	const float fog_factor = glm::clamp(100 * double(fog_density) / 0.008e9, 0.0, 1.0);
 
 	world_shader->setf("fog_density", fog_density);
@@ -130,19 +164,31 @@ static void do_rendering() {
 	}
 
 	wstate.current_scene->render();
-	render_gui();
+
+	render_gui(); // (locks the simulation only while building the windows that use it)
 
 	glfwSwapBuffers(wstate.window);
 	glfwPollEvents();
 }
 
 static void do_simulation() {
-	static float num_of_updates = 0.0f;
-	num_of_updates += guistate.physics_updates_per_frame;
+	const unsigned int control_input = guistate.lock_manual_controls ? 0 : read_control_input(wstate.window);
+
+	sim_thread->lock();
 
-	while (num_of_updates >= 1.0f) {
-		simulation_step();
-		num_of_updates -= 1.0f;
+	// Pass GUI outputs to the simulation
+	if (guistate.scenario_changed) {
+		sim->state.custom_lander_pos = guistate.custom_scenario_lander_pos;
+		sim->state.custom_lander_vel = guistate.custom_scenario_lander_vel;
+		set_scenario(sim, guistate.selected_scenario);
+		sim_thread->reset_interpolation();
 	}
+
+	set_timestep(sim, guistate.timestep_multiplier * (1.0 / FPS_MAX));
+	sim->state.autopilot_active = guistate.autopilot_active;
+	sim->state.control_input = control_input;
+	sim_thread->set_steps_per_tick(guistate.physics_updates_per_frame);
+
+	sim_thread->unlock();
 }
 
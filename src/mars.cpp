@@ -1,121 +1,66 @@
 // Ricardas Navickas 2020
-#include "core/core.h"
 #include "mars.h"
 #include "noise.h"
+#include "terrain_cache.h"
 
 #include <cmath>
+#include <random>
+#include <vector>
 
-static const glm::vec3 mars_base_color(0.63f, 0.33f, 0.22f);
+// Seeds are drawn here (rather than by the noise generators) so that they can be recorded
+MarsEnvironment::MarsEnvironment() :
+	MarsEnvironment(std::random_device()(), std::random_device()()) {}
 
-Object* make_mars_object() {
-	Mesh* mars_mesh = new Mesh;
-	*mars_mesh = make_ico_sphere_mesh(4, mars_base_color.x, mars_base_color.y, mars_base_color.z);
-	transform_mesh(mars_mesh, glm::scale(glm::mat4(1.0), glm::vec3(MARS_RADIUS)));
-
-	// Base color
-	for (int i = 0; i < num_of_vertices(mars_mesh); i++) {
-		set_vertex_color(mars_mesh, i, mars_surface_color(get_vertex_coords(mars_mesh, i)));
-	}
-
-	// Add color noise
-	Noise3d noise(400.0f); 
-	for (int i = 0; i < num_of_vertices(mars_mesh); i++) {
-		const float coef = 1 / 20.0f;
-		float val = noise.get_value(get_vertex_coords(mars_mesh, i), 2);
-
-		glm::vec3 color = get_vertex_color(mars_mesh, i);
-
-		color.x = glm::clamp(color.x + coef * val, 0.0f, 1.0f);
-		color.y = glm::clamp(color.y + coef * val, 0.0f, 1.0f);
-		color.z = glm::clamp(color.z + coef * val, 0.0f, 1.0f);
+MarsEnvironment::MarsEnvironment(unsigned int terrain_seed, unsigned int wind_seed) :
+	terrain_seed(terrain_seed),
+	wind_seed(wind_seed),
+	height_noise(2.0f, terrain_seed, RNG_STREAM_TERRAIN),
+	wind_speed(10.0, wind_seed, RNG_STREAM_WIND_SPEED), // cell size - 10 seconds
+	wind_x(100.0, wind_seed, RNG_STREAM_WIND_X),
+	wind_z(100.0, wind_seed, RNG_STREAM_WIND_Z) {}
 
-		set_vertex_color(mars_mesh, i, color);
-	}
-
-	// Add normal noise
-	Noise3d x_noise(400.0f);
-	Noise3d y_noise(400.0f);
-	Noise3d z_noise(400.0f);
-	for (int i = 0; i < num_of_vertices(mars_mesh); i++) {
-		const float coef = 1 / 10.0f;
-		glm::vec3 normal = get_vertex_normal(mars_mesh, i);
-		glm::vec3 pos = get_vertex_coords(mars_mesh, i);
-
-		normal.x = normal.x + coef * x_noise.get_value(pos);
-		normal.y = normal.y + coef * y_noise.get_value(pos);
-		normal.z = normal.z + coef * z_noise.get_value(pos);
-		normal = glm::normalize(normal);
-
-		set_vertex_normal(mars_mesh, i, normal);
-	}
-
-	Model* mars_model = new Model(mars_mesh, GL_TRIANGLES);
-	Object* mars = new Object(mars_model, glm::dvec3(0.0, 0.0, 0.0), 0.1f, 2);
+Object* make_mars_object() {
+	Object* mars = new Object(NULL, glm::dvec3(0.0, 0.0, 0.0), 0.1f, 2);
 	mars->mass = MARS_MASS;
 
 	return mars;
 }
 
-Object* make_mars_near_object(Object* mars, Object* lander) {
-	Mesh* mars_flat_mesh = new Mesh;
-	glm::vec3 color = mars_surface_color(lander->position - mars->position);
-	*mars_flat_mesh = make_square_mesh(100, color.x, color.y, color.z);
-	transform_mesh(mars_flat_mesh, glm::scale(glm::dmat4(1.0), glm::dvec3(8.0, 1.0, 8.0))); // 20km x 20km
-
-	Model* mars_flat_model = new Model(mars_flat_mesh, GL_TRIANGLES);
-	Object* mars_flat = new Object(mars_flat_model, glm::dvec3(0.0, 0.0, 0.0), 0.1f, 2);
-
-	//update_mars_near_object(mars_flat, mars, lander);
-
-	return mars_flat;
+double mars_surface_height(Object* mars, MarsEnvironment* env, glm::dvec3 direction) {
+	if (glm::length(direction) < 1e-8) return MARS_RADIUS;
+	glm::dvec3 surface_pos = glm::normalize(glm::inverse(mars->attitude_matrix) * direction) * double(MARS_RADIUS);
+	return MARS_TERRAIN_AMPLITUDE * env->height_noise.get_value(surface_pos, MARS_TERRAIN_OCTAVES);
 }
 
-void update_mars_near_object(Object* near_mars, Object* mars, Object* lander) {
-	const glm::vec3 base_color = mars_surface_color(lander->position - mars->position);
-	Mesh* m = near_mars->model->mesh;
-
-	near_mars->position = glm::normalize(lander->position - mars->position) * double(MARS_RADIUS);
-	near_mars->orient_towards(lander->position - mars->position);
+void mars_surface_heights(Object* mars, MarsEnvironment* env, const glm::dvec3* directions, double* heights, size_t n) {
+	const glm::dmat3 inverse_attitude = glm::inverse(mars->attitude_matrix);
 
-	for (int i = 0; i < num_of_vertices(m); i++) {
-		glm::dvec3 coords = get_vertex_coords(m, i);
-		glm::dvec3 vertex_world_coords = near_mars->position + near_mars->attitude_matrix * coords;
+	std::vector<glm::vec3> surface_pos(n);
+	std::vector<float> noise(n);
+	for (size_t i = 0; i < n; i++) {
+		surface_pos[i] = glm::normalize(inverse_attitude * directions[i]) * double(MARS_RADIUS);
+	}
 
-		// Height
-		coords.y = mars_surface_height(mars, vertex_world_coords);
-		set_vertex_coords(m, i, coords);
+	env->height_noise.get_values(surface_pos.data(), noise.data(), n, MARS_TERRAIN_OCTAVES);
 
-		// Color
-		glm::vec3 color = base_color + glm::vec3(coords.y);
-		set_vertex_color(m, i, color);
+	for (size_t i = 0; i < n; i++) {
+		heights[i] = (glm::length(directions[i]) < 1e-8) ? MARS_RADIUS : MARS_TERRAIN_AMPLITUDE * noise[i];
 	}
-
-	near_mars->model->reload_mesh();
 }
 
-double mars_surface_height(Object* mars, glm::dvec3 direction) {
+// Attitude matrices are rotations, so the transpose is the inverse
+double mars_surface_height(Object* mars, MarsEnvironment* env, TerrainCache* cache, int level, glm::dvec3 direction) {
 	if (glm::length(direction) < 1e-8) return MARS_RADIUS;
-	static Noise3d height_noise(2.0f);
-	double noise_amplitude = 0.2;
-	glm::dvec3 surface_pos = glm::normalize(glm::inverse(mars->attitude_matrix) * direction) * double(MARS_RADIUS);
-	return noise_amplitude * height_noise.get_value(surface_pos, 3);
+	return cache->height(env, glm::transpose(mars->attitude_matrix) * direction, level);
 }
 
-glm::vec3 mars_surface_color(glm::dvec3 direction) {
-	glm::vec3 color = mars_base_color;
-	const glm::dvec3 surface_pos = glm::normalize(direction) * double(MARS_RADIUS);
-	const glm::vec3 ice_color(0.9f, 0.9f, 0.9f);
-	const float pole_y_threshold = 0.8 * MARS_RADIUS;
-
-	if (std::abs(surface_pos.y) >= pole_y_threshold) {
-		float coef = glm::clamp(10.0 * (std::abs(surface_pos.y) - pole_y_threshold) / pole_y_threshold, 0.0, 1.0);
+void mars_surface_heights(Object* mars, MarsEnvironment* env, TerrainCache* cache, int level, const glm::dvec3* directions, double* heights, size_t n) {
+	const glm::dmat3 inverse_attitude = glm::transpose(mars->attitude_matrix);
 
-		color.x = glm::clamp(color.x * (1.0f - coef) + ice_color.x * coef, 0.0f, 1.0f);
-		color.y = glm::clamp(color.y * (1.0f - coef) + ice_color.y * coef, 0.0f, 1.0f);
-		color.z = glm::clamp(color.z * (1.0f - coef) + ice_color.z * coef, 0.0f, 1.0f);
+	for (size_t i = 0; i < n; i++) {
+		if (glm::length(directions[i]) < 1e-8) heights[i] = MARS_RADIUS;
+		else heights[i] = cache->height(env, inverse_attitude * directions[i], level);
 	}
-
-	return color;
 }
 
 glm::dvec3 mars_surface_velocity(Object const* mars, glm::dvec3 pos) {
@@ -123,17 +68,13 @@ glm::dvec3 mars_surface_velocity(Object const* mars, glm::dvec3 pos) {
 	return glm::cross(mars->ang_velocity, surface_pos);
 }
 
-glm::dvec3 mars_wind_velocity(Object const* mars, glm::dvec3 pos, double time) {
+glm::dvec3 mars_wind_velocity(Object const* mars, MarsEnvironment* env, glm::dvec3 pos, double time) {
 	glm::dvec3 surface_pos = (double)MARS_RADIUS * glm::normalize(pos);
 
-	static Noise1d wind_speed(10.0); // cell size - 10 seconds
-	static Noise1d wind_x(100.0);
-	static Noise1d wind_z(100.0);
-
 	const double wind_speed_amplitude = 0.05; // 50 m/s
-	double wind_speed_val = wind_speed.get_value(time);
+	double wind_speed_val = env->wind_speed.get_value(time);
 	double actual_speed = wind_speed_amplitude * std::abs(wind_speed_val);
-	glm::dvec3 wind_dir = glm::dvec3(wind_x.get_value(time), 0.0, wind_z.get_value(time));
+	glm::dvec3 wind_dir = glm::dvec3(env->wind_x.get_value(time), 0.0, env->wind_z.get_value(time));
 	glm::dvec3 wind_velocity(0.0);
 
 	if (glm::length(wind_dir) < 1e-8) return mars_surface_velocity(mars, pos);
@@ -154,7 +95,7 @@ glm::dvec3 mars_wind_velocity(Object const* mars, glm::dvec3 pos, double time) {
 
 double mars_atm_density(Object const* mars, glm::dvec3 pos) {
 	double altitude = glm::length(pos - mars->position) - MARS_RADIUS;
-	if (altitude > 200.0) return 0.0;
+	if (altitude > MARS_ATMOSPHERE_HEIGHT) return 0.0;
 	return 0.017e9 * exp(-altitude / 11.0); // 0.017e9 kg/km^3
 }
 
@@ -3,23 +3,49 @@
 #define MARS_H
 
 #include "core/object.h"
+#include "noise.h"
 
 // Unit system: kilometer/kilogram/second
 // All forces are in kilonewtons (kilogram * kilometer / second^2)
 #define MARS_RADIUS 3386.0f // kilometers
 #define MARS_MASS 6.42e23 // kilograms
 #define MARS_DAY 88642.65f // seconds
+#define MARS_ATMOSPHERE_HEIGHT 200.0 // kilometers, no atmosphere above
+#define MARS_TERRAIN_AMPLITUDE 0.2 // kilometers per unit of height noise
+#define MARS_TERRAIN_OCTAVES 3
 
-Object* make_mars_object();                                  // Spherical low-detail mars object
-Object* make_mars_near_object(Object* mars, Object* lander); // Flat high-detail mars object
+// Random number streams (see CounterRng) of a simulation, drawn from its seeds
+#define RNG_STREAM_TERRAIN 1    // terrain_seed
+#define RNG_STREAM_WIND_SPEED 2 // wind_seed
+#define RNG_STREAM_WIND_X 3     // wind_seed
+#define RNG_STREAM_WIND_Z 4     // wind_seed
+#define RNG_STREAM_DEBRIS 5     // SimulationContext::rng_seed
+#define RNG_STREAM_CAMPAIGN_RUN(run) ((1ull << 32) + (run)) // campaign seed, dispersions of one run
 
-// Move the near-object under the lander
-void update_mars_near_object(Object* near_mars, Object* mars, Object* lander);
+// Noise generators describing the terrain & weather of one simulated Mars
+struct MarsEnvironment {
+	MarsEnvironment(); // random seeds
+	MarsEnvironment(unsigned int terrain_seed, unsigned int wind_seed);
 
-double mars_surface_height(Object* mars, glm::dvec3 direction); // Radius in the given direction from the center
+	unsigned int terrain_seed, wind_seed;
+	Noise3d height_noise;
+	Noise1d wind_speed, wind_x, wind_z;
+};
+
+class TerrainCache;
+
+Object* make_mars_object(); // Mars body with no model attached (physics only)
+
+// Rendering (defined in mars_model.cpp)
+Model* make_mars_model();                            // Spherical low-detail mars model (close views use TerrainLod)
 glm::vec3 mars_surface_color(glm::dvec3 direction);  // Color in the given direction from the center
+
+double mars_surface_height(Object* mars, MarsEnvironment* env, glm::dvec3 direction); // Radius in the given direction from the center
+void mars_surface_heights(Object* mars, MarsEnvironment* env, const glm::dvec3* directions, double* heights, size_t n); // Same for n directions at once
+double mars_surface_height(Object* mars, MarsEnvironment* env, TerrainCache* cache, int level, glm::dvec3 direction); // Same, interpolated from cached tiles
+void mars_surface_heights(Object* mars, MarsEnvironment* env, TerrainCache* cache, int level, const glm::dvec3* directions, double* heights, size_t n);
 glm::dvec3 mars_surface_velocity(Object const* mars, glm::dvec3 pos); // surface velocity under pos
-glm::dvec3 mars_wind_velocity(Object const* mars, glm::dvec3 pos, double time); // wind velocity at pos
+glm::dvec3 mars_wind_velocity(Object const* mars, MarsEnvironment* env, glm::dvec3 pos, double time); // wind velocity at pos
 
 // Returns atmosphere density at pos (in kg/km^3)
 double mars_atm_density(Object const* mars, glm::dvec3 pos);
@@ -0,0 +1,90 @@
+// Ricardas Navickas 2020
+#include "core/core.h"
+#include "mars.h"
+#include "noise.h"
+
+#include <cmath>
+#include <vector>
+
+static std::vector<glm::vec3> vertex_coords(Mesh* m);
+
+static const glm::vec3 mars_base_color(0.63f, 0.33f, 0.22f);
+
+Model* make_mars_model() {
+	Mesh* mars_mesh = new Mesh;
+	*mars_mesh = make_ico_sphere_mesh(4, mars_base_color.x, mars_base_color.y, mars_base_color.z);
+	transform_mesh(mars_mesh, glm::scale(glm::mat4(1.0), glm::vec3(MARS_RADIUS)));
+
+	// Base color
+	for (int i = 0; i < num_of_vertices(mars_mesh); i++) {
+		set_vertex_color(mars_mesh, i, mars_surface_color(get_vertex_coords(mars_mesh, i)));
+	}
+
+	// Noise is evaluated for all vertices at once
+	const std::vector<glm::vec3> coords = vertex_coords(mars_mesh);
+	std::vector<float> values(coords.size());
+
+	// Add color noise
+	Noise3d noise(400.0f); 
+	noise.get_values(coords.data(), values.data(), coords.size(), 2);
+	for (int i = 0; i < num_of_vertices(mars_mesh); i++) {
+		const float coef = 1 / 20.0f;
+		float val = values[i];
+
+		glm::vec3 color = get_vertex_color(mars_mesh, i);
+
+		color.x = glm::clamp(color.x + coef * val, 0.0f, 1.0f);
+		color.y = glm::clamp(color.y + coef * val, 0.0f, 1.0f);
+		color.z = glm::clamp(color.z + coef * val, 0.0f, 1.0f);
+
+		set_vertex_color(mars_mesh, i, color);
+	}
+
+	// Add normal noise
+	Noise3d x_noise(400.0f);
+	Noise3d y_noise(400.0f);
+	Noise3d z_noise(400.0f);
+	std::vector<float> x_values(coords.size()), y_values(coords.size()), z_values(coords.size());
+	x_noise.get_values(coords.data(), x_values.data(), coords.size(), 1);
+	y_noise.get_values(coords.data(), y_values.data(), coords.size(), 1);
+	z_noise.get_values(coords.data(), z_values.data(), coords.size(), 1);
+	for (int i = 0; i < num_of_vertices(mars_mesh); i++) {
+		const float coef = 1 / 10.0f;
+		glm::vec3 normal = get_vertex_normal(mars_mesh, i);
+
+		normal.x = normal.x + coef * x_values[i];
+		normal.y = normal.y + coef * y_values[i];
+		normal.z = normal.z + coef * z_values[i];
+		normal = glm::normalize(normal);
+
+		set_vertex_normal(mars_mesh, i, normal);
+	}
+
+	return new Model(mars_mesh, GL_TRIANGLES);
+}
+
+glm::vec3 mars_surface_color(glm::dvec3 direction) {
+	glm::vec3 color = mars_base_color;
+	const glm::dvec3 surface_pos = glm::normalize(direction) * double(MARS_RADIUS);
+	const glm::vec3 ice_color(0.9f, 0.9f, 0.9f);
+	const float pole_y_threshold = 0.8 * MARS_RADIUS;
+
+	if (std::abs(surface_pos.y) >= pole_y_threshold) {
+		float coef = glm::clamp(10.0 * (std::abs(surface_pos.y) - pole_y_threshold) / pole_y_threshold, 0.0, 1.0);
+
+		color.x = glm::clamp(color.x * (1.0f - coef) + ice_color.x * coef, 0.0f, 1.0f);
+		color.y = glm::clamp(color.y * (1.0f - coef) + ice_color.y * coef, 0.0f, 1.0f);
+		color.z = glm::clamp(color.z * (1.0f - coef) + ice_color.z * coef, 0.0f, 1.0f);
+	}
+
+	return color;
+}
+
+static std::vector<glm::vec3> vertex_coords(Mesh* m) {
+	std::vector<glm::vec3> coords(num_of_vertices(m));
+	for (unsigned int i = 0; i < coords.size(); i++) {
+		coords[i] = get_vertex_coords(m, i);
+	}
+
+	return coords;
+}
@@ -1,35 +1,85 @@
 // Ricardas Navickas 2020
 #include "noise.h"
+#include "core/state_blob.h"
 #include <cstdlib>
 #include <iostream>
 #include <cmath>
-#include <ctime>
+#include <random>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NOISE_AVX2
+#include <immintrin.h>
+#endif
 
 static int round(float x) {
 	return std::floor(x + 0.5f);
 }
 
+// Random float from -1.0 to 1.0 (in steps of 0.01) from 10 random bits
+static float gradient_component(uint32_t bits) {
+	return float(int(((bits & 1023) * 201) >> 10) - 100) / 100;
+}
+
+// Lattice point -> counter of the generator's stream
+static uint64_t lattice_index(int x, int y, int z) {
+	return (uint64_t)(uint32_t)x * 0x9e3779b97f4a7c15ull ^ (uint64_t)(uint32_t)y * 0xc2b2ae3d27d4eb4full ^ (uint64_t)(uint32_t)z * 0x165667b19e3779f9ull;
+}
+
+#ifdef NOISE_AVX2
+static size_t noise3d_kernel_avx2(const CounterRng& rng, float cell_size, const glm::vec3* pos, float* out, size_t n, int octaves);
+static bool cpu_has_avx2();
+#endif
+
 // ==== ==== 1D NOISE ==== ====
-Noise1d::Noise1d(float cs) {
-	srand(time(NULL));
+Noise1d::Noise1d(float cs) : rng(std::random_device()(), 0) {
+	cell_size = cs;
+}
+
+Noise1d::Noise1d(float cs, unsigned int seed, unsigned int stream) : rng(seed, stream) {
 	cell_size = cs;
 }
 
 Noise1d::~Noise1d() {}
 
-float Noise1d::get_value(float pos) {	
+float Noise1d::get_value(float pos) const {
+	return value(pos, cell_size);
+}
+
+float Noise1d::get_value(float pos, int n) const {
+	float val = 0.0f;
+	float cs = cell_size;
+
+	for (int i = 0; i < n; i++) {
+		val += value(pos, cs) / std::pow(2, i);
+		cs /= 2;
+	}
+
+	return val;
+}
+
+void Noise1d::save_state(StateWriter& w) const {
+	w.put(cell_size);
+	w.put(rng);
+}
+
+bool Noise1d::restore_state(StateReader& r) {
+	r.get(&cell_size);
+	r.get(&rng);
+
+	return !r.failed;
+}
+
+float Noise1d::value(float pos, float cs) const {
 	// Normalized position
-	float np = pos / cell_size;
+	float np = pos / cs;
 
 	// Coords of adjacent gradient vectors
 	int gc[2] = { round(std::floor(np)), round(std::floor(np + 1)) };
 
 	// Adjacent gradients
 	float g[2];
-	if (!gradient_exists(gc[0])) generate_gradient(gc[0]);
-	if (!gradient_exists(gc[1])) generate_gradient(gc[1]);
-	g[0] = gradients[gc[0]];
-	g[1] = gradients[gc[1]];
+	g[0] = gradient(gc[0]);
+	g[1] = gradient(gc[1]);
 
 	// Distance to gradient vectors
 	float dist[2];
@@ -52,40 +102,63 @@ float Noise1d::get_value(float pos) {
 	return interp;
 }
 
-float Noise1d::get_value(float pos, int n) {
+float Noise1d::gradient(int x) const {
+	return gradient_component(rng.at((uint32_t)x));
+}
+
+// ==== ==== 3D NOISE ==== ====
+Noise3d::Noise3d(float cs) : rng(std::random_device()(), 0) {
+	cell_size = cs;
+}
+
+Noise3d::Noise3d(float cs, unsigned int seed, unsigned int stream) : rng(seed, stream) {
+	cell_size = cs;
+}
+
+Noise3d::~Noise3d() {}
+
+float Noise3d::get_value(glm::vec3 pos) const {
+	return value(pos, cell_size);
+}
+
+float Noise3d::get_value(glm::vec3 pos, int n) const {
 	float val = 0.0f;
-	float old_cell_size = cell_size;
+	float cs = cell_size;
 
 	for (int i = 0; i < n; i++) {
-		val += get_value(pos) / std::pow(2, i);
-		cell_size /= 2;
+		val += value(pos, cs) / std::pow(2, i);
+		cs /= 2;
 	}
 
-	cell_size = old_cell_size;
 	return val;
 }
 
-bool Noise1d::gradient_exists(int x) {
-	return gradients.count(x) != 0;
-}
+void Noise3d::get_values(const glm::vec3* pos, float* out, size_t n, int octaves) const {
+	size_t done = 0;
+#ifdef NOISE_AVX2
+	if (cpu_has_avx2()) done = noise3d_kernel_avx2(rng, cell_size, pos, out, n, octaves);
+#endif
 
-void Noise1d::generate_gradient(int x) {
-	// random float from -1.0 to 1.0
-	float new_gradient = float((rand() % 201) - 100) / 100;
-	gradients[x] = new_gradient;
+	for (size_t i = done; i < n; i++) {
+		out[i] = get_value(pos[i], octaves);
+	}
 }
 
-// ==== ==== 3D NOISE ==== ====
-Noise3d::Noise3d(float cs) {
-	srand(time(NULL));
-	cell_size = cs;
+void Noise3d::save_state(StateWriter& w) const {
+	w.put(cell_size);
+	w.put(rng);
 }
 
-Noise3d::~Noise3d() {}
+bool Noise3d::restore_state(StateReader& r) {
+	r.get(&cell_size);
+	r.get(&rng);
 
-float Noise3d::get_value(glm::vec3 pos) {
+	return !r.failed;
+}
+
+float Noise3d::value(glm::vec3 pos, float cs) const {
 	// Convert position to normalized coords
-	glm::vec3 np = pos / cell_size;
+	glm::vec3 np = pos / cs;
 
 	// Coords of adjacent gradient vectors
 	int gc[8][3] = {
@@ -102,15 +175,7 @@ float Noise3d::get_value(glm::vec3 pos) {
 	// Adjacent gradient vectors
 	glm::vec3 g[8];
 	for (int i = 0; i < 8; i++) {
-		int x = gc[i][0];
-		int y = gc[i][1];
-		int z = gc[i][2];
-
-		if (!gradient_exists(x, y, z)) {
-			generate_gradient(x, y, z);
-		}
-
-		g[i] = gradients[x][y][z];
+		g[i] = gradient(gc[i][0], gc[i][1], gc[i][2]);
 	}
 
 	// Distance vectors
@@ -140,31 +205,153 @@ float Noise3d::get_value(glm::vec3 pos) {
 	return interp;
 }
 
-float Noise3d::get_value(glm::vec3 pos, int n) {
-	float val = 0.0f;
-	float old_cell_size = cell_size;
+// Components from three 10-bit fields of one random number
+glm::vec3 Noise3d::gradient(int x, int y, int z) const {
+	uint32_t bits = rng.at(lattice_index(x, y, z));
+	return glm::vec3(gradient_component(bits), gradient_component(bits >> 10), gradient_component(bits >> 20));
+}
 
-	for (int i = 0; i < n; i++) {
-		val += get_value(pos) / std::pow(2, i);
-		cell_size /= 2;
-	}
+// ==== ==== KERNELS ==== ====
 
-	cell_size = old_cell_size;
-	return val;
+#ifdef NOISE_AVX2
+// Low 64 bits of a * b in each 64-bit lane
+__attribute__((target("avx2")))
+static inline __m256i mul64_avx2(__m256i a, __m256i b) {
+	__m256i lo = _mm256_mul_epu32(a, b);
+	__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+	return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
 }
 
-bool Noise3d::gradient_exists(int x, int y, int z) {
-	return gradients[x][y].count(z) != 0;
+// x * x + y, halves swapped (one round of Squares)
+__attribute__((target("avx2")))
+static inline __m256i squares_round_avx2(__m256i x, __m256i y) {
+	__m256i lo = _mm256_mul_epu32(x, x);
+	__m256i cross = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), x);
+	x = _mm256_add_epi64(_mm256_add_epi64(lo, _mm256_slli_epi64(cross, 33)), y);
+	return _mm256_or_si256(_mm256_srli_epi64(x, 32), _mm256_slli_epi64(x, 32));
 }
 
-void Noise3d::generate_gradient(int x, int y, int z) {
-	glm::vec3 new_gradient;
+// rng.at(lattice_index(x, y, z)) for 4 lattice points (zero-extended 32-bit coordinates), in the low
+// halves of the lanes
+__attribute__((target("avx2")))
+static inline __m256i lattice_bits4_avx2(__m256i key, __m256i x, __m256i y, __m256i z) {
+	__m256i n = _mm256_xor_si256(_mm256_xor_si256(
+		mul64_avx2(x, _mm256_set1_epi64x(0x9e3779b97f4a7c15ull)),
+		mul64_avx2(y, _mm256_set1_epi64x(0xc2b2ae3d27d4eb4full))),
+		mul64_avx2(z, _mm256_set1_epi64x(0x165667b19e3779f9ull)));
+
+	// See CounterRng::at()
+	__m256i first = mul64_avx2(n, key);
+	__m256i second = _mm256_add_epi64(first, key);
+	__m256i r = squares_round_avx2(first, first);
+	r = squares_round_avx2(r, second);
+	r = squares_round_avx2(r, first);
+
+	__m256i lo = _mm256_mul_epu32(r, r);
+	__m256i cross = _mm256_mul_epu32(_mm256_srli_epi64(r, 32), r);
+	return _mm256_srli_epi64(_mm256_add_epi64(_mm256_add_epi64(lo, _mm256_slli_epi64(cross, 33)), second), 32);
+}
 
-	// random float from -1.0 to 1.0
-	new_gradient.x = float((rand() % 201) - 100) / 100;
-	new_gradient.y = float((rand() % 201) - 100) / 100;
-	new_gradient.z = float((rand() % 201) - 100) / 100;
+// Same for 8 lattice points
+__attribute__((target("avx2")))
+static inline __m256i lattice_bits_avx2(__m256i key, __m256i x, __m256i y, __m256i z) {
+	__m256i lo = lattice_bits4_avx2(key,
+		_mm256_cvtepu32_epi64(_mm256_castsi256_si128(x)),
+		_mm256_cvtepu32_epi64(_mm256_castsi256_si128(y)),
+		_mm256_cvtepu32_epi64(_mm256_castsi256_si128(z)));
+	__m256i hi = lattice_bits4_avx2(key,
+		_mm256_cvtepu32_epi64(_mm256_extracti128_si256(x, 1)),
+		_mm256_cvtepu32_epi64(_mm256_extracti128_si256(y, 1)),
+		_mm256_cvtepu32_epi64(_mm256_extracti128_si256(z, 1)));
+
+	// Gather the low halves of the lanes
+	const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	return _mm256_permute2x128_si256(_mm256_permutevar8x32_epi32(lo, even), _mm256_permutevar8x32_epi32(hi, even), 0x20);
+}
+
+// Same as Noise3d::get_value(pos[i], octaves), 8 positions at a time (the same operations in the same
+// order, so results match the scalar version). Returns number of positions processed (a multiple of 8).
+__attribute__((target("avx2")))
+static size_t noise3d_kernel_avx2(const CounterRng& rng, float cell_size, const glm::vec3* pos, float* out, size_t n, int octaves) {
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 hundred = _mm256_set1_ps(100.0f);
+	const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	const __m256i bits_mask = _mm256_set1_epi32(1023);
+	const __m256i bits_scale = _mm256_set1_epi32(201);
+	const __m256i bits_offset = _mm256_set1_epi32(100);
+
+	const __m256i key = _mm256_set1_epi64x(rng.key);
+
+	alignas(32) float px[8], py[8], pz[8];
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		for (int k = 0; k < 8; k++) {
+			px[k] = pos[i + k].x;
+			py[k] = pos[i + k].y;
+			pz[k] = pos[i + k].z;
+		}
+		const __m256 x = _mm256_load_ps(px);
+		const __m256 y = _mm256_load_ps(py);
+		const __m256 z = _mm256_load_ps(pz);
+
+		__m256 val = _mm256_setzero_ps();
+		float cs = cell_size;
+
+		for (int octave = 0; octave < octaves; octave++) {
+			// Normalized position & lattice cell
+			const __m256 vcs = _mm256_set1_ps(cs);
+			const __m256 nx = _mm256_div_ps(x, vcs);
+			const __m256 ny = _mm256_div_ps(y, vcs);
+			const __m256 nz = _mm256_div_ps(z, vcs);
+			const __m256i ix = _mm256_cvttps_epi32(_mm256_floor_ps(nx));
+			const __m256i iy = _mm256_cvttps_epi32(_mm256_floor_ps(ny));
+			const __m256i iz = _mm256_cvttps_epi32(_mm256_floor_ps(nz));
+
+			__m256 interp = _mm256_setzero_ps();
+			for (int corner = 0; corner < 8; corner++) {
+				const int ox = corner >> 2, oy = (corner >> 1) & 1, oz = corner & 1;
+
+				const __m256i gcx = _mm256_add_epi32(ix, _mm256_set1_epi32(ox));
+				const __m256i gcy = _mm256_add_epi32(iy, _mm256_set1_epi32(oy));
+				const __m256i gcz = _mm256_add_epi32(iz, _mm256_set1_epi32(oz));
+
+				// Gradient (see gradient_component())
+				const __m256i b = lattice_bits_avx2(key, gcx, gcy, gcz);
+				__m256i bx = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_and_si256(b, bits_mask), bits_scale), 10);
+				__m256i by = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(b, 10), bits_mask), bits_scale), 10);
+				__m256i bz = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(b, 20), bits_mask), bits_scale), 10);
+				const __m256 gx = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(bx, bits_offset)), hundred);
+				const __m256 gy = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(by, bits_offset)), hundred);
+				const __m256 gz = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(bz, bits_offset)), hundred);
+
+				// Distance to the lattice point
+				const __m256 dx = _mm256_sub_ps(nx, _mm256_cvtepi32_ps(gcx));
+				const __m256 dy = _mm256_sub_ps(ny, _mm256_cvtepi32_ps(gcy));
+				const __m256 dz = _mm256_sub_ps(nz, _mm256_cvtepi32_ps(gcz));
+
+				// Dot product & trilinear weight
+				const __m256 dp = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, gx), _mm256_mul_ps(dy, gy)), _mm256_mul_ps(dz, gz));
+				const __m256 wx = _mm256_sub_ps(one, _mm256_and_ps(dx, abs_mask));
+				const __m256 wy = _mm256_sub_ps(one, _mm256_and_ps(dy, abs_mask));
+				const __m256 wz = _mm256_sub_ps(one, _mm256_and_ps(dz, abs_mask));
+				const __m256 w = _mm256_mul_ps(_mm256_mul_ps(wx, wy), wz);
+
+				interp = _mm256_add_ps(interp, _mm256_mul_ps(w, dp));
+			}
+
+			val = _mm256_add_ps(val, _mm256_mul_ps(interp, _mm256_set1_ps(1.0f / (1 << octave))));
+			cs /= 2;
+		}
 
-	gradients[x][y][z] = new_gradient;
+		_mm256_storeu_ps(out + i, val);
+	}
+
+	return i;
 }
 
+static bool cpu_has_avx2() {
+	static const bool has_avx2 = __builtin_cpu_supports("avx2");
+	return has_avx2;
+}
+#endif
@@ -2,49 +2,69 @@
 #ifndef NOISE_H
 #define NOISE_H
 
-#include <map>
-#include "core/core.h"
+#include "core/glm/glm.hpp"
+#include "core/counter_rng.h"
+
+#include <cstddef>
+
+class StateWriter;
+class StateReader;
+
+// Gradient noise generators are stateless: the gradient at each lattice point is hashed from its
+// coordinates with the generator's random number stream, so values don't depend on what was queried
+// before and generators can be read from any number of threads at once.
 
 // 1-dimensional Perlin noise generator
 class Noise1d {
 public:
-	Noise1d(float cs);
+	Noise1d(float cs);                                         // random seed
+	Noise1d(float cs, unsigned int seed, unsigned int stream); // same seed & stream -> same noise
 	~Noise1d();
 
 	// Returns noise value at chosen position
-	float get_value(float pos);
-	float get_value(float pos, int n); // sum n octaves
+	float get_value(float pos) const;
+	float get_value(float pos, int n) const; // sum n octaves
+
+	// Seed & cell size
+	void save_state(StateWriter& w) const;
+	bool restore_state(StateReader& r);
 
 	// Distance between adjacent gradient vectors
 	float cell_size;
 
 private:
-	// 3d map of gradient vectors
-	std::map<int, float> gradients;
+	CounterRng rng;
 
-	bool gradient_exists(int x);
-	void generate_gradient(int x);
+	float value(float pos, float cs) const;
+	float gradient(int x) const;
 };
 
 // 3-dimensional Perlin noise generator
 class Noise3d {
 public:
-	Noise3d(float cs);
+	Noise3d(float cs);                                         // random seed
+	Noise3d(float cs, unsigned int seed, unsigned int stream); // same seed & stream -> same noise
 	~Noise3d();
 
 	// Returns noise value at chosen position
-	float get_value(glm::vec3 pos);
-	float get_value(glm::vec3 pos, int n); // sum n octaves
+	float get_value(glm::vec3 pos) const;
+	float get_value(glm::vec3 pos, int n) const; // sum n octaves
+
+	// out[i] = get_value(pos[i], octaves) for n positions, 8 at a time with AVX2 if the CPU supports it
+	void get_values(const glm::vec3* pos, float* out, size_t n, int octaves) const;
+
+	// Seed & cell size
+	void save_state(StateWriter& w) const;
+	bool restore_state(StateReader& r);
 
 	// Distance between adjacent gradient vectors
 	float cell_size;
 
 private:
-	// 3d map of gradient vectors
-	std::map<int, std::map<int, std::map<int, glm::vec3>>> gradients;
+	CounterRng rng;
 
-	bool gradient_exists(int x, int y, int z);
-	void generate_gradient(int x, int y, int z);
+	float value(glm::vec3 pos, float cs) const;
+	glm::vec3 gradient(int x, int y, int z) const;
 };
 
 #endif
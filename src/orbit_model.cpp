@@ -0,0 +1,38 @@
+// Ricardas Navickas 2020
+#include "core/core.h"
+#include "physics.h"
+
+#include <cmath>
+
+#define ORBIT_SEGMENTS 512 // lines per drawn conic (spaced evenly in true anomaly, so closest at periapsis)
+
+static GLuint empty_vertex_array = 0; // vertices come from gl_VertexID, but a VAO must be bound to draw
+
+void draw_orbit(Shader* shader, const OrbitElements& orbit, glm::dvec3 camera_pos, glm::vec4 color, double max_radius) {
+	const double e = orbit.eccentricity;
+	const double p = orbit.semi_latus_rectum;
+	if (p <= 0.0) return; // radial trajectory, no conic to draw
+
+	// Whole ellipse, or the part of an open orbit within max_radius (short of the asymptotes)
+	double anomaly_end = M_PI;
+	if (e >= 1.0 || p / (1.0 - e) > max_radius) {
+		const double cos_end = glm::clamp((p / max_radius - 1.0) / e, -1.0, 1.0);
+		anomaly_end = glm::min(std::acos(cos_end), e >= 1.0 ? std::acos(-1.0 / e) - 1e-6 : M_PI);
+	}
+
+	if (empty_vertex_array == 0) glGenVertexArrays(1, &empty_vertex_array);
+
+	shader->setmat4("model", glm::translate(glm::dmat4(1.0), orbit.focus - camera_pos));
+	shader->setf("semi_latus_rectum", p);
+	shader->setf("eccentricity", e);
+	shader->set3f("periapsis_dir", orbit.periapsis_dir.x, orbit.periapsis_dir.y, orbit.periapsis_dir.z);
+	shader->set3f("motion_dir", orbit.motion_dir.x, orbit.motion_dir.y, orbit.motion_dir.z);
+	shader->setf("anomaly_start", -anomaly_end);
+	shader->setf("anomaly_end", anomaly_end);
+	shader->seti("segments", ORBIT_SEGMENTS);
+	shader->set4f("color", color.r, color.g, color.b, color.a);
+
+	glBindVertexArray(empty_vertex_array);
+	glDrawArrays(GL_LINE_STRIP, 0, ORBIT_SEGMENTS + 1);
+	glBindVertexArray(0);
+}
@@ -3,37 +3,54 @@
 #include "core/graphics.h"
 #include "core/camera.h"
 #include "core/scene.h"
+#include "core/track_buffer.h"
 #include "core/error.h"
 #include "global.h"
 #include "gui.h"
 #include "simulation.h"
+#include "physics.h"
+
+#include <cmath>
+#include <vector>
 
 // Scene and camera objects not accessible outside of comp. unit
 static Scene* orbit_scene;
 static Camera* orbit_camera;
 
-static Object* lander_track;
+static TrackBuffer* lander_track;
 static Object* lander_indicator;
 
 static const glm::vec3 lander_track_color = glm::vec3(0.6f, 0.6f, 1.0f);
-static const int track_points = 1024; // number of points in track
-static const float track_update_period = 16.0f; // number of simulation-seconds between updates
+static const glm::vec4 orbit_color = glm::vec4(0.6f, 1.0f, 0.6f, 0.8f);
+static const glm::vec4 pinned_orbit_color = glm::vec4(0.6f, 1.0f, 0.6f, 0.3f);
+static const double orbit_max_radius = 40.0 * MARS_RADIUS; // open orbits are drawn out to here
+static const unsigned int track_points = 1 << 17; // number of points in track
+
+// A point is added to the track when the lander's velocity (relative to mars) has turned or changed
+// in magnitude by this much since the last point, so points are dense where the track curves (near
+// periapsis) or where the engine is firing, and sparse along the slow far side of an orbit
+static const double track_max_turn = glm::radians(0.5);
+static const double track_max_speed_change = 0.002; // fraction of speed
+static const double track_max_period = 300.0; // number of simulation-seconds between points at most
 static double dist_to_mars = 10 * MARS_RADIUS;
 
-static double last_update_time;
-static int prev_scenario = simstate.scenario_id;
+static std::vector<OrbitElements> pinned_orbits;
+
+static glm::dvec3 last_point_velocity;
+static double last_point_time;
+static unsigned int prev_generation;
 
 static void reset_lander_track();
 static void update_lander_track();
+static void draw_lander_track(Camera* camera, glm::mat4 view, glm::mat4 projection);
+static void draw_orbits(Camera* camera, glm::mat4 view, glm::mat4 projection);
 static void orbit_mouse_callback(GLFWwindow* w, double x, double y);
 static void orbit_scroll_callback(GLFWwindow* w, double x, double y);
 
 void init_orbit_scene(Shader* world_shader, Shader* light_shader) {
-	Mesh* lander_track_mesh = new Mesh;
-	lander_track_mesh->vertex_data.resize(VERTEX_DATA_LEN * track_points);
-	Model* lander_track_model = new Model(lander_track_mesh, GL_LINES);
-	lander_track = new Object(lander_track_model, glm::dvec3(0.0, 0.0, 0.0), 0.0f, 1);
+	lander_track = new TrackBuffer(track_points);
 	reset_lander_track();
+	prev_generation = sim_view.generation;
 
 	Mesh* lander_indicator_mesh = new Mesh;
 	*lander_indicator_mesh = make_uv_sphere_mesh(12, 6, lander_track_color.x, lander_track_color.y, lander_track_color.z);
@@ -43,9 +60,12 @@ void init_orbit_scene(Shader* world_shader, Shader* light_shader) {
 
 	orbit_camera = new Camera(glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, 0.0, -0.5), glm::dvec3(0.0, 1.0, 0.0), 45.0, 0.01);
 	orbit_scene = new Scene(orbit_camera, world_shader, light_shader);
-	orbit_scene->add_object(mars);
-	orbit_scene->add_nofx_object(lander_track);
+	orbit_scene->add_object(mars_view);
+	orbit_scene->add_render_callback(draw_lander_track);
+	orbit_scene->add_render_callback(draw_orbits);
 	orbit_scene->add_nofx_object(lander_indicator);
+	orbit_scene->add_nofx_object(predicted_path);
+	orbit_scene->add_nofx_object(predicted_impact);
 	orbit_scene->add_light(sun, glm::vec3(1.0f, 1.0f, 1.0f));
 	orbit_scene->render_wireframe = false;
 }
@@ -57,23 +77,18 @@ void activate_orbit_scene() {
 }
 
 void update_orbit_scene() {
-	// If scenario changed, reset the track
-	if (guistate.scenario_changed) {
+	// If the simulation jumped (scenario changed), reset the track
+	if (sim_view.generation != prev_generation) {
 		reset_lander_track();
-		prev_scenario = simstate.scenario_id;
-		last_update_time = simstate.time;
+		prev_generation = sim_view.generation;
 	}
 
-	// One update for each track_update_period that passed since last update
-	int track_updates = (simstate.time - last_update_time) / track_update_period;
-	for (int i = 0; i < track_updates; i++) update_lander_track();
-	set_vertex_coords(lander_track->model->mesh, 0, lander->position);
-	lander_track->model->reload_mesh();
+	update_lander_track();
 
-	lander_indicator->position = lander->position;
+	lander_indicator->position = lander_view->position;
 
 	// Update camera
-	orbit_camera->position = mars->position - dist_to_mars * orbit_camera->facing;
+	orbit_camera->position = mars_view->position - dist_to_mars * orbit_camera->facing;
 
 	orbit_camera->right.x = orbit_camera->facing.z;
 	orbit_camera->right.y = 0;
@@ -84,39 +99,60 @@ void update_orbit_scene() {
 }
 
 static void update_lander_track() {
-	Mesh* m = lander_track->model->mesh; // Alias for convenience
+	const glm::dvec3 velocity = lander_view->velocity - mars_view->velocity;
+
+	const double speed = glm::length(velocity);
+	const double last_speed = glm::length(last_point_velocity);
+	const double turn = (speed > 0.0 && last_speed > 0.0)
+	                    ? std::acos(glm::clamp(glm::dot(velocity, last_point_velocity) / (speed * last_speed), -1.0, 1.0))
+	                    : 0.0;
+
+	if (turn > track_max_turn || std::abs(speed - last_speed) > track_max_speed_change * last_speed
+	    || sim_view.state.time - last_point_time > track_max_period) {
+		lander_track->add_point(lander_view->position);
+		last_point_velocity = velocity;
+		last_point_time = sim_view.state.time;
+	}
 
-	// Shift all point coordinates in track by 1
-	for (unsigned int i = num_of_vertices(m) - 1; i > 0; i--)
-		set_vertex_coords(m, i, get_vertex_coords(m, i - 1));
+	// The track ends at the lander
+	lander_track->set_end(lander_view->position);
+}
 
-	// Insert new point into front of list
-	set_vertex_coords(m, 0, lander->position);
+static void reset_lander_track() {
+	lander_track->clear();
+	lander_track->add_point(lander_view->position);
+	last_point_velocity = lander_view->velocity - mars_view->velocity;
+	last_point_time = sim_view.state.time;
+}
 
-	lander_track->model->reload_mesh();
+static void draw_lander_track(Camera* camera, glm::mat4 view, glm::mat4 projection) {
+	track_shader->use();
+	track_shader->setmat4("view", view);
+	track_shader->setmat4("projection", projection);
 
-	last_update_time = simstate.time;
-	prev_scenario = simstate.scenario_id;
+	lander_track->draw(track_shader, camera->position, lander_track_color);
 }
 
-static void reset_lander_track() {
-	Mesh* m = lander_track->model->mesh;
+void pin_current_orbit() {
+	pinned_orbits.push_back(orbit_elements(mars_view, lander_view));
+}
 
-	for (int i = 0; i < track_points; i++) {
-		float alpha_multiplier = 1.0f - 1.0f * float(i) / track_points;
+void clear_pinned_orbits() {
+	pinned_orbits.clear();
+}
 
-		set_vertex_coords(m, i, lander->position);
-		set_vertex_normal(m, i, glm::vec3(alpha_multiplier, 0.0f, 0.0f));
-		set_vertex_color(m, i, lander_track_color);
+// The conics are generated by the shader, so any number of them cost only a few uniforms each
+static void draw_orbits(Camera* camera, glm::mat4 view, glm::mat4 projection) {
+	orbit_shader->use();
+	orbit_shader->setmat4("view", view);
+	orbit_shader->setmat4("projection", projection);
 
-		// Indices
-		if (i != track_points - 1) {
-			m->indices.push_back(i);
-			m->indices.push_back(i + 1);
-		}
+	for (unsigned int i = 0; i < pinned_orbits.size(); i++) {
+		draw_orbit(orbit_shader, pinned_orbits[i], camera->position, pinned_orbit_color, orbit_max_radius);
 	}
 
-	lander_track->model->reload_mesh();
+	if (!sim_view.state.landed && !sim_view.state.crashed)
+		draw_orbit(orbit_shader, orbit_elements(mars_view, lander_view), camera->position, orbit_color, orbit_max_radius);
 }
 
 static void orbit_mouse_callback(GLFWwindow* w, double xpos, double ypos) {
@@ -12,4 +12,8 @@ void activate_orbit_scene();
 // Updates the camera
 void update_orbit_scene();
 
+// Keeps drawing the lander's current orbit, for comparison with later ones
+void pin_current_orbit();
+void clear_pinned_orbits();
+
 #endif
@@ -2,14 +2,29 @@
 #include "physics.h"
 #include "mars.h"
 
+#include <cmath>
+#include <algorithm>
+
+static double stumpff_c(double z);
+static double stumpff_s(double z);
+static double mean_anomaly(double e, double nu);
+
 glm::dvec3 grav_force(Object const* obj1, Object const* obj2) {
-	glm::dvec3 dist = obj1->position - obj2->position;
-	double dist_squared = glm::dot(dist, dist);
-	return glm::normalize(dist) * GRAVITY * obj1->mass * obj2->mass / dist_squared;
+	return grav_force(obj1, obj2->position, obj2->mass);
 }
 
 glm::dvec3 drag_force(Object const* obj, glm::dvec3 air_vel, double air_density, double drag_coef, double frontal_area) {
-	glm::dvec3 relvel = obj->velocity - air_vel; // relative velocity
+	return drag_force(obj->velocity, air_vel, air_density, drag_coef, frontal_area);
+}
+
+glm::dvec3 grav_force(Object const* primary, glm::dvec3 position, double mass) {
+	glm::dvec3 dist = primary->position - position;
+	double dist_squared = glm::dot(dist, dist);
+	return glm::normalize(dist) * GRAVITY * primary->mass * mass / dist_squared;
+}
+
+glm::dvec3 drag_force(glm::dvec3 velocity, glm::dvec3 air_vel, double air_density, double drag_coef, double frontal_area) {
+	glm::dvec3 relvel = velocity - air_vel; // relative velocity
 
 	if (glm::length(relvel) <= 1e-8)
 		return glm::dvec3(0.0f);
@@ -44,3 +59,118 @@ double apoapsis_radius(Object const* primary, Object const* secondary) {
 	return orbit_semi_major_axis(primary, secondary) * (1 + orbit_eccentricity(primary, secondary));
 }
 
+OrbitElements orbit_elements(Object const* primary, Object const* secondary) {
+	const double mu = GRAVITY * primary->mass;
+	glm::dvec3 r = secondary->position - primary->position;
+	glm::dvec3 v = secondary->velocity - primary->velocity;
+	glm::dvec3 h = glm::cross(r, v); // specific angular momentum
+
+	OrbitElements orbit;
+	orbit.semi_major_axis = orbit_semi_major_axis(primary, secondary);
+	orbit.eccentricity = orbit_eccentricity(primary, secondary);
+	if (!(orbit.eccentricity >= 0.0)) orbit.eccentricity = 0.0; // rounding (circular orbit)
+	orbit.semi_latus_rectum = glm::dot(h, h) / mu;
+	orbit.focus = primary->position;
+
+	// Towards periapsis along the eccentricity vector (any direction will do for a circle)
+	glm::dvec3 e = ((glm::dot(v, v) - mu / glm::length(r)) * r - glm::dot(r, v) * v) / mu;
+	orbit.periapsis_dir = (glm::length(e) > 1e-9) ? glm::normalize(e) : glm::normalize(r);
+	orbit.motion_dir = glm::normalize(glm::cross(h, orbit.periapsis_dir));
+	orbit.true_anomaly = atan2(glm::dot(r, orbit.motion_dir), glm::dot(r, orbit.periapsis_dir));
+
+	return orbit;
+}
+
+double time_to_true_anomaly(const OrbitElements& orbit, double mu, double true_anomaly) {
+	const double e = orbit.eccentricity;
+	const double a = std::abs(orbit.semi_major_axis);
+	const double mean_motion = sqrt(mu / (a * a * a));
+
+	double delta = mean_anomaly(e, true_anomaly) - mean_anomaly(e, orbit.true_anomaly);
+
+	if (e < 1.0) {
+		// Next time round
+		delta = fmod(delta, 2.0 * M_PI);
+		if (delta <= 0.0) delta += 2.0 * M_PI;
+		return delta / mean_motion;
+	}
+
+	// Open orbit: only once, between the asymptotes
+	if (std::abs(true_anomaly) >= acos(-1.0 / e)) return -1.0;
+	return (delta > 0.0) ? delta / mean_motion : -1.0;
+}
+
+void kepler_propagate(Object const* primary, Object const* secondary, double delta_time, glm::dvec3& position, glm::dvec3& velocity) {
+	const double mu = GRAVITY * primary->mass;
+	const double sqrt_mu = sqrt(mu);
+
+	glm::dvec3 r0 = secondary->position - primary->position;
+	glm::dvec3 v0 = secondary->velocity - primary->velocity;
+	double r0_len = glm::length(r0);
+	double vr0 = glm::dot(r0, v0) / r0_len;           // radial velocity
+	double alpha = 1.0 / orbit_semi_major_axis(primary, secondary); // < 0 for hyperbolic orbits
+
+	// Solve the universal Kepler equation for the universal anomaly chi (Newton's method)
+	double chi = (std::abs(alpha) > 1e-12) ? sqrt_mu * std::abs(alpha) * delta_time : sqrt_mu * delta_time / r0_len;
+
+	for (int i = 0; i < 50; i++) {
+		double chi2 = chi * chi;
+		double z = alpha * chi2;
+		double c = stumpff_c(z);
+		double s = stumpff_s(z);
+
+		double f = r0_len * vr0 / sqrt_mu * chi2 * c + (1.0 - alpha * r0_len) * chi2 * chi * s + r0_len * chi - sqrt_mu * delta_time;
+		double df = r0_len * vr0 / sqrt_mu * chi * (1.0 - z * s) + (1.0 - alpha * r0_len) * chi2 * c + r0_len;
+
+		double step = f / df;
+		chi -= step;
+		if (std::abs(step) <= 1e-12 * std::max(1.0, std::abs(chi))) break;
+	}
+
+	// Lagrange coefficients
+	double chi2 = chi * chi;
+	double z = alpha * chi2;
+	double c = stumpff_c(z);
+	double s = stumpff_s(z);
+
+	double f = 1.0 - chi2 / r0_len * c;
+	double g = delta_time - chi2 * chi * s / sqrt_mu;
+	glm::dvec3 r = f * r0 + g * v0;
+	double r_len = glm::length(r);
+
+	double f_dot = sqrt_mu / (r_len * r0_len) * (z * s - 1.0) * chi;
+	double g_dot = 1.0 - chi2 / r_len * c;
+
+	position = primary->position + r;
+	velocity = primary->velocity + f_dot * r0 + g_dot * v0;
+}
+
+// Mean anomaly at true anomaly nu (the hyperbolic one for open orbits)
+static double mean_anomaly(double e, double nu) {
+	if (e < 1.0) {
+		double ecc_anomaly = 2.0 * atan2(sqrt(1.0 - e) * sin(0.5 * nu), sqrt(1.0 + e) * cos(0.5 * nu));
+		return ecc_anomaly - e * sin(ecc_anomaly);
+	}
+
+	double hyp_anomaly = 2.0 * atanh(sqrt((e - 1.0) / (e + 1.0)) * tan(0.5 * nu));
+	return e * sinh(hyp_anomaly) - hyp_anomaly;
+}
+
+// Stumpff functions C(z) and S(z) (series near z = 0 to avoid cancellation)
+static double stumpff_c(double z) {
+	if (z > 1e-6) return (1.0 - cos(sqrt(z))) / z;
+	if (z < -1e-6) return (cosh(sqrt(-z)) - 1.0) / (-z);
+	return 1.0 / 2.0 - z / 24.0;
+}
+
+static double stumpff_s(double z) {
+	if (z > 1e-6) {
+		double sz = sqrt(z);
+		return (sz - sin(sz)) / (sz * sz * sz);
+	}
+	if (z < -1e-6) {
+		double sz = sqrt(-z);
+		return (sinh(sz) - sz) / (sz * sz * sz);
+	}
+	return 1.0 / 6.0 - z / 120.0;
+}
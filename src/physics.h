@@ -8,6 +8,8 @@
 
 glm::dvec3 grav_force(Object const* primary, Object const* secondary); // grav. force acting on secondary
 glm::dvec3 drag_force(Object const* obj, glm::dvec3 air_vel, double air_density, double drag_coef, double frontal_area); // air_vel is relative to origin
+glm::dvec3 grav_force(Object const* primary, glm::dvec3 position, double mass); // same, for a body that is not an Object
+glm::dvec3 drag_force(glm::dvec3 velocity, glm::dvec3 air_vel, double air_density, double drag_coef, double frontal_area);
 
 double orbit_energy(Object const* primary, Object const* secondary);
 double orbit_semi_major_axis(Object const* primary, Object const* secondary);
@@ -15,4 +17,30 @@ double orbit_eccentricity(Object const* primary, Object const* secondary);
 double periapsis_radius(Object const* primary, Object const* secondary);
 double apoapsis_radius(Object const* primary, Object const* secondary);
 
+// Osculating two-body orbit (conic) of a secondary around a primary
+struct OrbitElements {
+	double semi_major_axis;   // < 0 for hyperbolic orbits
+	double eccentricity;
+	double semi_latus_rectum; // a (1 - e^2), radius = p / (1 + e cos(true anomaly))
+	glm::dvec3 focus;         // primary's position
+	glm::dvec3 periapsis_dir; // orbit plane: unit vector towards periapsis,
+	glm::dvec3 motion_dir;    // and unit vector 90 degrees ahead of it (direction of motion at periapsis)
+	double true_anomaly;      // of secondary (radians, -pi - pi)
+};
+
+OrbitElements orbit_elements(Object const* primary, Object const* secondary);
+
+// Time (s) until the secondary next passes true_anomaly along its conic (mu is G * primary mass).
+// Returns -1 if it never will (beyond an open orbit's asymptotes, or already passed on it).
+double time_to_true_anomaly(const OrbitElements& orbit, double mu, double true_anomaly);
+
+// Two-body propagation of secondary along its conic by delta_time (universal variable Kepler solver).
+// Returns the new position & velocity; secondary itself is not modified.
+void kepler_propagate(Object const* primary, Object const* secondary, double delta_time, glm::dvec3& position, glm::dvec3& velocity);
+
+// Rendering (defined in orbit_model.cpp)
+// Draws the conic as a line strip generated in the vertex shader (see shaders/orbit.v.glsl), which must be
+// in use with view & projection set. Open orbits are drawn out to max_radius.
+void draw_orbit(Shader* shader, const OrbitElements& orbit, glm::dvec3 camera_pos, glm::vec4 color, double max_radius);
+
 #endif
@@ -1,5 +1,6 @@
 // Ricardas Navickas 2020
 #include "pid.h"
+#include "core/state_blob.h"
 
 PIDController::PIDController(double Kp, double Ki, double Kd) {
 	this->Kp = Kp;
@@ -31,3 +32,24 @@ double PIDController::output() {
 	return Kp * error + Ki * error_integral + Kd * error_derivative;
 }
 
+void PIDController::save_state(StateWriter& w) const {
+	w.put(Kp);
+	w.put(Ki);
+	w.put(Kd);
+	w.put(prev_error);
+	w.put(error);
+	w.put(error_integral);
+	w.put(error_derivative);
+}
+
+bool PIDController::restore_state(StateReader& r) {
+	r.get(&Kp);
+	r.get(&Ki);
+	r.get(&Kd);
+	r.get(&prev_error);
+	r.get(&error);
+	r.get(&error_integral);
+	r.get(&error_derivative);
+
+	return !r.failed;
+}
@@ -2,6 +2,9 @@
 #ifndef PID_H
 #define PID_H
 
+class StateWriter;
+class StateReader;
+
 class PIDController {
 public:
 	PIDController(double Kp, double Ki, double Kd);
@@ -12,6 +15,10 @@ public:
 	void update(double dt, double err);
 	double output();
 
+	// Gains and integrator state
+	void save_state(StateWriter& w) const;
+	bool restore_state(StateReader& r);
+
 	double Kp, Ki, Kd;
 
 private:
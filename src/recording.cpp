@@ -0,0 +1,219 @@
+// Ricardas Navickas 2020
+#include "recording.h"
+#include "simulation.h"
+#include "autopilot.h"
+#include "core/error.h"
+
+#include <cstdio>
+#include <cstring>
+
+#define RECORDING_MAGIC "LREC"
+#define RECORDING_VERSION 5 // 2 - counter-based random number streams, 3 - stateless noise, 4 - cached terrain heights, 5 - coasts to events
+
+static StepInputs current_inputs(SimulationContext* ctx);
+static bool same_inputs(const StepInputs& a, const StepInputs& b);
+static InputRecord& record_for_current_step(Recording* rec);
+
+template <typename T> static void write_value(FILE* f, const T& value);
+template <typename T> static bool read_value(FILE* f, T* value);
+
+void start_recording(SimulationContext* ctx) {
+	Recording& rec = ctx->recording;
+
+	rec.scenario_id = ctx->state.scenario_id;
+	rec.custom_lander_pos = ctx->state.custom_lander_pos;
+	rec.custom_lander_vel = ctx->state.custom_lander_vel;
+	rec.terrain_seed = ctx->env.terrain_seed;
+	rec.wind_seed = ctx->env.wind_seed;
+	rec.rng_seed = ctx->rng_seed;
+
+	rec.records.clear();
+	rec.steps = 0;
+
+	// A program that is already loaded carries on into the new recording
+	if (ctx->ap.loaded) record_autopilot_load(ctx, ctx->ap.path);
+}
+
+void record_step_inputs(SimulationContext* ctx) {
+	Recording& rec = ctx->recording;
+	StepInputs inputs = current_inputs(ctx);
+
+	if (!rec.records.empty() && same_inputs(rec.records.back().inputs, inputs)) return;
+
+	record_for_current_step(&rec).inputs = inputs;
+}
+
+void record_autopilot_load(SimulationContext* ctx, std::string path) {
+	InputRecord& record = record_for_current_step(&ctx->recording);
+
+	record.inputs = current_inputs(ctx);
+	record.autopilot_path = path;
+}
+
+bool save_recording(SimulationContext* ctx, std::string path) {
+	Recording& rec = ctx->recording;
+
+	FILE* f = fopen(path.c_str(), "wb");
+	if (f == NULL) {
+		error("save_recording()", "Cannot open " + path + " for writing");
+		return false;
+	}
+
+	rec.end_time = ctx->state.time;
+	rec.end_position = ctx->lander->position;
+	rec.end_velocity = ctx->lander->velocity;
+
+	fwrite(RECORDING_MAGIC, 1, 4, f);
+	write_value(f, (int)RECORDING_VERSION);
+	write_value(f, rec.scenario_id);
+	write_value(f, rec.custom_lander_pos);
+	write_value(f, rec.custom_lander_vel);
+	write_value(f, rec.terrain_seed);
+	write_value(f, rec.wind_seed);
+	write_value(f, rec.rng_seed);
+	write_value(f, rec.steps);
+	write_value(f, rec.end_time);
+	write_value(f, rec.end_position);
+	write_value(f, rec.end_velocity);
+
+	write_value(f, (unsigned int)rec.records.size());
+	for (unsigned int i = 0; i < rec.records.size(); i++) {
+		const InputRecord& record = rec.records[i];
+
+		write_value(f, record.step);
+		write_value(f, record.inputs.control_input);
+		write_value(f, record.inputs.autopilot_active);
+		write_value(f, record.inputs.coast_to_events);
+		write_value(f, record.inputs.paused);
+		write_value(f, record.inputs.integrator);
+		write_value(f, record.inputs.timestep);
+		write_value(f, (unsigned int)record.autopilot_path.size());
+		fwrite(record.autopilot_path.data(), 1, record.autopilot_path.size(), f);
+	}
+
+	bool ok = !ferror(f);
+	fclose(f);
+
+	if (!ok) error("save_recording()", "Failed to write " + path);
+	return ok;
+}
+
+bool load_recording(Recording* rec, std::string path) {
+	FILE* f = fopen(path.c_str(), "rb");
+	if (f == NULL) {
+		error("load_recording()", "Cannot open " + path);
+		return false;
+	}
+
+	char magic[4];
+	int version = 0;
+	bool ok = fread(magic, 1, 4, f) == 4 && memcmp(magic, RECORDING_MAGIC, 4) == 0;
+	ok = ok && read_value(f, &version) && version == RECORDING_VERSION;
+	if (!ok) {
+		error("load_recording()", path + " is not a recording (or was made by another version)");
+		fclose(f);
+		return false;
+	}
+
+	unsigned int num_of_records = 0;
+	ok = read_value(f, &rec->scenario_id) && read_value(f, &rec->custom_lander_pos) && read_value(f, &rec->custom_lander_vel)
+	     && read_value(f, &rec->terrain_seed) && read_value(f, &rec->wind_seed) && read_value(f, &rec->rng_seed)
+	     && read_value(f, &rec->steps) && read_value(f, &rec->end_time) && read_value(f, &rec->end_position)
+	     && read_value(f, &rec->end_velocity) && read_value(f, &num_of_records);
+
+	rec->records.clear();
+	for (unsigned int i = 0; ok && i < num_of_records; i++) {
+		InputRecord record;
+		unsigned int path_length = 0;
+
+		ok = read_value(f, &record.step) && read_value(f, &record.inputs.control_input)
+		     && read_value(f, &record.inputs.autopilot_active) && read_value(f, &record.inputs.coast_to_events) && read_value(f, &record.inputs.paused)
+		     && read_value(f, &record.inputs.integrator) && read_value(f, &record.inputs.timestep)
+		     && read_value(f, &path_length);
+
+		if (ok) {
+			record.autopilot_path.resize(path_length);
+			ok = fread(&record.autopilot_path[0], 1, path_length, f) == path_length;
+		}
+
+		rec->records.push_back(record);
+	}
+
+	fclose(f);
+
+	if (!ok) error("load_recording()", path + " is truncated");
+	return ok;
+}
+
+SimulationContext* make_replay_context(const Recording& rec) {
+	double timestep = rec.records.empty() ? 1.0 : rec.records[0].inputs.timestep;
+	SimulationContext* ctx = new SimulationContext(timestep, rec.terrain_seed, rec.wind_seed);
+
+	ctx->rng_seed = rec.rng_seed;
+	ctx->state.custom_lander_pos = rec.custom_lander_pos;
+	ctx->state.custom_lander_vel = rec.custom_lander_vel;
+	set_scenario(ctx, rec.scenario_id);
+
+	return ctx;
+}
+
+void apply_recorded_inputs(SimulationContext* ctx, const Recording& rec, long step, unsigned int* next_record) {
+	for (; *next_record < rec.records.size() && rec.records[*next_record].step <= step; (*next_record)++) {
+		const InputRecord& record = rec.records[*next_record];
+
+		if (record.autopilot_path != "") {
+			free_autopilot_program(&ctx->ap);
+			ctx->ap = make_autopilot_program(ctx, record.autopilot_path);
+		}
+
+		ctx->state.control_input = record.inputs.control_input;
+		ctx->state.autopilot_active = record.inputs.autopilot_active;
+		ctx->state.coast_to_events = record.inputs.coast_to_events;
+		ctx->state.paused = record.inputs.paused;
+		ctx->state.integrator = record.inputs.integrator;
+		set_timestep(ctx, record.inputs.timestep);
+	}
+}
+
+bool replay_matches(SimulationContext* ctx, const Recording& rec) {
+	return memcmp(&ctx->state.time, &rec.end_time, sizeof(double)) == 0
+	       && memcmp(&ctx->lander->position, &rec.end_position, sizeof(glm::dvec3)) == 0
+	       && memcmp(&ctx->lander->velocity, &rec.end_velocity, sizeof(glm::dvec3)) == 0;
+}
+
+static StepInputs current_inputs(SimulationContext* ctx) {
+	StepInputs inputs;
+
+	inputs.control_input = ctx->state.control_input;
+	inputs.autopilot_active = ctx->state.autopilot_active;
+	inputs.coast_to_events = ctx->state.coast_to_events;
+	inputs.paused = ctx->state.paused;
+	inputs.integrator = ctx->state.integrator;
+	inputs.timestep = ctx->state.timestep;
+
+	return inputs;
+}
+
+static bool same_inputs(const StepInputs& a, const StepInputs& b) {
+	return a.control_input == b.control_input && a.autopilot_active == b.autopilot_active && a.coast_to_events == b.coast_to_events && a.paused == b.paused
+	       && a.integrator == b.integrator && a.timestep == b.timestep;
+}
+
+// Changes made while paused all apply before the same step, so they are merged into one record
+static InputRecord& record_for_current_step(Recording* rec) {
+	if (rec->records.empty() || rec->records.back().step != rec->steps) {
+		InputRecord record = InputRecord();
+		record.step = rec->steps;
+		rec->records.push_back(record);
+	}
+
+	return rec->records.back();
+}
+
+template <typename T> static void write_value(FILE* f, const T& value) {
+	fwrite(&value, sizeof(T), 1, f);
+}
+
+template <typename T> static bool read_value(FILE* f, T* value) {
+	return fread(value, sizeof(T), 1, f) == 1;
+}
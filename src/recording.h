@@ -0,0 +1,66 @@
+// Ricardas Navickas 2020
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include "core/glm/glm.hpp"
+#include <vector>
+#include <string>
+
+class SimulationContext;
+
+// Front-end inputs that steer a simulation, as seen at the start of a step
+struct StepInputs {
+	unsigned int control_input; // CONTROL_* flags
+	bool autopilot_active;
+	bool coast_to_events;
+	bool paused;
+	int integrator;
+	double timestep;
+};
+
+struct InputRecord {
+	long step;                  // applies before this step (counted from the start of the recording, paused steps don't count)
+	StepInputs inputs;
+	std::string autopilot_path; // if not empty, the autopilot program is (re)loaded from here before the step
+};
+
+// Everything needed to re-run a flight bit-exactly: the scenario, all seeds and every change of inputs.
+// Every SimulationContext keeps one, restarted by set_scenario(); only changes are stored, so it stays
+// small however long the flight is.
+// NOTE: an autopilot program is replayed from its file, starting with fresh Lua globals
+struct Recording {
+	int scenario_id;
+	glm::dvec3 custom_lander_pos;
+	glm::dvec3 custom_lander_vel;
+	unsigned int terrain_seed;
+	unsigned int wind_seed;
+	unsigned int rng_seed;
+
+	std::vector<InputRecord> records;
+	long steps; // steps taken so far
+
+	// State at the end (filled in by save_recording()), to check replays against
+	double end_time;
+	glm::dvec3 end_position;
+	glm::dvec3 end_velocity;
+};
+
+// Called by the simulation itself
+void start_recording(SimulationContext* ctx);                           // from set_scenario()
+void record_step_inputs(SimulationContext* ctx);                        // at the start of every step
+void record_autopilot_load(SimulationContext* ctx, std::string path);   // when a program is loaded
+
+// Binary file, returns false (and reports an error) on failure
+bool save_recording(SimulationContext* ctx, std::string path);
+bool load_recording(Recording* rec, std::string path);
+
+// Replay: make_replay_context() sets up the recorded scenario and seeds, then for every step from 0 to
+// rec.steps - 1 call apply_recorded_inputs() followed by simulation_coast() (up to the next record) or
+// simulation_step()
+SimulationContext* make_replay_context(const Recording& rec);
+void apply_recorded_inputs(SimulationContext* ctx, const Recording& rec, long step, unsigned int* next_record);
+
+// True if ctx ended in exactly (bit for bit) the recorded end state
+bool replay_matches(SimulationContext* ctx, const Recording& rec);
+
+#endif
@@ -0,0 +1,84 @@
+// Ricardas Navickas 2020
+#include "rewind.h"
+#include "simulation.h"
+#include "checkpoint.h"
+#include "recording.h"
+
+#include <utility>
+
+RewindBuffer::RewindBuffer() {
+	keyframe_interval = 0;
+	max_bytes = 0;
+	bytes = 0;
+}
+
+void update_rewind_buffer(SimulationContext* ctx) {
+	RewindBuffer& rb = ctx->rewind;
+	const long step = ctx->recording.steps;
+
+	if (rb.keyframe_interval <= 0) return;
+	if (!rb.keyframes.empty() && step - rb.keyframes.back().step < rb.keyframe_interval) return;
+
+	RewindKeyframe keyframe;
+	keyframe.step = step;
+	keyframe.time = ctx->state.time;
+
+	// Reuse the memory of the oldest keyframe if it has to go anyway
+	if (!rb.keyframes.empty() && rb.bytes + rb.keyframes.back().checkpoint.size() > rb.max_bytes) {
+		keyframe.checkpoint = std::move(rb.keyframes.front().checkpoint);
+		rb.bytes -= keyframe.checkpoint.size();
+		rb.keyframes.pop_front();
+	}
+
+	save_checkpoint(ctx, &keyframe.checkpoint);
+	rb.bytes += keyframe.checkpoint.size();
+	rb.keyframes.push_back(std::move(keyframe));
+
+	while (rb.keyframes.size() > 1 && rb.bytes > rb.max_bytes) {
+		rb.bytes -= rb.keyframes.front().checkpoint.size();
+		rb.keyframes.pop_front();
+	}
+}
+
+void clear_rewind_buffer(RewindBuffer* rb) {
+	rb->keyframes.clear();
+	rb->bytes = 0;
+}
+
+double rewind_start_time(SimulationContext* ctx) {
+	return ctx->rewind.keyframes.empty() ? -1.0 : ctx->rewind.keyframes.front().time;
+}
+
+bool rewind_to(SimulationContext* ctx, double time) {
+	RewindBuffer& rb = ctx->rewind;
+
+	// Last keyframe at or before time
+	int k = rb.keyframes.size() - 1;
+	while (k >= 0 && rb.keyframes[k].time > time) k--;
+	if (k < 0) return false;
+
+	// The keyframe's recording ends at the keyframe, the current one has the inputs after it
+	const Recording rec = ctx->recording;
+	const long keyframe_step = rb.keyframes[k].step;
+	if (!restore_checkpoint(ctx, rb.keyframes[k].checkpoint.data(), rb.keyframes[k].checkpoint.size())) return false;
+
+	while (rb.keyframes.size() > (unsigned int)k + 1) {
+		rb.bytes -= rb.keyframes.back().checkpoint.size();
+		rb.keyframes.pop_back();
+	}
+
+	unsigned int next_record = 0;
+	while (next_record < rec.records.size() && rec.records[next_record].step < keyframe_step) next_record++;
+
+	// Simulating forward records the same inputs again and takes the same keyframes
+	while (ctx->state.time < time && ctx->recording.steps < rec.steps) {
+		const long step = ctx->recording.steps;
+
+		apply_recorded_inputs(ctx, rec, step, &next_record);
+		simulation_step(ctx);
+
+		if (ctx->recording.steps == step) break; // paused
+	}
+
+	return true;
+}
@@ -0,0 +1,42 @@
+// Ricardas Navickas 2020
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <deque>
+#include <vector>
+#include <cstddef>
+
+class SimulationContext;
+
+// Checkpoint taken at the end of a step
+struct RewindKeyframe {
+	long step;   // recording.steps at the time
+	double time;
+	std::vector<char> checkpoint;
+};
+
+// Recent history of a simulation, for going back in time. Only every keyframe_interval-th step is
+// checkpointed; the inputs of the steps in between are in the recording, so any of them can be rebuilt
+// (bit-exactly) by restoring the keyframe before it and simulating forward.
+// Disabled by default, the front-end sets keyframe_interval & max_bytes.
+struct RewindBuffer {
+	RewindBuffer();
+
+	long keyframe_interval; // steps between keyframes (0 - disabled)
+	size_t max_bytes;       // the oldest keyframes are dropped to stay below this
+
+	std::deque<RewindKeyframe> keyframes; // oldest first
+	size_t bytes;                         // taken by keyframes
+};
+
+void update_rewind_buffer(SimulationContext* ctx); // from simulation_step()
+void clear_rewind_buffer(RewindBuffer* rb);        // on discontinuities (set_scenario(), restored checkpoint)
+
+// Earliest time that can be rewound to (< 0 if none)
+double rewind_start_time(SimulationContext* ctx);
+
+// Goes back to the first step that ends at or after time (within the history). The history after it is
+// dropped, as the flight continues differently from there.
+bool rewind_to(SimulationContext* ctx, double time);
+
+#endif
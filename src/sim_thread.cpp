@@ -0,0 +1,169 @@
+// Ricardas Navickas 2020
+#include "sim_thread.h"
+
+#include <chrono>
+
+#define SNAPSHOT_INDEX 3
+#define SNAPSHOT_NEW 4
+
+typedef std::chrono::steady_clock Clock;
+
+static double wall_seconds();
+static ObjectSnapshot take_snapshot(const Object* obj);
+static ObjectSnapshot interpolate(const ObjectSnapshot& a, const ObjectSnapshot& b, double alpha);
+
+SimulationThread::SimulationThread(SimulationContext* c, double tick_rate) {
+	ctx = c;
+	tick_length = 1.0 / tick_rate;
+	stopping = false;
+	access_requests = 0;
+	steps_per_tick = 1.0;
+	generation = 0;
+	last_published_time = ctx->state.time;
+
+	back = 0;
+	middle = 1;
+	front = 2;
+	have_snapshot = false;
+	publish(0.0);
+
+	thread = std::thread(&SimulationThread::loop, this);
+}
+
+SimulationThread::~SimulationThread() {
+	stopping = true;
+	thread.join();
+}
+
+void SimulationThread::lock() {
+	access_requests++;
+	ctx_lock.lock();
+}
+
+void SimulationThread::unlock() {
+	access_requests--;
+	ctx_lock.unlock();
+	access_done.notify_all();
+}
+
+void SimulationThread::set_steps_per_tick(double steps) {
+	steps_per_tick = steps;
+}
+
+void SimulationThread::reset_interpolation() {
+	generation++;
+	last_published_time = ctx->state.time;
+}
+
+const SimulationSnapshot& SimulationThread::get_view() {
+	if (middle & SNAPSHOT_NEW) {
+		front = middle.exchange(front) & SNAPSHOT_INDEX;
+
+		prev = (have_snapshot && buffers[front].generation == curr.generation) ? curr : buffers[front];
+		curr = buffers[front];
+		have_snapshot = true;
+	}
+
+	// Go from prev to curr over the time it took the simulation to get from one to the other,
+	// starting when curr was published
+	double interval = curr.wall_time - prev.wall_time;
+	double alpha = (interval > 0.0) ? (wall_seconds() - curr.wall_time) / interval : 1.0;
+	alpha = glm::clamp(alpha, 0.0, 1.0);
+
+	view = curr;
+	view.state.time = prev.state.time + alpha * (curr.state.time - prev.state.time);
+	view.mars = interpolate(prev.mars, curr.mars, alpha);
+	view.lander = interpolate(prev.lander, curr.lander, alpha);
+	for (unsigned int i = 0; i < view.debris.size() && i < prev.debris.size(); i++) {
+		view.debris[i] = interpolate(prev.debris[i], curr.debris[i], alpha);
+	}
+	view.ground_height = prev.ground_height + alpha * (curr.ground_height - prev.ground_height);
+
+	return view;
+}
+
+void SimulationThread::loop() {
+	Clock::time_point next_tick = Clock::now();
+	const Clock::duration tick = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(tick_length));
+	double pending_steps = 0.0;
+
+	while (!stopping) {
+		next_tick += tick;
+		Clock::time_point begin = Clock::now();
+
+		{
+			std::lock_guard<std::mutex> guard(ctx_lock);
+			pending_steps += steps_per_tick;
+		}
+
+		while (pending_steps >= 1.0 && Clock::now() < next_tick) {
+			std::unique_lock<std::mutex> guard(ctx_lock);
+			access_done.wait(guard, [this] { return access_requests == 0; });
+
+			simulation_step(ctx);
+			pending_steps -= 1.0;
+		}
+
+		// Couldn't keep up: drop the backlog instead of falling further behind
+		if (pending_steps >= 1.0) pending_steps = 0.0;
+
+		{
+			std::unique_lock<std::mutex> guard(ctx_lock);
+			access_done.wait(guard, [this] { return access_requests == 0; });
+			publish(std::chrono::duration<double>(Clock::now() - begin).count());
+		}
+
+		// Overran the tick: start the next one now rather than trying to catch up
+		if (Clock::now() > next_tick) next_tick = Clock::now();
+		std::this_thread::sleep_until(next_tick);
+	}
+}
+
+void SimulationThread::publish(double busy_time) {
+	SimulationSnapshot& s = buffers[back];
+
+	s.wall_time = wall_seconds();
+	s.generation = generation;
+	s.state = ctx->state;
+	s.lander_state = ctx->lander->state;
+	s.mars = take_snapshot(ctx->mars);
+	s.lander = take_snapshot(ctx->lander);
+
+	s.debris.resize(ctx->lander_debris.size());
+	for (unsigned int i = 0; i < ctx->lander_debris.size(); i++) {
+		s.debris[i] = take_snapshot(ctx->lander_debris[i]);
+	}
+	s.ground_height = MARS_RADIUS + mars_surface_height(ctx->mars, &ctx->env, &ctx->terrain, TERRAIN_PHYSICS_LEVEL, ctx->lander->position - ctx->mars->position);
+
+	s.busy_time = busy_time;
+	s.speed = glm::max(0.0, (ctx->state.time - last_published_time) / tick_length);
+	last_published_time = ctx->state.time;
+
+	back = middle.exchange(back | SNAPSHOT_NEW) & SNAPSHOT_INDEX;
+}
+
+static double wall_seconds() {
+	return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+}
+
+static ObjectSnapshot take_snapshot(const Object* obj) {
+	ObjectSnapshot s;
+
+	s.position = obj->position;
+	s.velocity = obj->velocity;
+	s.attitude = glm::quat_cast(obj->attitude_matrix);
+	s.ang_velocity = obj->ang_velocity;
+
+	return s;
+}
+
+static ObjectSnapshot interpolate(const ObjectSnapshot& a, const ObjectSnapshot& b, double alpha) {
+	ObjectSnapshot s;
+
+	s.position = glm::mix(a.position, b.position, alpha);
+	s.velocity = glm::mix(a.velocity, b.velocity, alpha);
+	s.attitude = glm::slerp(a.attitude, b.attitude, alpha);
+	s.ang_velocity = glm::mix(a.ang_velocity, b.ang_velocity, alpha);
+
+	return s;
+}
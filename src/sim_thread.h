@@ -0,0 +1,87 @@
+// Ricardas Navickas 2020
+#ifndef SIM_THREAD_H
+#define SIM_THREAD_H
+
+#include "simulation.h"
+#include "core/glm/gtc/quaternion.hpp"
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Pose of one simulated object
+struct ObjectSnapshot {
+	glm::dvec3 position;
+	glm::dvec3 velocity;
+	glm::dquat attitude;
+	glm::dvec3 ang_velocity;
+};
+
+// Everything the renderer needs from the simulation at one point in time
+struct SimulationSnapshot {
+	double wall_time;        // s (steady clock) when the snapshot was published
+	unsigned int generation; // changes on discontinuities (e.g. scenario switch); no interpolation across them
+
+	SimulationState state;
+	LanderState lander_state;
+	ObjectSnapshot mars;
+	ObjectSnapshot lander;
+	std::vector<ObjectSnapshot> debris; // same order as SimulationContext::lander_debris
+	double ground_height;               // km from mars' center to the terrain under the lander (so the renderer needn't sample it)
+
+	double busy_time; // wall time spent stepping during the last tick
+	double speed;     // simulated seconds per wall-clock second over the last tick
+};
+
+// Steps a simulation on its own thread at a fixed tick rate, independently of the frame rate.
+// Each tick runs as many steps as requested (dropping the backlog if they don't fit in the tick)
+// and publishes a snapshot through a triple buffer. The renderer interpolates between the last
+// two snapshots, so it shows the simulation one tick late but moving smoothly.
+class SimulationThread {
+public:
+	SimulationThread(SimulationContext* ctx, double tick_rate);
+	~SimulationThread();
+
+	// Blocks the simulation thread (between steps) so that the context can be read and modified.
+	// The simulation thread yields to waiting callers, so they don't starve while it's time-warping.
+	void lock();
+	void unlock();
+
+	// Must hold lock()
+	void set_steps_per_tick(double steps); // may be fractional
+	void reset_interpolation();            // call after making the state jump (e.g. set_scenario())
+
+	// Render thread only: state interpolated between the last two snapshots at the current time
+	const SimulationSnapshot& get_view();
+
+private:
+	void loop();
+	void publish(double busy_time); // must hold ctx_lock
+
+	SimulationContext* ctx;
+	std::thread thread;
+	std::atomic<bool> stopping;
+	double tick_length; // s
+
+	// Guarded by ctx_lock
+	std::mutex ctx_lock;
+	std::condition_variable access_done;
+	std::atomic<int> access_requests;
+	double steps_per_tick;
+	unsigned int generation;
+	double last_published_time; // sim time of the last snapshot
+
+	// Triple buffer: the simulation writes buffers[back], the renderer reads buffers[front]
+	// and they swap with the middle one, whose index (and a new snapshot flag) is in 'middle'
+	SimulationSnapshot buffers[3];
+	std::atomic<int> middle;
+	int back, front;
+
+	// Render thread only
+	SimulationSnapshot prev, curr, view;
+	bool have_snapshot;
+};
+
+#endif
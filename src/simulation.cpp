@@ -3,138 +3,384 @@
 #include "physics.h"
 #include "mars.h"
 #include "lander.h"
-#include "gui.h"
-#include "core/graphics.h"
 #include "core/error.h"
-#include "global.h"
 #include "autopilot.h"
 
-SimulationState simstate;
+#include <cmath>
+#include <algorithm>
+#include <random>
 
-// Lander autopilot
-static AutopilotProgram* ap;
+static const int num_of_debris = 3;
 
-static void process_lander_control_input();
-static bool should_update_scenario();
-static void set_scenario(int id);
+static const double dopri5_abs_tolerance = 1e-8;
+static const double dopri5_rel_tolerance = 1e-10;
 
-void init_simulation(double physics_timestep) {
-	simstate.time = 0.0;
-	simstate.timestep = physics_timestep;
-	simstate.scenario_id = guistate.selected_scenario;
-	simstate.me_manual_control = false;
-	simstate.rcs_manual_control = false;
-	simstate.paused = false;
-	simstate.landed = false;
-	simstate.crashed = false;
+static void apply_control_input(SimulationContext* ctx);
+static glm::dvec3 lander_environment_force(SimulationContext* ctx, double time, glm::dvec3 position, glm::dvec3 velocity);
+static void advance_lander(SimulationContext* ctx, glm::dvec3 engine_force);
+static bool coast_lander(SimulationContext* ctx);
+static double landed_distance(SimulationContext* ctx);
+static void handle_surface_contact(SimulationContext* ctx);
+static glm::dvec3 random_direction(SimulationContext* ctx);
 
-	ap = &guistate.ap;
+SimulationContext::SimulationContext(double physics_timestep, int scenario_id) :
+	SimulationContext(physics_timestep, std::random_device()(), std::random_device()()) {
+	set_scenario(this, scenario_id);
+}
 
-	set_scenario(simstate.scenario_id);
+SimulationContext::SimulationContext(double physics_timestep, unsigned int terrain_seed, unsigned int wind_seed) :
+	lander_dopri5(dopri5_abs_tolerance, dopri5_rel_tolerance),
+	lander_yoshida(4),
+	env(terrain_seed, wind_seed),
+	terrain(1 << 20),
+	rng(1, RNG_STREAM_DEBRIS) {
+	state.time = 0.0;
+	state.timestep = physics_timestep;
+	state.integrator = INTEGRATOR_VERLET;
+	state.on_rails = false;
+	state.scenario_id = -1; // none until set_scenario()
+	state.custom_lander_pos = glm::dvec3(0.0);
+	state.custom_lander_vel = glm::dvec3(0.0);
+	state.me_manual_control = false;
+	state.rcs_manual_control = false;
+	state.control_input = 0;
+	state.autopilot_active = false;
+	state.coast_to_events = false;
+	state.paused = false;
+	state.landed = false;
+	state.crashed = false;
+	state.touchdown_speed = -1.0;
+
+	ap.path = "";
+	ap.loaded = false;
+	ap.L = NULL;
+
+	rng_seed = 1;
+
+	lander = make_lander_object();
+	mars = make_mars_object();
+	event_detectors = make_default_event_detectors();
+
+	for (int i = 0; i < num_of_debris; i++) {
+		lander_debris.push_back(new Object(NULL, glm::dvec3(0.0), 1.0f, 128));
+	}
 }
 
-void add_sim_object(Object* obj) {
-	for (unsigned int i = 0; i < simstate.obj.size(); i++) {
-		if (simstate.obj[i] == obj) return;
+SimulationContext::~SimulationContext() {
+	free_autopilot_program(&ap);
+
+	delete lander;
+	delete mars;
+
+	for (unsigned int i = 0; i < lander_debris.size(); i++) {
+		delete lander_debris[i];
 	}
+}
 
-	simstate.obj.push_back(obj);
+void add_sim_object(SimulationContext* ctx, Object* obj) {
+	for (unsigned int i = 0; i < ctx->obj.size(); i++) {
+		if (ctx->obj[i] == obj) return;
+	}
+
+	ctx->obj.push_back(obj);
 }
 
-void remove_sim_object(Object* obj) {
-	for (unsigned int i = 0; i < simstate.obj.size(); i++) {
-		if (simstate.obj[i] == obj) simstate.obj.erase(simstate.obj.begin() + i);
+void remove_sim_object(SimulationContext* ctx, Object* obj) {
+	for (unsigned int i = 0; i < ctx->obj.size(); i++) {
+		if (ctx->obj[i] == obj) ctx->obj.erase(ctx->obj.begin() + i);
 	}
 }
 
-void simulation_step() {
-	// Change scenario if requested
-	if (should_update_scenario()) set_scenario(guistate.selected_scenario);
+void simulation_step(SimulationContext* ctx) {
+	SimulationState& simstate = ctx->state;
+	Lander* lander = ctx->lander;
+	Object* mars = ctx->mars;
+
+	record_step_inputs(ctx);
 
 	// If paused, do nothing
 	if (simstate.paused) return;
-
-	// If below or at Mars' surface
-	const double landed_dist = BASE_COM_DIST + MARS_RADIUS + mars_surface_height(mars, lander->position - mars->position); // distance between mars & lander objects when landed
-	if (glm::length(lander->position - mars->position) <= landed_dist) {
-		lander->position = glm::normalize(lander->position - mars->position) * landed_dist;
-		lander->reset_integrator();
-
-		if (soft_landing(lander)) {
-			simstate.paused = true;
-			simstate.landed = true;
-			cut_parachute(lander);
-		} else if (simstate.crashed) {
-			simstate.paused = true;
-			cut_parachute(lander);
-		} else {
-			lander->model = lander_crashed_model;
-			lander->velocity += glm::normalize(lander->position - mars->position) * descent_rate(lander, mars) * 1.05;
-			lander->ang_velocity = glm::dvec3(2.0, 0.0, 0.0);
-			lander->reset_integrator();
-			simstate.crashed = true;
-
-			// Add debris objects
-			for (unsigned int i = 0; i < lander_debris.size(); i++) {
-				glm::dvec3 velocity_diff = 0.5 * descent_rate(lander, mars) * glm::normalize(glm::dvec3(rand(), rand(), rand()));
-
-				lander_debris[i]->position = lander->position;
-				lander_debris[i]->velocity = lander->velocity + velocity_diff;
-				lander_debris[i]->ang_velocity = 10.0 * glm::normalize(glm::dvec3(rand(), rand(), rand()));
-				lander_debris[i]->net_force = grav_force(mars, lander_debris[i]);
-				lander_debris[i]->reset_integrator();
-
-				add_sim_object(lander_debris[i]);
-			}
-		}
+	ctx->recording.steps++;
+
+	// If below or at Mars' surface (the previous step normally ends exactly at the surface contact event)
+	const bool near_surface = glm::length(lander->position - mars->position) - MARS_RADIUS <= MARS_ATMOSPHERE_HEIGHT;
+	const bool contact_event = !ctx->event_log.empty() && ctx->event_log.back().type == EVENT_SURFACE_CONTACT && ctx->event_log.back().time == simstate.time;
+	if (contact_event || (near_surface && glm::length(lander->position - mars->position) <= landed_distance(ctx))) {
+		handle_surface_contact(ctx);
+		if (simstate.paused) return;
 	}
 
 	// Setup forces
 	lander->net_force = glm::dvec3(0.0);
 	lander->net_moment = glm::dvec3(0.0);
-	lander->net_force += grav_force(mars, lander);
-	lander->net_force += drag_force(lander, mars_wind_velocity(mars, lander->position, simstate.time), mars_atm_density(mars, lander->position), 1.0, lander->attribute["frontal_area"]);
+	const glm::dvec3 environment_force = lander_environment_force(ctx, simstate.time, lander->position, lander->velocity);
+	lander->net_force += environment_force;
+
+	// Lander control (the mass and attitude it starts the step with are kept in case the step is cut short)
+	const double start_mass = lander->mass;
+	const double start_moment_of_inertia = lander->moment_of_inertia;
+	const double start_fuel_level = lander->state.fuel_level;
+	const glm::dmat3 start_attitude = lander->attitude_matrix;
+	const glm::dvec3 start_ang_velocity = lander->ang_velocity;
 
-	// Lander control
-	lander->attribute["rcs_throttle"] = 0.0;
+	lander->state.rcs_throttle = 0.0;
 	if (!simstate.crashed) {
-		if (guistate.autopilot_active && ap->loaded) run_autopilot_program(ap);
-		if (!guistate.lock_manual_controls) process_lander_control_input();
+		if (simstate.autopilot_active && ctx->ap.loaded) run_autopilot_program(ctx);
+		apply_control_input(ctx);
 		fire_engines(lander, simstate.timestep);
 	}
 
-	// Update lander and mars objects
+	// Update mars and lander objects
+	const glm::dmat3 mars_start_attitude = mars->attitude_matrix;
+	const glm::dvec3 start_position = lander->position;
+	const glm::dvec3 start_velocity = lander->velocity;
+
 	mars->update(simstate.timestep);
-	lander->update(simstate.timestep);
 
-	// Update all other objects
-	for (unsigned int i = 0; i < simstate.obj.size(); i++) {
-		simstate.obj[i]->update(simstate.timestep);
+	simstate.on_rails = !simstate.crashed && coast_lander(ctx);
+	if (!simstate.on_rails) {
+		if (simstate.integrator == INTEGRATOR_VERLET) {
+			lander->update(simstate.timestep);
+		} else {
+			advance_lander(ctx, lander->net_force - environment_force);
+		}
+	}
+
+	// Find events within the step; a terminal event (e.g. touchdown) cuts the step short, so that it
+	// can be handled at the start of the next one
+	EventRecord event;
+	const double step_duration = locate_events(ctx, simstate.time, start_position, start_velocity, simstate.timestep, &event);
+
+	if (step_duration < simstate.timestep) {
+		// Rotate mars only as far as the event
+		mars->attitude_matrix = mars_start_attitude;
+		mars->reset_integrator();
+		mars->update(step_duration);
+
+		// Likewise burn fuel and turn the lander only as far as the event
+		lander->mass = start_mass;
+		lander->moment_of_inertia = start_moment_of_inertia;
+		lander->state.fuel_level = start_fuel_level;
+		if (!simstate.crashed) burn_fuel(lander, step_duration);
+
+		lander->attitude_matrix = start_attitude;
+		lander->ang_velocity = start_ang_velocity;
+		lander->update_attitude(step_duration);
+	}
+
+	// Update debris & test bodies (all at once) and all other objects over the same time
+	ctx->bodies.step(step_duration, mars->position, GRAVITY * mars->mass);
+	for (unsigned int i = 0; i < ctx->obj.size(); i++) {
+		ctx->obj[i]->update(step_duration);
+	}
+
+	simstate.time += step_duration;
+
+	if (step_duration < simstate.timestep) {
+		// Verlet history assumes a constant timestep
+		mars->reset_integrator();
+		ctx->bodies.reset_integrator();
+		for (unsigned int i = 0; i < ctx->obj.size(); i++) {
+			ctx->obj[i]->reset_integrator();
+		}
+	}
+
+	update_rewind_buffer(ctx);
+}
+
+long simulation_coast(SimulationContext* ctx, long max_steps) {
+	SimulationState& simstate = ctx->state;
+	Lander* lander = ctx->lander;
+	Object* mars = ctx->mars;
+
+	// Only if nothing could change the lander's course before the event
+	if (!simstate.coast_to_events || simstate.paused || simstate.crashed) return 0;
+	if (simstate.autopilot_active || simstate.control_input != 0 || lander->state.me_throttle != 0.0) return 0;
+	if (ctx->bodies.size() > 0) return 0;
+	if (glm::length(lander->position - mars->position) - MARS_RADIUS <= MARS_ATMOSPHERE_HEIGHT) return 0;
+
+	const double mu = GRAVITY * mars->mass;
+	const OrbitElements orbit = orbit_elements(mars, lander);
+	if (std::abs(orbit.eccentricity - 1.0) < 1e-6) return 0; // (near parabolic, anomalies are ill-conditioned)
+
+	// Next event: periapsis, apoapsis or atmosphere entry (if the periapsis is in it)
+	std::vector<double> event_times;
+	event_times.push_back(time_to_true_anomaly(orbit, mu, 0.0));
+	event_times.push_back(time_to_true_anomaly(orbit, mu, M_PI));
+
+	const double atmosphere_radius = MARS_RADIUS + MARS_ATMOSPHERE_HEIGHT;
+	if (orbit.semi_latus_rectum / (1.0 + orbit.eccentricity) < atmosphere_radius) {
+		const double entry = acos(glm::clamp((orbit.semi_latus_rectum / atmosphere_radius - 1.0) / orbit.eccentricity, -1.0, 1.0));
+		event_times.push_back(time_to_true_anomaly(orbit, mu, -entry));
+	}
+
+	// Stop a whole step short of it, so that simulation_step() locates it as usual
+	long steps = max_steps;
+	for (unsigned int i = 0; i < event_times.size(); i++) {
+		if (event_times[i] >= 0.0) steps = std::min(steps, (long)std::floor(event_times[i] / simstate.timestep) - 1);
+	}
+	if (steps < 1) return 0;
+
+	record_step_inputs(ctx);
+	ctx->recording.steps += steps;
+
+	const double duration = steps * simstate.timestep;
+
+	// Whole revolutions make no difference (and would slow the solver down)
+	double solve_duration = duration;
+	if (orbit.eccentricity < 1.0) solve_duration = fmod(duration, 2.0 * M_PI * sqrt(pow(orbit.semi_major_axis, 3) / mu));
+
+	glm::dvec3 position, velocity;
+	kepler_propagate(mars, lander, solve_duration, position, velocity);
+	mars->update(duration);
+
+	lander->position = position;
+	lander->velocity = velocity;
+	lander->state.rcs_throttle = 0.0;
+	lander->net_force = lander_environment_force(ctx, simstate.time + duration, position, velocity);
+	lander->net_moment = glm::dvec3(0.0);
+	lander->acceleration = lander->net_force / lander->mass;
+	lander->update_attitude(duration);
+
+	for (unsigned int i = 0; i < ctx->obj.size(); i++) {
+		ctx->obj[i]->update(duration);
+	}
+
+	simstate.time += duration;
+	simstate.on_rails = true;
+
+	// Verlet history assumes a constant timestep
+	mars->reset_integrator();
+	lander->reset_integrator();
+	for (unsigned int i = 0; i < ctx->obj.size(); i++) {
+		ctx->obj[i]->reset_integrator();
+	}
+
+	update_rewind_buffer(ctx);
+	return steps;
+}
+
+// Distance between mars & lander objects when landed (at the lander's current position)
+static double landed_distance(SimulationContext* ctx) {
+	Object* mars = ctx->mars;
+	return BASE_COM_DIST + MARS_RADIUS + mars_surface_height(mars, &ctx->env, &ctx->terrain, TERRAIN_PHYSICS_LEVEL, ctx->lander->position - mars->position);
+}
+
+// Lander has reached the surface: land, crash or (after a crash) stop
+static void handle_surface_contact(SimulationContext* ctx) {
+	SimulationState& simstate = ctx->state;
+	Lander* lander = ctx->lander;
+	Object* mars = ctx->mars;
+	std::vector<Object*>& lander_debris = ctx->lander_debris;
+
+	if (simstate.touchdown_speed < 0.0)
+		simstate.touchdown_speed = glm::length(lander->velocity - mars_surface_velocity(mars, lander->position));
+
+	lander->position = glm::normalize(lander->position - mars->position) * landed_distance(ctx);
+	lander->reset_integrator();
+
+	if (soft_landing(lander, mars)) {
+		simstate.paused = true;
+		simstate.landed = true;
+		cut_parachute(lander);
+	} else if (simstate.crashed) {
+		simstate.paused = true;
+		cut_parachute(lander);
+	} else {
+		lander->velocity += glm::normalize(lander->position - mars->position) * descent_rate(lander, mars) * 1.05;
+		lander->ang_velocity = glm::dvec3(2.0, 0.0, 0.0);
+		lander->reset_integrator();
+		simstate.crashed = true;
+
+		// Add debris objects
+		for (unsigned int i = 0; i < lander_debris.size(); i++) {
+			glm::dvec3 velocity_diff = 0.5 * descent_rate(lander, mars) * random_direction(ctx);
+
+			int body = ctx->bodies.add_body(lander->position, lander->velocity + velocity_diff, lander_debris[i]->mass, lander_debris[i]);
+			ctx->bodies.set_attitude(body, lander_debris[i]->attitude_matrix);
+			ctx->bodies.set_ang_velocity(body, 10.0 * random_direction(ctx));
+		}
+	}
+}
+
+// Gravity & aerodynamic drag acting on the lander in the given state
+static glm::dvec3 lander_environment_force(SimulationContext* ctx, double time, glm::dvec3 position, glm::dvec3 velocity) {
+	Object* mars = ctx->mars;
+	Lander* lander = ctx->lander;
+
+	glm::dvec3 force = grav_force(mars, position, lander->mass);
+
+	double air_density = mars_atm_density(mars, position);
+	if (air_density > 0.0) force += drag_force(velocity, mars_wind_velocity(mars, &ctx->env, position, time), air_density, 1.0, lander->state.frontal_area);
+
+	return force;
+}
+
+// Integrates lander position over one simulation step with the selected (non-Verlet) integrator.
+// Engine forces are held constant over the step, gravity & drag are re-evaluated at every stage.
+static void advance_lander(SimulationContext* ctx, glm::dvec3 engine_force) {
+	Lander* lander = ctx->lander;
+	const double mass = lander->mass;
+
+	AccelerationFunction acceleration = [ctx, engine_force, mass](double time, glm::dvec3 position, glm::dvec3 velocity) {
+		return (lander_environment_force(ctx, time, position, velocity) + engine_force) / mass;
+	};
+
+	lander->acceleration = lander->net_force / mass;
+	if (ctx->state.integrator == INTEGRATOR_DOPRI5) {
+		ctx->lander_dopri5.advance(lander->position, lander->velocity, ctx->state.time, ctx->state.timestep, acceleration);
+	} else {
+		ctx->lander_yoshida.order = (ctx->state.integrator == INTEGRATOR_YOSHIDA6) ? 6 : 4;
+		ctx->lander_yoshida.advance(lander->position, lander->velocity, ctx->state.time, ctx->state.timestep, acceleration);
 	}
+	lander->update_attitude(ctx->state.timestep);
+
+	// Verlet history is stale now (in case the integrator is switched back)
+	lander->reset_integrator();
+}
+
+// If the lander is coasting in vacuum (engines off, above the atmosphere, no debris flying)
+// its motion is a pure two-body conic, so it is moved along it analytically.
+// Returns false (without moving the lander) if numerical integration is needed.
+static bool coast_lander(SimulationContext* ctx) {
+	Lander* lander = ctx->lander;
+	Object* mars = ctx->mars;
+
+	if (lander->state.me_throttle != 0.0 || lander->state.rcs_throttle != 0.0) return false;
+	if (ctx->bodies.size() > 0) return false;
+	if (glm::length(lander->position - mars->position) - MARS_RADIUS <= MARS_ATMOSPHERE_HEIGHT) return false;
+
+	// (if the conic enters the atmosphere, the atmosphere entry event cuts the step short)
+	glm::dvec3 position, velocity;
+	kepler_propagate(mars, lander, ctx->state.timestep, position, velocity);
+
+	lander->acceleration = lander->net_force / lander->mass;
+	lander->position = position;
+	lander->velocity = velocity;
+	lander->update_attitude(ctx->state.timestep);
+
+	// Verlet history is stale now
+	lander->reset_integrator();
 
-	simstate.time += simstate.timestep;
+	return true;
 }
 
-static void process_lander_control_input() {
-	if (ImGui::GetIO().WantCaptureKeyboard == 1) return;
+static void apply_control_input(SimulationContext* ctx) {
+	SimulationState& simstate = ctx->state;
+	Lander* lander = ctx->lander;
+	const unsigned int input = simstate.control_input;
 
 	// RCS CONTROLS
 	simstate.rcs_manual_control = false;
 	glm::dvec3 rcs_axis(0.0);
 
-	if (glfwGetKey(wstate.window, GLFW_KEY_W) == GLFW_PRESS)
-		rcs_axis += glm::dvec3(-1.0, 0.0, 0.0);
-	if (glfwGetKey(wstate.window, GLFW_KEY_A) == GLFW_PRESS)
-		rcs_axis += glm::dvec3(0.0, 0.0, 1.0);
-	if (glfwGetKey(wstate.window, GLFW_KEY_S) == GLFW_PRESS)
-		rcs_axis += glm::dvec3(1.0, 0.0, 0.0);
-	if (glfwGetKey(wstate.window, GLFW_KEY_D) == GLFW_PRESS)
-		rcs_axis += glm::dvec3(0.0, 0.0, -1.0);
-	if (glfwGetKey(wstate.window, GLFW_KEY_Q) == GLFW_PRESS)
-		rcs_axis += glm::dvec3(0.0, -1.0, 0.0);
-	if (glfwGetKey(wstate.window, GLFW_KEY_E) == GLFW_PRESS)
-		rcs_axis += glm::dvec3(0.0, 1.0, 0.0);
-	
+	if (input & CONTROL_RCS_NEG_X) rcs_axis += glm::dvec3(-1.0, 0.0, 0.0);
+	if (input & CONTROL_RCS_POS_Z) rcs_axis += glm::dvec3(0.0, 0.0, 1.0);
+	if (input & CONTROL_RCS_POS_X) rcs_axis += glm::dvec3(1.0, 0.0, 0.0);
+	if (input & CONTROL_RCS_NEG_Z) rcs_axis += glm::dvec3(0.0, 0.0, -1.0);
+	if (input & CONTROL_RCS_NEG_Y) rcs_axis += glm::dvec3(0.0, -1.0, 0.0);
+	if (input & CONTROL_RCS_POS_Y) rcs_axis += glm::dvec3(0.0, 1.0, 0.0);
+
 	if (glm::length(rcs_axis) > 1e-8) {
 		setup_rcs(lander, rcs_axis, 1.0);
 		simstate.rcs_manual_control = true;
@@ -143,48 +389,64 @@ static void process_lander_control_input() {
 	// MAIN ENGINE CONTROLS
 	simstate.me_manual_control = false;
 
-	if (glfwGetKey(wstate.window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
-		setup_main_engine(lander, lander->attribute["me_throttle"] + 0.01);
+	if (input & CONTROL_THROTTLE_UP) {
+		setup_main_engine(lander, lander->state.me_throttle + 0.01);
 		simstate.me_manual_control = true;
-	} if (glfwGetKey(wstate.window, GLFW_KEY_LEFT) == GLFW_PRESS) {
-		setup_main_engine(lander, lander->attribute["me_throttle"] - 0.01);
+	} if (input & CONTROL_THROTTLE_DOWN) {
+		setup_main_engine(lander, lander->state.me_throttle - 0.01);
 		simstate.me_manual_control = true;
 	}
 
 	// PARACHUTE CONTROLS
-	if (glfwGetKey(wstate.window, GLFW_KEY_SPACE) == GLFW_PRESS && lander->attribute["parachute_status"] == 0.0) {
-		deploy_parachute(lander);
+	if ((input & CONTROL_PARACHUTE) && lander->state.parachute_status == 0.0) {
+		deploy_parachute(lander, ctx->mars);
 	}
 }
 
-static bool should_update_scenario() {
-	//return simstate.scenario_id != guistate.selected_scenario;
-	return guistate.scenario_changed;
+void set_timestep(SimulationContext* ctx, double timestep) {
+	if (timestep == ctx->state.timestep) return;
+	ctx->state.timestep = timestep;
+
+	// Verlet history assumes a constant timestep
+	ctx->mars->reset_integrator();
+	ctx->lander->reset_integrator();
+	ctx->bodies.reset_integrator();
+	for (unsigned int i = 0; i < ctx->obj.size(); i++) {
+		ctx->obj[i]->reset_integrator();
+	}
 }
 
-static void set_scenario(int id) {
-	reset_lander_attributes(lander);
+void set_scenario(SimulationContext* ctx, int id) {
+	SimulationState& simstate = ctx->state;
+	Lander* lander = ctx->lander;
+	Object* mars = ctx->mars;
 
-	lander->model = lander_default_model;
+	reset_lander_attributes(lander);
 
 	simstate.time = 0.0;
 	//simstate.paused = false;
 	simstate.landed = false;
 	simstate.crashed = false;
+	simstate.on_rails = false;
+	simstate.touchdown_speed = -1.0;
 	simstate.scenario_id = id;
 	mars->reset_integrator();
 	lander->reset_integrator();
 
 	debug("set_scenario()", "Switching to scenario " + std::to_string(id));
 
-	// Remove lander debris objects
-	for (unsigned int i = 0; i < lander_debris.size(); i++) {
-		remove_sim_object(lander_debris[i]);
-	}
+	reset_autopilot_controllers(&ctx->controllers);
+	ctx->lander_dopri5.reset();
+	ctx->lander_yoshida.reset();
+
+	// Remove lander debris
+	ctx->bodies.clear();
+	ctx->event_log.clear();
+	ctx->rng = CounterRng(ctx->rng_seed, RNG_STREAM_DEBRIS);
 
 	// Reset all objects' Verlet integrators
-	for (unsigned int i = 0; i < simstate.obj.size(); i++) {
-		simstate.obj[i]->reset_integrator();
+	for (unsigned int i = 0; i < ctx->obj.size(); i++) {
+		ctx->obj[i]->reset_integrator();
 	}
 
 	// Position of Mars is same in all scenarios
@@ -252,19 +514,31 @@ static void set_scenario(int id) {
 		break;
 	case 8:
 		// Custom scenario
-		if (glm::length(guistate.custom_scenario_lander_pos) > 1e-8) {
-			lander->position = guistate.custom_scenario_lander_pos;
+		if (glm::length(simstate.custom_lander_pos) > 1e-8) {
+			lander->position = simstate.custom_lander_pos;
 		} else {
 			// if position is zero, replace it with (0, 0, 0)
 			lander->position = glm::dvec3(1.0);
 		}
 
-		lander->velocity = guistate.custom_scenario_lander_vel;
+		lander->velocity = simstate.custom_lander_vel;
 		//lander->orient_towards(-lander->velocity);
 		lander->ang_velocity = glm::dvec3(0.0, 0.0, 0.0);
 		break;
 	default:
 		break;
 	}
+
+	start_recording(ctx);
+	clear_rewind_buffer(&ctx->rewind);
 }
 
+// Unit vector with all components positive
+static glm::dvec3 random_direction(SimulationContext* ctx) {
+	// Separate statements fix the order in which components are drawn
+	double x = ctx->rng();
+	double y = ctx->rng();
+	double z = ctx->rng();
+
+	return glm::normalize(glm::dvec3(x, y, z));
+}
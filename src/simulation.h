@@ -3,28 +3,116 @@
 #define SIMULATION_H
 
 #include "core/object.h"
+#include "core/body_store.h"
+#include "autopilot.h"
+#include "mars.h"
+#include "lander.h"
+#include "integrator.h"
+#include "events.h"
+#include "recording.h"
+#include "rewind.h"
+#include "terrain_cache.h"
+#include "core/counter_rng.h"
 
-extern struct SimulationState {
+#include <vector>
+#include <string>
+
+// Manual control input flags (see SimulationState::control_input)
+#define CONTROL_RCS_NEG_X    (1 << 0) // W
+#define CONTROL_RCS_POS_Z    (1 << 1) // A
+#define CONTROL_RCS_POS_X    (1 << 2) // S
+#define CONTROL_RCS_NEG_Z    (1 << 3) // D
+#define CONTROL_RCS_NEG_Y    (1 << 4) // Q
+#define CONTROL_RCS_POS_Y    (1 << 5) // E
+#define CONTROL_THROTTLE_UP   (1 << 6) // Right arrow
+#define CONTROL_THROTTLE_DOWN (1 << 7) // Left arrow
+#define CONTROL_PARACHUTE    (1 << 8) // Spacebar
+
+struct SimulationState {
 	double time;
 	double timestep;
+	int integrator; // INTEGRATOR_* (used for the lander)
+	bool on_rails;  // lander was propagated analytically (unpowered vacuum coast) in the last step
 	bool paused;
 	bool landed, crashed;
+	double touchdown_speed; // surface-relative speed at first surface contact (< 0 before contact)
 
 	int scenario_id;
+	glm::dvec3 custom_lander_pos; // initial conditions for the custom scenario
+	glm::dvec3 custom_lander_vel;
 
 	bool me_manual_control;
 	bool rcs_manual_control;
 
-	// Objects to simulate (other than lander & mars)
+	// Inputs set by the front-end (GUI or headless runner), applied on every step
+	unsigned int control_input; // CONTROL_* flags
+	bool autopilot_active;
+	bool coast_to_events; // simulation_coast() may cover unattended vacuum coasts (see there)
+};
+
+// Everything one simulation needs to step. Contexts share no state, so several of them
+// can exist and be stepped concurrently (one thread per context).
+class SimulationContext {
+public:
+	SimulationContext(double physics_timestep, int scenario_id); // random terrain & wind, starts the scenario
+	SimulationContext(double physics_timestep, unsigned int terrain_seed, unsigned int wind_seed); // set_scenario() before stepping
+	~SimulationContext();
+
+	SimulationState state;
+
+	// Simulated bodies (created without models)
+	Lander* lander;
+	Object* mars;
+	std::vector<Object*> lander_debris; // handles of debris bodies (valid after a crash)
+
+	// Lander integrator state (if state.integrator is not INTEGRATOR_VERLET)
+	DormandPrinceIntegrator lander_dopri5;
+	YoshidaIntegrator lander_yoshida;
+
+	// Events located within steps (surface contact, atmosphere interface, apsides)
+	std::vector<EventDetector> event_detectors;
+	std::vector<EventRecord> event_log;
+
+	// Debris & test bodies (mars gravity only, integrated in one batch)
+	BodyStore bodies;
+
+	// Objects to simulate (other than lander, mars & bodies)
 	std::vector<Object*> obj;
-} simstate;
 
-void init_simulation(double physics_timestep);
+	// Terrain & weather noise generators
+	MarsEnvironment env;
+	TerrainCache terrain; // terrain heights seen by the physics (at TERRAIN_PHYSICS_LEVEL)
+
+	// Other randomness (debris scatter), restarted from rng_seed by set_scenario()
+	unsigned int rng_seed;
+	CounterRng rng;
+
+	// Inputs since the last set_scenario(), for replays
+	Recording recording;
+
+	// Keyframes for going back in time (disabled unless configured)
+	RewindBuffer rewind;
+
+	// Lander autopilot
+	AutopilotProgram ap;
+	AutopilotControllers controllers;
+	std::vector<std::string> autopilot_message_log; // messages from the autopilot program (load errors, INFO() calls etc.)
+};
+
+void set_scenario(SimulationContext* ctx, int id);
+void set_timestep(SimulationContext* ctx, double timestep); // restarts the fixed-step integrators
+
+void add_sim_object(SimulationContext* ctx, Object* obj);
+void remove_sim_object(SimulationContext* ctx, Object* obj);
 
-void add_sim_object(Object* obj);
-void remove_sim_object(Object* obj);
+// Do one physics update
+void simulation_step(SimulationContext* ctx);
 
-// Do n physics updates
-void simulation_step();
+// If coast_to_events is set and nothing can steer the lander (no autopilot, no control input, engines
+// off) while it coasts in vacuum, moves everything in one Kepler solve by as many whole steps as pass
+// before the lander's next event (apsis or atmosphere entry; the event itself is left to the next
+// simulation_step()), but at most max_steps. Returns the number of steps covered, 0 if there's no such
+// coast (take a simulation_step() instead). The steps count as such for recording & replay.
+long simulation_coast(SimulationContext* ctx, long max_steps);
 
 #endif
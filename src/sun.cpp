@@ -1,4 +1,5 @@
 // Ricardas Navickas 2020
+#include "core/core.h"
 #include "sun.h"
 #include "mars.h"
 
@@ -0,0 +1,183 @@
+// Ricardas Navickas 2020
+#include "terrain_cache.h"
+#include "mars.h"
+
+#include <cmath>
+#include <iterator>
+
+#define TILE_BYTES (TERRAIN_TILE_SAMPLES * TERRAIN_TILE_SAMPLES * sizeof(float) + 64) // samples + bookkeeping
+
+// Position of a query within the tiles of one level
+struct TileCoords {
+	uint64_t key;
+	int i, j;      // sample at the lower corner of the grid cell
+	double fx, fy; // position within the grid cell (0 - 1)
+};
+
+static TileCoords tile_coords(glm::dvec3 direction, int level);
+static uint64_t tile_key(int face, int level, uint64_t tx, uint64_t ty);
+static glm::dvec3 face_direction(int face, double u, double v);
+static double interpolate(const float* samples, const TileCoords& c);
+
+TerrainCache::TerrainCache(size_t max_bytes) {
+	hits = 0;
+	misses = 0;
+	terrain_seed = 0;
+	set_max_bytes(max_bytes);
+}
+
+double TerrainCache::height(const MarsEnvironment* env, glm::dvec3 body_direction, int level) {
+	TileCoords c = tile_coords(body_direction, level);
+	return interpolate(find_tile(env, c.key), c);
+}
+
+void TerrainCache::heights(const MarsEnvironment* env, const glm::dvec3* body_directions, double* heights, size_t n, int level) {
+	for (size_t i = 0; i < n; i++) {
+		heights[i] = height(env, body_directions[i], level);
+	}
+}
+
+const float* TerrainCache::tile(const MarsEnvironment* env, int face, int level, int tx, int ty) {
+	return find_tile(env, tile_key(face, level, tx, ty));
+}
+
+void TerrainCache::clear() {
+	tiles.clear();
+	index.clear();
+}
+
+void TerrainCache::set_max_bytes(size_t bytes) {
+	max_tiles = glm::max(bytes / TILE_BYTES, size_t(1));
+	evict_to(max_tiles);
+}
+
+size_t TerrainCache::size_bytes() const {
+	return tiles.size() * TILE_BYTES;
+}
+
+// Samples of the tile, generated if it isn't cached
+const float* TerrainCache::find_tile(const MarsEnvironment* env, uint64_t key) {
+	// Tiles of another terrain are useless
+	if (env->terrain_seed != terrain_seed) {
+		clear();
+		terrain_seed = env->terrain_seed;
+	}
+
+	// Queries come in runs around the same spot, mostly hitting the last tile used
+	if (!tiles.empty() && tiles.front().key == key) {
+		hits++;
+		return tiles.front().heights.data();
+	}
+
+	auto it = index.find(key);
+	if (it != index.end()) {
+		hits++;
+		tiles.splice(tiles.begin(), tiles, it->second);
+		return tiles.front().heights.data();
+	}
+
+	misses++;
+
+	// Reuse the least recently used tile's memory when full
+	if (tiles.size() >= max_tiles) {
+		index.erase(tiles.back().key);
+		tiles.splice(tiles.begin(), tiles, std::prev(tiles.end()));
+	} else {
+		tiles.emplace_front();
+	}
+
+	Tile& t = tiles.front();
+	t.key = key;
+	t.heights.resize(TERRAIN_TILE_SAMPLES * TERRAIN_TILE_SAMPLES);
+	terrain_tile(env, int(key >> 53), int((key >> 48) & 31), int((key >> 24) & 0xffffff), int(key & 0xffffff), t.heights.data());
+	index[key] = tiles.begin();
+
+	return t.heights.data();
+}
+
+void TerrainCache::evict_to(size_t num_of_tiles) {
+	while (tiles.size() > num_of_tiles) {
+		index.erase(tiles.back().key);
+		tiles.pop_back();
+	}
+}
+
+void terrain_tile(const MarsEnvironment* env, int face, int level, int tx, int ty, float* heights) {
+	const int n = TERRAIN_TILE_SAMPLES;
+	std::vector<glm::vec3> pos(n * n);
+	std::vector<float> noise(n * n);
+
+	for (int j = 0; j < n; j++) {
+		for (int i = 0; i < n; i++) {
+			pos[j * n + i] = glm::normalize(terrain_sample_direction(face, level, tx, ty, i, j)) * double(MARS_RADIUS);
+		}
+	}
+
+	env->height_noise.get_values(pos.data(), noise.data(), n * n, MARS_TERRAIN_OCTAVES);
+
+	for (int i = 0; i < n * n; i++) {
+		heights[i] = MARS_TERRAIN_AMPLITUDE * noise[i];
+	}
+}
+
+// Samples are placed at multiples of 1 / (intervals * tiles per edge) across the face, so that edge
+// samples of neighbouring tiles are computed from the same numbers and match exactly
+glm::dvec3 terrain_sample_direction(int face, int level, int tx, int ty, int i, int j) {
+	const int intervals = TERRAIN_TILE_SAMPLES - 1;
+	const double face_intervals = double(intervals) * double(uint64_t(1) << level);
+	const double u = 2.0 * double(uint64_t(tx) * intervals + i) / face_intervals - 1.0;
+	const double v = 2.0 * double(uint64_t(ty) * intervals + j) / face_intervals - 1.0;
+
+	return face_direction(face, u, v);
+}
+
+static TileCoords tile_coords(glm::dvec3 d, int level) {
+	const glm::dvec3 a = glm::abs(d);
+	const int axis = (a.x >= a.y && a.x >= a.z) ? 0 : (a.y >= a.z ? 1 : 2);
+	const int face = 2 * axis + (d[axis] < 0.0 ? 1 : 0);
+	const double u = d[(axis + 1) % 3] / a[axis];
+	const double v = d[(axis + 2) % 3] / a[axis];
+
+	const int tiles_per_edge = 1 << level;
+	const int intervals = TERRAIN_TILE_SAMPLES - 1;
+	const double s = 0.5 * (u + 1.0) * tiles_per_edge;
+	const double t = 0.5 * (v + 1.0) * tiles_per_edge;
+	const int tx = glm::clamp(int(std::floor(s)), 0, tiles_per_edge - 1);
+	const int ty = glm::clamp(int(std::floor(t)), 0, tiles_per_edge - 1);
+	const double x = (s - tx) * intervals;
+	const double y = (t - ty) * intervals;
+
+	TileCoords c;
+	c.key = tile_key(face, level, tx, ty);
+	c.i = glm::clamp(int(x), 0, intervals - 1);
+	c.j = glm::clamp(int(y), 0, intervals - 1);
+	c.fx = glm::clamp(x - c.i, 0.0, 1.0);
+	c.fy = glm::clamp(y - c.j, 0.0, 1.0);
+
+	return c;
+}
+
+static uint64_t tile_key(int face, int level, uint64_t tx, uint64_t ty) {
+	return (uint64_t(face) << 53) | (uint64_t(level) << 48) | (tx << 24) | ty;
+}
+
+static glm::dvec3 face_direction(int face, double u, double v) {
+	const int axis = face / 2;
+	glm::dvec3 d;
+
+	d[axis] = (face & 1) ? -1.0 : 1.0;
+	d[(axis + 1) % 3] = u;
+	d[(axis + 2) % 3] = v;
+
+	return d;
+}
+
+static double interpolate(const float* samples, const TileCoords& c) {
+	const int n = TERRAIN_TILE_SAMPLES;
+	const float* row0 = samples + c.j * n + c.i;
+	const float* row1 = row0 + n;
+
+	double bottom = row0[0] + c.fx * (double(row0[1]) - row0[0]);
+	double top = row1[0] + c.fx * (double(row1[1]) - row1[0]);
+	return bottom + c.fy * (top - bottom);
+}
@@ -0,0 +1,70 @@
+// Ricardas Navickas 2020
+#ifndef TERRAIN_CACHE_H
+#define TERRAIN_CACHE_H
+
+#include "core/glm/glm.hpp"
+
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+struct MarsEnvironment;
+
+#define TERRAIN_TILE_SAMPLES 33  // samples along each tile edge (edge samples are shared with the neighbouring tile)
+#define TERRAIN_MAX_LEVEL 20
+#define TERRAIN_PHYSICS_LEVEL 12 // ~1.3km tiles, ~40m between samples
+
+// Terrain heights sampled on a grid in mars' body frame, so that repeated queries are table lookups
+// instead of noise evaluations. The surface is split into the 6 faces of a cube (projected onto the
+// sphere), each face into 2^level x 2^level tiles at a given level of detail; tiles are generated
+// (with Noise3d::get_values()) when first needed and the least recently used ones are dropped to stay
+// within max_bytes. Heights in between samples are interpolated bilinearly.
+//
+// A tile depends only on the terrain seed, so results don't depend on what is cached. Not thread-safe:
+// every thread that samples terrain keeps its own cache.
+//
+// Faces are numbered axis (x, y, z) * 2, + 1 on the negative side. A face's coordinates (u, v) in [-1, 1]
+// are the other two components (in x, y, z order starting after the axis) over the axis component.
+class TerrainCache {
+public:
+	TerrainCache(size_t max_bytes);
+
+	// Height (as mars_surface_height()) in body_direction (mars' body frame, non-zero) at the given level
+	double height(const MarsEnvironment* env, glm::dvec3 body_direction, int level);
+	void heights(const MarsEnvironment* env, const glm::dvec3* body_directions, double* heights, size_t n, int level);
+
+	// Heights (km) of a tile's samples, TERRAIN_TILE_SAMPLES^2 row by row (see terrain_sample_direction()).
+	// Valid until the next call.
+	const float* tile(const MarsEnvironment* env, int face, int level, int tx, int ty);
+
+	void clear();
+	void set_max_bytes(size_t bytes); // drops tiles if they no longer fit
+	size_t size_bytes() const;
+
+	long hits, misses; // tile lookups since construction
+
+private:
+	struct Tile {
+		uint64_t key;
+		std::vector<float> heights;
+	};
+
+	const float* find_tile(const MarsEnvironment* env, uint64_t key);
+	void evict_to(size_t num_of_tiles);
+
+	size_t max_tiles;
+	unsigned int terrain_seed; // of the cached tiles
+
+	std::list<Tile> tiles; // most recently used first
+	std::unordered_map<uint64_t, std::list<Tile>::iterator> index;
+};
+
+// Heights (km) of a tile's samples, computed without a cache (any thread may call it)
+void terrain_tile(const MarsEnvironment* env, int face, int level, int tx, int ty, float* heights);
+
+// Direction (mars' body frame, not normalized) of sample (i, j) of a tile; i runs along u, j along v
+glm::dvec3 terrain_sample_direction(int face, int level, int tx, int ty, int i, int j);
+
+#endif
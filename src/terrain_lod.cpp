@@ -0,0 +1,361 @@
+// Ricardas Navickas 2020
+#include "terrain_lod.h"
+#include "core/core.h"
+
+#include <cmath>
+#include <queue>
+
+#define HEIGHT_MARGIN 1.0 // km, terrain stays this close to MARS_RADIUS
+
+// Chunk (not necessarily built) considered for drawing
+struct TerrainLod::Node {
+	int face, level, tx, ty;
+	glm::dvec3 center; // on the MARS_RADIUS sphere, in mars' body frame
+	double radius;     // from center to the furthest corner
+	double spacing;    // between vertices
+	double error;      // vertex spacing on screen (pixels)
+
+	bool operator<(const Node& n) const { return error < n.error; }
+};
+
+struct TerrainLod::View {
+	glm::dvec3 position;
+	glm::dvec3 side_normals[4]; // of the frustum's side planes (pointing inside)
+	double pixels_per_radian;
+};
+
+static uint64_t chunk_key(int face, int level, int tx, int ty);
+static glm::dvec3 sample_position(int face, int level, int tx, int ty, int i, int j);
+static TerrainLod::Node make_node(int face, int level, int tx, int ty, const TerrainLod::View& view);
+static bool culled(const TerrainLod::Node& n, const TerrainLod::View& view);
+static Mesh* make_chunk_mesh(const MarsEnvironment* env, const TerrainLod::Node& n);
+
+TerrainLod::TerrainLod(MarsEnvironment* env, size_t max_bytes) : env(env), max_bytes(max_bytes) {
+	terrain_seed = env->terrain_seed;
+	update_count = 0;
+	triangles = 0;
+	bytes = 0;
+	workers = new ThreadPool(TERRAIN_LOD_THREADS);
+
+	// Faces don't depend on the view
+	View view = View();
+	for (int face = 0; face < 6; face++) {
+		request_chunk(make_node(face, 0, 0, 0, view));
+	}
+
+	workers->wait();
+	receive_chunks(6);
+}
+
+TerrainLod::~TerrainLod() {
+	delete workers; // finishes the queued chunks first
+
+	for (unsigned int i = 0; i < built.size(); i++) {
+		delete built[i].mesh;
+	}
+	clear();
+}
+
+void TerrainLod::update(Object* mars, const Camera* camera, glm::dvec3 camera_velocity, double vfov, int viewport_width, int viewport_height) {
+	// Meshes of another terrain are useless
+	if (env->terrain_seed != terrain_seed) {
+		clear();
+		terrain_seed = env->terrain_seed;
+	}
+
+	update_count++;
+	receive_chunks(TERRAIN_LOD_UPLOADS_PER_UPDATE);
+
+	// Camera in mars' body frame
+	const glm::dmat3 to_body = glm::transpose(mars->attitude_matrix);
+	const glm::dvec3 facing = glm::normalize(to_body * camera->facing);
+	const glm::dvec3 up = glm::normalize(to_body * camera->up);
+	const glm::dvec3 right = glm::normalize(to_body * camera->right);
+	const double half_vfov = glm::radians(vfov) / 2.0;
+	const double half_hfov = std::atan(std::tan(half_vfov) * viewport_width / glm::max(viewport_height, 1));
+
+	View view;
+	view.position = to_body * (camera->position - mars->position);
+	view.side_normals[0] = facing * std::sin(half_hfov) + right * std::cos(half_hfov);
+	view.side_normals[1] = facing * std::sin(half_hfov) - right * std::cos(half_hfov);
+	view.side_normals[2] = facing * std::sin(half_vfov) + up * std::cos(half_vfov);
+	view.side_normals[3] = facing * std::sin(half_vfov) - up * std::cos(half_vfov);
+	view.pixels_per_radian = viewport_height / (2.0 * std::tan(half_vfov));
+
+	std::vector<Node> selected;
+	select_chunks(view, &selected);
+
+	// Get ready for where the camera is going (what's needed now is requested first)
+	View ahead = view;
+	ahead.position += to_body * camera_velocity * TERRAIN_LOD_LOOKAHEAD;
+	select_chunks(ahead, NULL);
+
+	// Pose the chosen chunks
+	visible.clear();
+	triangles = 0;
+	for (unsigned int i = 0; i < selected.size(); i++) {
+		Chunk* c = find_chunk(selected[i]);
+
+		c->obj->position = mars->position + mars->attitude_matrix * c->center;
+		c->obj->attitude_matrix = mars->attitude_matrix;
+		visible.push_back(c->obj);
+		triangles += c->obj->model->mesh->indices.size() / 3;
+	}
+
+	// Drop the least recently used meshes that don't fit (but none that are drawn or wanted soon)
+	while (bytes > max_bytes && chunks.back().last_used != update_count) {
+		free_chunk(&chunks.back());
+		index.erase(chunks.back().key);
+		chunks.pop_back();
+	}
+}
+
+void TerrainLod::clear() {
+	for (auto it = chunks.begin(); it != chunks.end(); it++) {
+		free_chunk(&*it);
+	}
+
+	chunks.clear();
+	index.clear();
+	visible.clear();
+	triangles = 0;
+}
+
+// Splits the worst chunk until all are fine (or there are too many). Chunks that aren't built yet are requested.
+void TerrainLod::select_chunks(const View& view, std::vector<Node>* selected) {
+	std::priority_queue<Node> candidates;
+	int count = 0;
+
+	for (int face = 0; face < 6; face++) {
+		Node n = make_node(face, 0, 0, 0, view);
+		if (culled(n, view)) continue;
+
+		if (find_chunk(n) == NULL) {
+			request_chunk(n);
+			continue;
+		}
+
+		candidates.push(n);
+		count++;
+	}
+
+	while (!candidates.empty()) {
+		Node n = candidates.top();
+		candidates.pop();
+
+		Node children[4];
+		int num_of_children = 0;
+		bool split = n.error > TERRAIN_LOD_MAX_ERROR && n.level < TERRAIN_LOD_MAX_LEVEL && count + 3 <= TERRAIN_LOD_MAX_CHUNKS;
+
+		for (int k = 0; split && k < 4; k++) {
+			Node c = make_node(n.face, n.level + 1, 2 * n.tx + (k & 1), 2 * n.ty + (k >> 1), view);
+			if (culled(c, view)) continue;
+
+			children[num_of_children++] = c;
+		}
+
+		for (int k = 0; k < num_of_children; k++) {
+			if (find_chunk(children[k]) == NULL) {
+				request_chunk(children[k]);
+				split = false;
+			}
+		}
+
+		if (!split) {
+			if (selected != NULL) selected->push_back(n);
+			continue;
+		}
+
+		for (int k = 0; k < num_of_children; k++) {
+			candidates.push(children[k]);
+		}
+		count += num_of_children - 1;
+	}
+}
+
+// Chunk of the node (marked as used); NULL if it isn't built
+TerrainLod::Chunk* TerrainLod::find_chunk(const Node& n) {
+	auto it = index.find(chunk_key(n.face, n.level, n.tx, n.ty));
+	if (it == index.end()) return NULL;
+
+	chunks.splice(chunks.begin(), chunks, it->second);
+	chunks.front().last_used = update_count;
+	return &chunks.front();
+}
+
+void TerrainLod::request_chunk(const Node& n) {
+	const uint64_t key = chunk_key(n.face, n.level, n.tx, n.ty);
+	if (pending.size() >= TERRAIN_LOD_MAX_PENDING || pending.count(key) > 0) return;
+
+	pending.insert(key);
+
+	// Workers get their own copy of the (stateless) noise generators, which may be replaced meanwhile
+	MarsEnvironment worker_env = *env;
+	unsigned int seed = terrain_seed;
+	workers->submit([this, n, key, worker_env, seed] {
+		BuiltChunk b;
+		b.key = key;
+		b.terrain_seed = seed;
+		b.center = n.center;
+		b.mesh = make_chunk_mesh(&worker_env, n);
+
+		std::lock_guard<std::mutex> guard(built_lock);
+		built.push_back(b);
+	});
+}
+
+// Uploads (at most max_chunks) meshes made by the workers
+void TerrainLod::receive_chunks(int max_chunks) {
+	std::vector<BuiltChunk> received;
+
+	{
+		std::lock_guard<std::mutex> guard(built_lock);
+		const int n = glm::min(max_chunks, int(built.size()));
+		received.assign(built.begin(), built.begin() + n);
+		built.erase(built.begin(), built.begin() + n);
+	}
+
+	for (unsigned int i = 0; i < received.size(); i++) {
+		const BuiltChunk& b = received[i];
+		pending.erase(b.key);
+
+		// Terrain changed (or requested twice across a change) while it was being built
+		if (b.terrain_seed != terrain_seed || index.count(b.key) > 0) {
+			delete b.mesh;
+			continue;
+		}
+
+		chunks.emplace_front();
+		Chunk& c = chunks.front();
+		c.key = b.key;
+		c.obj = new Object(new Model(b.mesh, GL_TRIANGLES), b.center, 0.1f, 2);
+		c.center = b.center;
+		c.bytes = b.mesh->vertex_data.size() * sizeof(float) + b.mesh->indices.size() * sizeof(unsigned int);
+		c.last_used = update_count;
+		bytes += c.bytes;
+		index[b.key] = chunks.begin();
+	}
+}
+
+void TerrainLod::free_chunk(Chunk* c) {
+	Model* model = c->obj->model;
+	Mesh* mesh = model->mesh;
+
+	delete c->obj;
+	delete model;
+	delete mesh;
+	bytes -= c->bytes;
+}
+
+static uint64_t chunk_key(int face, int level, int tx, int ty) {
+	return (uint64_t(face) << 53) | (uint64_t(level) << 48) | (uint64_t(tx) << 24) | uint64_t(ty);
+}
+
+static glm::dvec3 sample_position(int face, int level, int tx, int ty, int i, int j) {
+	return glm::normalize(terrain_sample_direction(face, level, tx, ty, i, j)) * double(MARS_RADIUS);
+}
+
+static TerrainLod::Node make_node(int face, int level, int tx, int ty, const TerrainLod::View& view) {
+	const int last = TERRAIN_TILE_SAMPLES - 1;
+	const glm::dvec3 corners[4] = {
+		sample_position(face, level, tx, ty, 0, 0), sample_position(face, level, tx, ty, last, 0),
+		sample_position(face, level, tx, ty, 0, last), sample_position(face, level, tx, ty, last, last)
+	};
+
+	TerrainLod::Node n;
+	n.face = face;
+	n.level = level;
+	n.tx = tx;
+	n.ty = ty;
+	n.center = sample_position(face, level, tx, ty, last / 2, last / 2);
+
+	n.radius = 0.0;
+	for (int k = 0; k < 4; k++) {
+		n.radius = glm::max(n.radius, glm::length(corners[k] - n.center));
+	}
+
+	n.spacing = glm::max(glm::length(corners[1] - corners[0]), glm::length(corners[2] - corners[0])) / last;
+
+	const double distance = glm::max(glm::length(view.position - n.center) - n.radius, 1e-3);
+	n.error = n.spacing / distance * view.pixels_per_radian;
+
+	return n;
+}
+
+// Outside the view, or behind the horizon of the lowest terrain (approximately: mountains peeking over
+// it are ignored)
+static bool culled(const TerrainLod::Node& n, const TerrainLod::View& view) {
+	const double radius = n.radius + HEIGHT_MARGIN;
+	const glm::dvec3 to_center = n.center - view.position;
+
+	for (int k = 0; k < 4; k++) {
+		if (glm::dot(to_center, view.side_normals[k]) < -radius) return true;
+	}
+
+	const double occluder_radius = MARS_RADIUS - HEIGHT_MARGIN;
+	const double camera_distance = glm::length(view.position);
+	if (camera_distance <= occluder_radius) return false;
+
+	// Points of the occluder in front of this plane (perpendicular to the camera direction) are visible
+	const double horizon_plane = occluder_radius * occluder_radius / camera_distance;
+	return glm::dot(n.center, view.position) / camera_distance + radius < horizon_plane;
+}
+
+// Grid on the chunk's tile, with vertices relative to its center (runs on worker threads)
+static Mesh* make_chunk_mesh(const MarsEnvironment* env, const TerrainLod::Node& n) {
+	const int s = TERRAIN_TILE_SAMPLES;
+	std::vector<float> heights(s * s);
+	terrain_tile(env, n.face, n.level, n.tx, n.ty, heights.data());
+
+	std::vector<glm::dvec3> dir(s * s);
+	std::vector<glm::dvec3> pos(s * s);
+	for (int j = 0; j < s; j++) {
+		for (int i = 0; i < s; i++) {
+			dir[j * s + i] = glm::normalize(terrain_sample_direction(n.face, n.level, n.tx, n.ty, i, j));
+			pos[j * s + i] = dir[j * s + i] * (MARS_RADIUS + double(heights[j * s + i]));
+		}
+	}
+
+	Mesh* mesh = new Mesh;
+
+	// Grid
+	for (int j = 0; j < s; j++) {
+		for (int i = 0; i < s; i++) {
+			const int v = j * s + i;
+			glm::dvec3 du = pos[j * s + glm::min(i + 1, s - 1)] - pos[j * s + glm::max(i - 1, 0)];
+			glm::dvec3 dv = pos[glm::min(j + 1, s - 1) * s + i] - pos[glm::max(j - 1, 0) * s + i];
+			glm::dvec3 normal = glm::normalize(glm::cross(du, dv));
+			if (glm::dot(normal, dir[v]) < 0.0) normal = -normal;
+
+			glm::vec3 color = mars_surface_color(dir[v]) + glm::vec3(heights[v]);
+			add_vertex(mesh, glm::vec3(pos[v] - n.center), glm::vec3(normal), color);
+		}
+	}
+
+	for (int j = 0; j < s - 1; j++) {
+		for (int i = 0; i < s - 1; i++) {
+			const unsigned int v = j * s + i;
+			mesh->indices.insert(mesh->indices.end(), {v, v + 1, v + s, v + 1, v + s + 1, v + s});
+		}
+	}
+
+	// Skirts: a copy of each edge, one vertex spacing lower
+	const int edge_start[4] = {0, (s - 1) * s, 0, s - 1}; // bottom, top, left, right
+	const int edge_step[4] = {1, 1, s, s};
+	for (int e = 0; e < 4; e++) {
+		const unsigned int first = num_of_vertices(mesh);
+
+		for (int k = 0; k < s; k++) {
+			const int v = edge_start[e] + k * edge_step[e];
+			add_vertex(mesh, glm::vec3(pos[v] - n.spacing * dir[v] - n.center), get_vertex_normal(mesh, v), get_vertex_color(mesh, v));
+		}
+
+		for (int k = 0; k < s - 1; k++) {
+			const unsigned int top = edge_start[e] + k * edge_step[e];
+			const unsigned int top_next = top + edge_step[e];
+			mesh->indices.insert(mesh->indices.end(), {top, top_next, first + k, top_next, first + k + 1, first + k});
+		}
+	}
+
+	return mesh;
+}
@@ -0,0 +1,94 @@
+// Ricardas Navickas 2020
+#ifndef TERRAIN_LOD_H
+#define TERRAIN_LOD_H
+
+#include "core/object.h"
+#include "core/camera.h"
+#include "core/thread_pool.h"
+#include "mars.h"
+#include "terrain_cache.h"
+
+#include <list>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+
+#define TERRAIN_LOD_MAX_LEVEL 16          // ~2.5m between vertices
+#define TERRAIN_LOD_MAX_CHUNKS 384        // drawn at once, ~2300 triangles each
+#define TERRAIN_LOD_MAX_ERROR 16.0        // pixels between vertices before a chunk is split
+#define TERRAIN_LOD_THREADS 2             // building chunk meshes
+#define TERRAIN_LOD_MAX_PENDING 16        // chunks being built at once
+#define TERRAIN_LOD_UPLOADS_PER_UPDATE 8  // built chunks handed to OpenGL per update, the rest wait for the next ones
+#define TERRAIN_LOD_LOOKAHEAD 3.0         // seconds; chunks are also requested for where the camera will be by then
+
+struct Mesh;
+
+// Mars' surface for close views, detailed where the camera is. Each face of the terrain cube-sphere (see
+// TerrainCache) is a quadtree of chunks; a chunk is a grid with a vertex on every sample of the terrain
+// tile at its face, level & position. Starting from the 6 faces, the chunk whose vertices are furthest
+// apart on screen is replaced by its 4 children until all are within TERRAIN_LOD_MAX_ERROR pixels or
+// TERRAIN_LOD_MAX_CHUNKS are drawn, so the triangle count is bounded at any altitude. Chunks outside the
+// view or below the horizon are skipped and skirts hang from chunk edges to hide cracks where levels meet.
+//
+// Chunk meshes are built in the background by worker threads; update() only uploads finished ones (so
+// the calling thread never evaluates noise) and splits a chunk once all of its children have arrived.
+// Meshes are kept for reuse until they no longer fit in max_bytes.
+class TerrainLod {
+public:
+	TerrainLod(MarsEnvironment* env, size_t max_bytes); // waits for the 6 faces to be built
+	~TerrainLod();
+
+	// Picks & poses the chunks to draw for the camera, with a vertical field of view of vfov degrees.
+	// camera_velocity is relative to mars' surface (world frame).
+	void update(Object* mars, const Camera* camera, glm::dvec3 camera_velocity, double vfov, int viewport_width, int viewport_height);
+
+	void clear(); // drops all meshes
+
+	std::vector<Object*> visible; // chunks to draw (see Scene::add_object_list())
+	long triangles;               // in visible
+	size_t bytes;                 // taken by meshes
+
+	struct Node; // chunk considered for drawing (defined in terrain_lod.cpp)
+	struct View; // camera in mars' body frame
+
+private:
+	struct Chunk {
+		uint64_t key;
+		Object* obj;         // vertices relative to center
+		glm::dvec3 center;   // in mars' body frame
+		size_t bytes;
+		long last_used;      // update number
+	};
+
+	// Mesh made by a worker, waiting to be uploaded
+	struct BuiltChunk {
+		uint64_t key;
+		unsigned int terrain_seed;
+		glm::dvec3 center;
+		Mesh* mesh;
+	};
+
+	void select_chunks(const View& view, std::vector<Node>* selected); // selected may be NULL (only requests chunks)
+	Chunk* find_chunk(const Node& n);
+	void request_chunk(const Node& n);
+	void receive_chunks(int max_chunks);
+	void free_chunk(Chunk* c);
+
+	MarsEnvironment* env;
+	unsigned int terrain_seed; // of the meshes
+
+	size_t max_bytes;
+	long update_count;
+
+	std::list<Chunk> chunks; // most recently used first
+	std::unordered_map<uint64_t, std::list<Chunk>::iterator> index;
+
+	ThreadPool* workers;
+	std::unordered_set<uint64_t> pending; // requested, not received yet
+	std::vector<BuiltChunk> built;        // by the workers
+	std::mutex built_lock;
+};
+
+#endif
@@ -0,0 +1,250 @@
+// Ricardas Navickas 2020
+#include "trajectory.h"
+#include "physics.h"
+#include "integrator.h"
+#include "lander.h"
+
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+#define IMPACT_ITERATIONS 20 // bisections of the step that went below the surface
+#define TERRAIN_MARGIN (10.0 * MARS_TERRAIN_AMPLITUDE) // km; terrain is only looked up below this altitude
+
+typedef std::chrono::steady_clock Clock;
+
+static bool above_surface(Object* mars, MarsEnvironment* env, TerrainCache* terrain, glm::dvec3 position);
+
+TrajectoryPredictor::TrajectoryPredictor() : terrain(1 << 20) {
+	last_duration = 0.0;
+	stopping = false;
+	restart = false;
+	have_request = false;
+	have_result = false;
+	requested = false;
+	requested_generation = 0;
+
+	prediction.generation = 0;
+	prediction.impact = false;
+	prediction.complete = false;
+
+	thread = std::thread(&TrajectoryPredictor::loop, this);
+}
+
+TrajectoryPredictor::~TrajectoryPredictor() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wakeup.notify_all();
+	thread.join();
+}
+
+bool TrajectoryPredictor::update(const SimulationSnapshot& view, unsigned int terrain_seed, unsigned int wind_seed) {
+	bool changed = false;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (have_result) {
+			std::swap(prediction, result);
+			have_result = false;
+			requested = false;
+			changed = true;
+		}
+	}
+
+	// Nowhere to go
+	if (view.state.landed || view.state.crashed) {
+		if (!prediction.points.empty()) {
+			prediction.points.clear();
+			prediction.times.clear();
+			prediction.impact = false;
+			changed = true;
+		}
+		return changed;
+	}
+
+	// One prediction at a time, unless the simulation jumped since it was requested
+	if (requested && view.generation == requested_generation) return changed;
+	if (!diverged(view)) return changed;
+
+	const LanderState& ls = view.lander_state;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		request.generation = view.generation;
+		request.time = view.state.time;
+		request.position = view.lander.position;
+		request.velocity = view.lander.velocity;
+		request.mass = ls.dry_mass + ls.fuel_level * ls.fuel_capacity * ls.fuel_density;
+		request.frontal_area = ls.frontal_area;
+		request.mars = view.mars;
+		request.terrain_seed = terrain_seed;
+		request.wind_seed = wind_seed;
+		have_request = true;
+		restart = requested;
+	}
+	wakeup.notify_all();
+
+	requested = true;
+	requested_generation = view.generation;
+
+	return changed;
+}
+
+// Whether the lander in view is off the prediction (or there's no prediction for it)
+bool TrajectoryPredictor::diverged(const SimulationSnapshot& view) {
+	const std::vector<double>& t = prediction.times;
+	const double time = view.state.time;
+
+	if (t.size() < 2 || prediction.generation != view.generation) return true;
+	if (time < t.front() || time > t.back()) return true;
+
+	size_t i = std::upper_bound(t.begin(), t.end(), time) - t.begin();
+	i = glm::clamp(i, size_t(1), t.size() - 1);
+
+	const double alpha = (time - t[i - 1]) / (t[i] - t[i - 1]);
+	const glm::dvec3 expected = glm::mix(prediction.points[i - 1], prediction.points[i], alpha);
+
+	return glm::length(view.lander.position - expected) > TRAJECTORY_MAX_ERROR;
+}
+
+void TrajectoryPredictor::loop() {
+	Request r;
+	TrajectoryPrediction p;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wakeup.wait(guard, [this] { return stopping || have_request; });
+			if (stopping) return;
+
+			r = request;
+			have_request = false;
+			restart = false;
+		}
+
+		Clock::time_point begin = Clock::now();
+		if (!predict(r, &p)) continue;
+		last_duration = std::chrono::duration<double>(Clock::now() - begin).count();
+
+		std::lock_guard<std::mutex> guard(lock);
+		std::swap(result, p);
+		have_result = true;
+	}
+}
+
+// Coasts (engines off) from the requested state, a point at a time. Points are spaced by angle around
+// mars & by how sharply the path bends, so the close pass of an orbit gets as many points as the slow
+// far side and a straight-line interpolation between points stays within TRAJECTORY_MAX_SAG
+bool TrajectoryPredictor::predict(const Request& r, TrajectoryPrediction* out) {
+	const Clock::time_point deadline = Clock::now()
+	                                   + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(TRAJECTORY_TIME_BUDGET));
+
+	if (env.terrain_seed != r.terrain_seed || env.wind_seed != r.wind_seed) env = MarsEnvironment(r.terrain_seed, r.wind_seed);
+
+	Object mars(NULL, r.mars.position, 0.0f, 1);
+	mars.velocity = r.mars.velocity;
+	mars.attitude_matrix = glm::mat3_cast(r.mars.attitude);
+	mars.ang_velocity = r.mars.ang_velocity;
+	mars.mass = MARS_MASS;
+
+	const double mass = r.mass;
+	const double frontal_area = r.frontal_area;
+	MarsEnvironment* e = &env;
+	AccelerationFunction acceleration = [&mars, e, mass, frontal_area](double time, glm::dvec3 position, glm::dvec3 velocity) {
+		glm::dvec3 force = grav_force(&mars, position, mass);
+
+		double air_density = mars_atm_density(&mars, position);
+		if (air_density > 0.0) force += drag_force(velocity, mars_wind_velocity(&mars, e, position, time), air_density, 1.0, frontal_area);
+
+		return force / mass;
+	};
+
+	DormandPrinceIntegrator integrator(1e-6, 1e-9);
+
+	double time = r.time;
+	glm::dvec3 position = r.position;
+	glm::dvec3 velocity = r.velocity;
+	double swept = 0.0; // angle around mars
+
+	out->generation = r.generation;
+	out->times.assign(1, time);
+	out->points.assign(1, position);
+	out->impact = false;
+	out->complete = true;
+
+	while (swept < 2.0 * M_PI && time - r.time < TRAJECTORY_MAX_DURATION) {
+		if (restart || stopping) return false;
+		if (out->points.size() >= TRAJECTORY_MAX_POINTS || Clock::now() > deadline) {
+			out->complete = false;
+			break;
+		}
+
+		const glm::dvec3 radius = position - mars.position;
+		const double distance = glm::length(radius);
+		const double angular_rate = glm::length(glm::cross(radius, velocity - mars.velocity)) / (distance * distance);
+
+		const double accel = glm::length(acceleration(time, position, velocity));
+
+		// Short enough not to turn too far, or stray from the straight line between points too far
+		double step = TRAJECTORY_MAX_STEP;
+		if (angular_rate > 0.0) step = glm::min(step, TRAJECTORY_MAX_TURN / angular_rate);
+		if (accel > 0.0) step = glm::min(step, std::sqrt(8.0 * TRAJECTORY_MAX_SAG / accel));
+		step = glm::max(step, TRAJECTORY_MIN_STEP);
+		if (distance - MARS_RADIUS < MARS_ATMOSPHERE_HEIGHT) step = glm::min(step, TRAJECTORY_ATMOSPHERE_STEP);
+
+		const DormandPrinceIntegrator prev_integrator = integrator;
+		const glm::dmat3 prev_attitude = mars.attitude_matrix;
+		const glm::dvec3 prev_position = position;
+		const glm::dvec3 prev_velocity = velocity;
+
+		integrator.advance(position, velocity, time, step, acceleration);
+		mars.update_attitude(step);
+
+		if (!above_surface(&mars, &env, &terrain, position)) {
+			// Narrow the step down to where it meets the surface
+			double above = 0.0, below = step;
+
+			for (int i = 0; i < IMPACT_ITERATIONS; i++) {
+				const double mid = 0.5 * (above + below);
+				DormandPrinceIntegrator trial = prev_integrator;
+				position = prev_position;
+				velocity = prev_velocity;
+				mars.attitude_matrix = prev_attitude;
+
+				trial.advance(position, velocity, time, mid, acceleration);
+				mars.update_attitude(mid);
+
+				if (above_surface(&mars, &env, &terrain, position)) above = mid;
+				else below = mid;
+			}
+
+			out->impact = true;
+			out->impact_time = time + 0.5 * (above + below);
+			out->impact_position = position;
+			out->impact_body_position = glm::transpose(mars.attitude_matrix) * (position - mars.position);
+			out->times.push_back(out->impact_time);
+			out->points.push_back(position);
+			break;
+		}
+
+		swept += std::acos(glm::clamp(glm::dot(radius, position - mars.position) / (distance * glm::length(position - mars.position)), -1.0, 1.0));
+		time += step;
+		out->times.push_back(time);
+		out->points.push_back(position);
+	}
+
+	return true;
+}
+
+// Whether the lander's base is above the terrain
+static bool above_surface(Object* mars, MarsEnvironment* env, TerrainCache* terrain, glm::dvec3 position) {
+	const glm::dvec3 radius = position - mars->position;
+	const double altitude = glm::length(radius) - MARS_RADIUS - BASE_COM_DIST;
+
+	// Clear of the highest terrain, no need to generate tiles (most of an orbit)
+	if (altitude > TERRAIN_MARGIN) return true;
+
+	return altitude > mars_surface_height(mars, env, terrain, TERRAIN_PHYSICS_LEVEL, radius);
+}
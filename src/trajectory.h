@@ -0,0 +1,99 @@
+// Ricardas Navickas 2020
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "sim_thread.h"
+#include "terrain_cache.h"
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define TRAJECTORY_MAX_POINTS 4096
+#define TRAJECTORY_MAX_TURN 0.01        // radians the lander goes around mars between points
+#define TRAJECTORY_MAX_SAG 0.05         // km the path may stray from the straight line between points
+#define TRAJECTORY_MIN_STEP 0.25        // s between points at least
+#define TRAJECTORY_MAX_STEP 120.0       // s between points at most
+#define TRAJECTORY_ATMOSPHERE_STEP 2.0  // s between points at most in the atmosphere
+#define TRAJECTORY_MAX_DURATION (2.0 * MARS_DAY) // s; escape trajectories end here
+#define TRAJECTORY_TIME_BUDGET 0.05     // s (wall clock) per prediction
+#define TRAJECTORY_MAX_ERROR 1.0        // km between the lander and its prediction before it is redone
+
+// Where the lander will go if the engines stay off
+struct TrajectoryPrediction {
+	unsigned int generation;         // of the snapshot it started from (see SimulationSnapshot)
+	std::vector<double> times;       // simulation time of each point
+	std::vector<glm::dvec3> points;  // world frame, from the lander's position at times[0]
+
+	bool impact;                     // ends on the surface
+	double impact_time;
+	glm::dvec3 impact_position;      // world frame, at impact_time
+	glm::dvec3 impact_body_position; // mars' body frame (relative to its center)
+
+	bool complete; // false if cut short by TRAJECTORY_TIME_BUDGET (or TRAJECTORY_MAX_POINTS)
+};
+
+// Propagates the lander's trajectory on its own thread, with gravity, drag in the rotating atmosphere
+// (including wind) and the terrain, until it hits the surface, goes once around mars or runs out of time.
+// The render thread hands it snapshots through update(); a new prediction is started from the latest
+// one whenever the lander strays from the current prediction (e.g. because of a burn), once the
+// running one is finished. A prediction running when the simulation jumps (see generation) is abandoned.
+class TrajectoryPredictor {
+public:
+	TrajectoryPredictor();
+	~TrajectoryPredictor();
+
+	// Render thread: compares the lander in view with the prediction and requests a new one if they
+	// diverged. Returns true if prediction changed.
+	bool update(const SimulationSnapshot& view, unsigned int terrain_seed, unsigned int wind_seed);
+
+	// Render thread only: the latest finished prediction (no points if there is none)
+	TrajectoryPrediction prediction;
+
+	// Wall time (s) taken by the last prediction
+	std::atomic<double> last_duration;
+
+private:
+	struct Request {
+		unsigned int generation;
+		double time;
+		glm::dvec3 position, velocity;
+		double mass, frontal_area;
+		ObjectSnapshot mars;
+		unsigned int terrain_seed, wind_seed;
+	};
+
+	bool diverged(const SimulationSnapshot& view);
+	void loop();
+	bool predict(const Request& r, TrajectoryPrediction* out); // false if abandoned
+
+	std::thread thread;
+	std::atomic<bool> stopping;
+	std::atomic<bool> restart; // the simulation jumped, the running prediction is useless
+
+	// Guarded by lock
+	std::mutex lock;
+	std::condition_variable wakeup;
+	Request request;
+	bool have_request;
+	TrajectoryPrediction result;
+	bool have_result;
+
+	// Render thread only
+	bool requested; // waiting for a prediction
+	unsigned int requested_generation;
+
+	// Prediction thread only
+	MarsEnvironment env;
+	TerrainCache terrain;
+};
+
+// Rendering (defined in trajectory_model.cpp)
+Object* make_trajectory_object();                 // predicted path, drawn as a nofx object
+Object* make_impact_marker_object(float radius);
+void update_trajectory_object(Object* obj, const TrajectoryPrediction& p);
+void update_impact_markers(Object* impact, Object* landing_site, Object* mars, const TrajectoryPrediction& p); // where the lander hits (world frame at impact time) & that spot on the surface now
+
+#endif
@@ -0,0 +1,64 @@
+// Ricardas Navickas 2020
+#include "core/core.h"
+#include "trajectory.h"
+
+static const glm::vec3 trajectory_color(1.0f, 0.6f, 0.2f);
+
+Object* make_trajectory_object() {
+	Mesh* mesh = new Mesh;
+	mesh->vertex_data.resize(VERTEX_DATA_LEN * TRAJECTORY_MAX_POINTS); // so that predictions are uploaded in place
+	mesh->indices.resize(2 * TRAJECTORY_MAX_POINTS);
+
+	Model* model = new Model(mesh, GL_LINES, true);
+	mesh->vertex_data.clear();
+	mesh->indices.clear();
+	model->reload_mesh();
+
+	return new Object(model, glm::dvec3(0.0), 0.0f, 1);
+}
+
+Object* make_impact_marker_object(float radius) {
+	Mesh* mesh = new Mesh;
+	*mesh = make_uv_sphere_mesh(12, 6, trajectory_color.x, trajectory_color.y, trajectory_color.z);
+	transform_mesh(mesh, glm::scale(glm::mat4(1.0f), glm::vec3(radius)));
+
+	Model* model = new Model(mesh, GL_TRIANGLES);
+	return new Object(model, glm::dvec3(0.0), 0.0f, 1);
+}
+
+void update_trajectory_object(Object* obj, const TrajectoryPrediction& p) {
+	Mesh* m = obj->model->mesh;
+	const int n = p.points.size();
+
+	m->vertex_data.resize(VERTEX_DATA_LEN * n);
+	m->indices.clear();
+
+	// Vertices relative to the first point (near the lander) for precision up close
+	if (n > 0) obj->position = p.points[0];
+
+	for (int i = 0; i < n; i++) {
+		float alpha_multiplier = 1.0f - 0.8f * float(i) / n;
+
+		set_vertex_coords(m, i, p.points[i] - obj->position);
+		set_vertex_normal(m, i, glm::vec3(alpha_multiplier, 0.0f, 0.0f));
+		set_vertex_color(m, i, trajectory_color);
+
+		if (i != n - 1) {
+			m->indices.push_back(i);
+			m->indices.push_back(i + 1);
+		}
+	}
+
+	obj->model->reload_mesh();
+}
+
+void update_impact_markers(Object* impact, Object* landing_site, Object* mars, const TrajectoryPrediction& p) {
+	if (p.impact && !p.points.empty()) {
+		impact->position = p.impact_position;
+		landing_site->position = mars->position + mars->attitude_matrix * p.impact_body_position;
+	} else {
+		// Hidden inside mars
+		impact->position = glm::dvec3(0.0);
+		landing_site->position = glm::dvec3(0.0);
+	}
+}